@@ -24,20 +24,67 @@ import {withLineNumbers} from '/www/linenumbers.min.js';
 // WebSocket connection and handling //////////////////////////////////////////////////////////////
 
 let ws; // WebSocket connection
-let pendingFile; // File pending for upload
+let pendingFile; // File pending for upload (kept until complete, for resuming)
+let pendingPath; // Device path of pending upload
+let binaryProto = false; // Binary protocol negotiated
+let requestId = 0; // Last binary request ID
+let fileSeq = 0; // Sequence number of the last file index change applied
+
+const CLI_MAX_LINES = 5000; // Default console line cap
+const CLI_OVERSCAN = 20; // Lines drawn above and below the visible ones
+let cliLines = []; // Console history, one string per line
+let cliPending = []; // Messages received since the last redraw
+let cliRenderPending = false; // Redraw requested
+let cliMaxLines = CLI_MAX_LINES; // Console line cap
+let cliLineHeight = 20; // Console line height in px
+
+// Binary protocol opcodes and acknowledge statuses (see webserver.h)
+const WSB = {
+	CLI: 0x01,
+	OUTPUT: 0x02,
+	FILE_LIST: 0x03,
+	UPLOAD: 0x04,
+	UPLOAD_DATA: 0x05,
+	DELETE: 0x06,
+	KILL: 0x07,
+	ACK: 0x08,
+	RESULT: 0x09,
+	RUN: 0x0A,
+	TELEMETRY: 0x0B,
+	WATCH: 0x0C,
+	FILE_DELTA: 0x0D
+};
+const WSB_STATUS = ['ok', 'tooLarge', 'protected', 'failed', 'corrupt'];
+const UPLOAD_CHUNK = 16384; // Bytes of file per upload data message
+const textEncoder = new TextEncoder();
+const textDecoder = new TextDecoder();
 
 // Connect to WebSocket
 function connectWS() {
 	ws = new WebSocket('ws://' + location.host + '/ws', ['arduino']);
+	ws.binaryType = 'arraybuffer';
 
-	// Handle incoming JSON
+	// Negotiate binary protocol, JSON is used until ESP agrees
+	ws.addEventListener('open', function() {
+		ws.send('{"type":"binary"}');
+	});
+
+	// Reconnect, interrupted upload is resumed once connected
+	ws.addEventListener('close', function() {
+		binaryProto = false;
+		setTimeout(connectWS, 1000);
+	});
+
+	// Handle incoming JSON or binary message
 	ws.onmessage = function(event) {
+		if (event.data instanceof ArrayBuffer) {
+			handleBinary(event.data);
+			return;
+		}
+
 		// Parse received JSON
 		let obj = JSON.parse(event.data);
 
-		// Debug
-		console.log(obj);
-
 		// Decide message type
 		if (obj.type == 'cli') {
 			// Print message to CLI
@@ -45,83 +92,532 @@ function connectWS() {
 
 		} else if (obj.type == 'fileList') {
 			// Update file select
-			updateFileList(obj.paths);
+			updateFileList(obj.files, obj.seq);
+
+		} else if (obj.type == 'fileDelta') {
+			// File created, changed or removed (size -1)
+			updateFileDelta(obj.seq, obj.path, obj.size);
 
 		} else if (obj.type == 'upload') {
 			// Complete file upload
 			if (obj.status == 'ready') {
 				// ESP is ready for upload. Engage!
-				uploadFile();
+				uploadFile(0);
 			} else {
 				// ESP refused upload. Clear pending file object.
 				pendingFile = null;
 				alert('Upload aborted: ' + obj.status);
 			}
 
+		} else if (obj.type == 'uploaded') {
+			// File written and verified (or not)
+			uploadDone(obj.status, obj.bytes, obj.ms);
+
 		} else if (obj.type == 'delete') {
 			// File deletion status
-			if (obj.status == 'ok') {
-				// File deleted, update file list
-				requestFileList();
-			} else {
+			if (obj.status != 'ok') {
 				alert('Deletion failed: ' + obj.status);
 			}
+
+		} else if (obj.type == 'binary') {
+			// Binary protocol negotiation
+			binaryProto = (obj.status == 'ok');
+			if (binaryProto && pendingFile) {
+				updateCliOut('Resuming upload of ' + pendingPath + '...');
+				requestUpload(pendingPath);
+			}
+
+		} else if (obj.type == 'watch') {
+			if (obj.index) {
+				// Changed watched variables
+				obj.index.forEach((index, i) => updateWatch(index, obj.value[i]));
+			} else if (obj.status == 'unknown') {
+				updateCliOut('Watch: no such variable: ' + obj.name);
+			} else if (obj.status == 'dropped') {
+				updateCliOut('Watch stopped: dictionary changed, watch the variables again.');
+			} else if (obj.status != 'ok') {
+				updateCliOut('Watch failed: ' + obj.status);
+			}
+
+		} else if (obj.type == 'role') {
+			if (obj.status) {
+				// Request refused, only the controller sends input
+				updateCliOut('Ignored: observers cannot send input. Take control first.');
+			} else {
+				// Role assigned or changed
+				updateCliOut('Connected as ' + obj.role + '.');
+				$( '#controlButton' ).prop('hidden', obj.role == 'controller');
+			}
+		}
+	}
+}
+
+// Handle binary protocol message: [opcode] [request ID] [payload]
+function handleBinary(buffer) {
+	const opcode = new DataView(buffer).getUint8(0);
+	const payload = new Uint8Array(buffer, 5);
+
+	if (opcode == WSB.TELEMETRY) {
+		// Samples for the plot
+		handleTelemetry(buffer);
+
+	} else if (opcode == WSB.WATCH) {
+		// Changed watched variables: [index, byte] [value, int32]...
+		const view = new DataView(buffer);
+		for (let i = 5; i + 5 <= buffer.byteLength; i += 5) {
+			updateWatch(view.getUint8(i), view.getInt32(i + 1, true));
+		}
+
+	} else if (opcode == WSB.OUTPUT) {
+		// Print raw output to CLI
+		updateCliOut(textDecoder.decode(payload));
+
+	} else if (opcode == WSB.FILE_LIST) {
+		// [seq] ([size] [path] \0)...
+		const view = new DataView(buffer);
+		const bytes = new Uint8Array(buffer);
+		const files = [];
+		for (let i = 9; i + 4 < bytes.length; ) {
+			const end = bytes.indexOf(0, i + 4);
+			if (end < 0) {
+				break;
+			}
+			files.push([textDecoder.decode(bytes.subarray(i + 4, end)), view.getUint32(i, true)]);
+			i = end + 1;
+		}
+		updateFileList(files, view.getUint32(5, true));
+
+	} else if (opcode == WSB.FILE_DELTA) {
+		// [size, -1 if removed] [mtime] [path], ID is the sequence number
+		const view = new DataView(buffer);
+		updateFileDelta(view.getUint32(1, true), textDecoder.decode(payload.subarray(8)),
+		                view.getInt32(5, true));
+
+	} else if (opcode == WSB.ACK) {
+		// Acknowledge: [request opcode] [status] [path]
+		const request = payload[0];
+		const status = WSB_STATUS[payload[1]];
+
+		if (request == WSB.UPLOAD) {
+			if (status == 'ok') {
+				// Send data from the offset ESP has (resumed upload)
+				const extra = ackExtra(buffer);
+				uploadFile(extra ? extra.getUint32(0, true) : 0);
+			} else {
+				pendingFile = null;
+				alert('Upload aborted: ' + status);
+			}
+		} else if (request == WSB.UPLOAD_DATA) {
+			// File complete: [bytes] [ms] of this session
+			const extra = ackExtra(buffer);
+			uploadDone(status, extra && extra.getUint32(0, true), extra && extra.getUint32(4, true));
+		} else if (request == WSB.DELETE) {
+			if (status != 'ok') {
+				alert('Deletion failed: ' + status);
+			}
 		}
 	}
 }
 
-// Upload file
-function uploadFile() {
+// Extra data of binary acknowledge (after path and null terminator), null if none
+function ackExtra(buffer) {
+	const payload = new Uint8Array(buffer, 5);
+	const end = payload.indexOf(0, 2);
+	return end < 0 ? null : new DataView(buffer, 5 + end + 1);
+}
+
+// Send binary protocol message, payload parts are typed arrays or blobs
+function sendBinary(opcode, id, ...payload) {
+	let header = new DataView(new ArrayBuffer(5));
+	header.setUint8(0, opcode);
+	header.setUint32(1, id, true);
+	ws.send(new Blob([header, ...payload]));
+}
+
+// Send ATLAST code to CLI
+function sendCli(code) {
+	if (binaryProto) {
+		// Request ID 0: plain output, no result message
+		sendBinary(WSB.CLI, 0, textEncoder.encode(code));
+	} else {
+		// Wrap code in JSON and send
+		let obj = {
+			type: 'cli',
+			data: code
+		};
+		ws.send(JSON.stringify(obj));
+	}
+}
+
+// Run ATLAST source: loaded line by line like a file, nothing is saved
+function sendRun(code) {
+	if (binaryProto) {
+		sendBinary(WSB.RUN, 0, textEncoder.encode(code));
+	} else {
+		// Header line followed by source
+		ws.send('{"type":"run"}\n' + code);
+	}
+}
+
+// CRC-32 (IEEE 802.3) lookup table
+const crcTable = new Uint32Array(256).map(function(_, n) {
+	let c = n;
+	for (let k = 0; k < 8; k++) {
+		c = (c >>> 1) ^ (0xEDB88320 & -(c & 1));
+	}
+	return c;
+});
+
+// CRC-32 of byte array
+function crc32(bytes) {
+	let crc = 0xFFFFFFFF;
+	for (let i = 0; i < bytes.length; i++) {
+		crc = (crc >>> 8) ^ crcTable[(crc ^ bytes[i]) & 0xFF];
+	}
+	return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+// Request upload of pending file to path, ESP verifies it with CRC-32
+async function requestUpload(path) {
+	pendingPath = path;
+	const crc = crc32(new Uint8Array(await pendingFile.arrayBuffer()));
+
+	if (binaryProto) {
+		let header = new DataView(new ArrayBuffer(8));
+		header.setUint32(0, pendingFile.size, true);
+		header.setUint32(4, crc, true);
+		sendBinary(WSB.UPLOAD, ++requestId, header, textEncoder.encode(path));
+	} else {
+		// Send upload request in JSON
+		let obj = {
+			type: 'upload',
+			name: path,
+			size: pendingFile.size,
+			crc: crc
+		};
+		ws.send(JSON.stringify(obj));
+	}
+}
+
+// Upload file from offset, ESP acknowledges the complete file
+function uploadFile(offset) {
+	if (binaryProto) {
+		// Queue all chunks at once, ESP writes them while more arrive
+		for (let pos = offset; pos < pendingFile.size; pos += UPLOAD_CHUNK) {
+			let header = new DataView(new ArrayBuffer(4));
+			header.setUint32(0, pos, true);
+			sendBinary(WSB.UPLOAD_DATA, ++requestId, header, pendingFile.slice(pos, pos + UPLOAD_CHUNK));
+		}
+		return;
+	}
+
 	// Send file blob
 	ws.send(pendingFile);
-	console.log('File sent.');
+}
 
-	// Clear pending file object
+// Report finished upload with throughput, update file list
+function uploadDone(status, bytes, ms) {
+	if (status == 'ok') {
+		let report = 'Upload finished: ' + pendingPath;
+		if (bytes) {
+			report += ', ' + bytes + ' B in ' + ms + ' ms (' + (bytes / 1.024 / Math.max(ms, 1)).toFixed(1) + ' kB/s)';
+		}
+		updateCliOut(report);
+	} else {
+		alert('Upload failed: ' + status);
+	}
 	pendingFile = null;
-
-	// Request updated file list
-	requestFileList();
 }
 	
-// Add message to history
+// Add message to history, shown with the next animation frame
 function updateCliOut(addition) {
-	let cliOut = $( '#cliOut' );
+	cliPending.push(addition);
+	requestCliRender();
+}
 
-	// Split message into lines, filter out empty strings
-	let lines = addition.split('\n').filter(s => s);
+// Request console redraw, bursts of messages are drawn at once
+function requestCliRender() {
+	if (!cliRenderPending) {
+		cliRenderPending = true;
+		requestAnimationFrame(renderCliOut);
+	}
+}
 
-	// Show lines separated with <br>
-	$.each (lines, function(i, line) {
-		if (!cliOut.is(':empty')) {
-			cliOut.append('<br>');
+// Move pending messages into history and draw the visible lines only
+function renderCliOut() {
+	cliRenderPending = false;
+	const cliOut = document.getElementById('cliOut');
+	const atBottom = cliOut.scrollTop + cliOut.clientHeight >= cliOut.scrollHeight - cliLineHeight;
+
+	// Split messages into lines, filter out empty strings
+	for (const addition of cliPending) {
+		for (const line of addition.split('\n')) {
+			if (line) {
+				cliLines.push(line);
+			}
 		}
-		cliOut.append(line);
+	}
+	cliPending = [];
+
+	// Drop oldest lines over the cap (in one go, not per line)
+	if (cliLines.length > cliMaxLines) {
+		cliLines.splice(0, cliLines.length - cliMaxLines);
+	}
+
+	// Spacer holds the height of all lines, only the visible ones exist
+	const spacer = document.getElementById('cliSpacer');
+	spacer.style.height = (cliLines.length * cliLineHeight) + 'px';
+
+	// Follow output unless scrolled up
+	if (atBottom) {
+		cliOut.scrollTop = cliOut.scrollHeight;
+	}
+
+	const first = Math.max(0, Math.floor(cliOut.scrollTop / cliLineHeight) - CLI_OVERSCAN);
+	const last = Math.min(cliLines.length,
+		Math.ceil((cliOut.scrollTop + cliOut.clientHeight) / cliLineHeight) + CLI_OVERSCAN);
+	const view = document.getElementById('cliLines');
+	view.style.top = (first * cliLineHeight) + 'px';
+	view.textContent = cliLines.slice(first, last).join('\n');
+}
+
+// Set up console: line height, line cap and redraw on scroll
+function initCliOut() {
+	const view = document.getElementById('cliLines');
+	cliLineHeight = parseFloat(getComputedStyle(view).lineHeight) || 20;
+
+	// Line cap is kept across page loads
+	const cap = $( '#cliCapIn' );
+	cap.val(localStorage.getItem('cliMaxLines') || CLI_MAX_LINES);
+	cap.change(function() {
+		cliMaxLines = Math.max(100, Number(cap.val()) || CLI_MAX_LINES);
+		cap.val(cliMaxLines);
+		localStorage.setItem('cliMaxLines', cliMaxLines);
+		requestCliRender();
 	});
+	cliMaxLines = Math.max(100, Number(cap.val()) || CLI_MAX_LINES);
 
-	// Scroll to bottom
-	cliOut.scrollTop(Number.MAX_SAFE_INTEGER);
+	$( '#cliOut' ).scroll(requestCliRender);
+	// Console may be resized by the user
+	new ResizeObserver(requestCliRender).observe(document.getElementById('cliOut'));
 }
 
-// Update file select from received array
-function updateFileList(paths) {
+// Update file select from received array of [path, size]
+function updateFileList(files, seq) {
+	fileSeq = seq;
+
 	// Clear old options
 	$( '#fileSelect' ).empty();
 
 	// Add option for each array member
-	$.each(paths, function(index, path) {   
+	$.each(files, function(index, file) {
 		$( '#fileSelect' )
 			.append($( '<option></option>' )
-					   .text(path));
-   });
+					   .text(file[0])
+					   .attr('title', file[1] + ' B'));
+	});
+}
+
+// Apply file index change, size is -1 if the file was removed
+function updateFileDelta(seq, path, size) {
+	// Change already in the list
+	if (seq <= fileSeq) {
+		return;
+	}
+	// A change was missed, get the whole list
+	if (seq != fileSeq + 1) {
+		requestFileList();
+		return;
+	}
+	fileSeq = seq;
+
+	// Options are sorted by path like the index on ESP
+	const options = $( '#fileSelect option' ).toArray();
+	const next = options.find(option => option.text >= path);
+	if (next && next.text == path) {
+		if (size < 0) {
+			next.remove();
+		} else {
+			next.title = size + ' B';
+		}
+	} else if (size >= 0) {
+		const option = $( '<option></option>' ).text(path).attr('title', size + ' B');
+		if (next) {
+			option.insertBefore(next);
+		} else {
+			$( '#fileSelect' ).append(option);
+		}
+	}
 }
 
 // Request file list
 function requestFileList() {
+	if (binaryProto) {
+		sendBinary(WSB.FILE_LIST, ++requestId);
+		return;
+	}
 	// Send file list request JSON
 	ws.send('{"type":"fileList"}');
 }
 
 
+// Telemetry plot ////////////////////////////////////////////////////////////////////////////////
+
+const PLOT_POINTS = 2048; // Samples kept per stream
+const PLOT_COLORS = ['#50fa7b', '#ff79c6', '#8be9fd', '#f1fa8c', '#bd93f9', '#ffb86c', '#ff5555', '#f8f8f2'];
+// Telemetry sample types (see telemetry.h): cells, bytes, floats
+const TLM_TYPES = [Int32Array, Uint8Array, Float64Array];
+const TLM_OFFSET = 8; // Samples start in message
+
+let plotStreams = []; // Ring buffer of samples per stream ID
+let plotPending = false; // Redraw requested
+
+// Append telemetry message: [header] [stream] [type] [reserved] [samples]
+function handleTelemetry(buffer) {
+	const view = new DataView(buffer);
+	const stream = view.getUint8(5);
+	const Type = TLM_TYPES[view.getUint8(6)];
+	if (!Type) {
+		return;
+	}
+	// View samples in place, no copy or parsing
+	const samples = new Type(buffer, TLM_OFFSET, (buffer.byteLength - TLM_OFFSET) / Type.BYTES_PER_ELEMENT);
+
+	let ring = plotStreams[stream];
+	if (!ring) {
+		ring = plotStreams[stream] = {data: new Float64Array(PLOT_POINTS), head: 0, count: 0};
+		$( '#plotWindow' ).prop('hidden', false);
+	}
+
+	// Only the newest PLOT_POINTS samples are ever shown
+	const start = Math.max(0, samples.length - PLOT_POINTS);
+	for (let i = start; i < samples.length; i++) {
+		ring.data[ring.head] = samples[i];
+		ring.head = (ring.head + 1) % PLOT_POINTS;
+	}
+	ring.count = Math.min(PLOT_POINTS, ring.count + samples.length - start);
+
+	// Redraw at most once per animation frame
+	if (!plotPending) {
+		plotPending = true;
+		requestAnimationFrame(drawPlot);
+	}
+}
+
+// Draw all streams, newest sample on the right, common vertical scale
+function drawPlot() {
+	plotPending = false;
+	const canvas = document.getElementById('plotCanvas');
+	const ctx = canvas.getContext('2d');
+
+	// Match canvas resolution to its size on screen
+	const width = canvas.clientWidth * devicePixelRatio;
+	const height = canvas.clientHeight * devicePixelRatio;
+	if (canvas.width != width || canvas.height != height) {
+		canvas.width = width;
+		canvas.height = height;
+	}
+	ctx.clearRect(0, 0, width, height);
+
+	// Vertical range over all streams
+	let min = Infinity;
+	let max = -Infinity;
+	plotStreams.forEach(function(ring) {
+		for (let i = 0; i < ring.count; i++) {
+			const v = ring.data[(ring.head - 1 - i + PLOT_POINTS) % PLOT_POINTS];
+			min = Math.min(min, v);
+			max = Math.max(max, v);
+		}
+	});
+	if (min > max) {
+		return;
+	}
+	if (min == max) {
+		min -= 1;
+		max += 1;
+	}
+	const scaleX = width / (PLOT_POINTS - 1);
+	const scaleY = (height - 2) / (max - min);
+
+	// Stream polylines
+	ctx.lineWidth = devicePixelRatio;
+	plotStreams.forEach(function(ring, stream) {
+		ctx.strokeStyle = PLOT_COLORS[stream % PLOT_COLORS.length];
+		ctx.beginPath();
+		for (let i = 0; i < ring.count; i++) {
+			const v = ring.data[(ring.head - ring.count + i + PLOT_POINTS) % PLOT_POINTS];
+			const x = width - (ring.count - 1 - i) * scaleX;
+			const y = height - 1 - (v - min) * scaleY;
+			if (i == 0) {
+				ctx.moveTo(x, y);
+			} else {
+				ctx.lineTo(x, y);
+			}
+		}
+		ctx.stroke();
+	});
+
+	// Range and legend with the newest value of each stream
+	ctx.font = (12 * devicePixelRatio) + 'px monospace';
+	ctx.fillStyle = '#f8f8f2';
+	ctx.textBaseline = 'top';
+	ctx.fillText(max, 4, 4);
+	ctx.textBaseline = 'bottom';
+	ctx.fillText(min, 4, height - 4);
+	ctx.textBaseline = 'top';
+	let legendY = 4;
+	plotStreams.forEach(function(ring, stream) {
+		const last = ring.data[(ring.head - 1 + PLOT_POINTS) % PLOT_POINTS];
+		const text = stream + ': ' + last;
+		ctx.fillStyle = PLOT_COLORS[stream % PLOT_COLORS.length];
+		ctx.fillText(text, width - ctx.measureText(text).width - 4, legendY);
+		legendY += 14 * devicePixelRatio;
+	});
+}
+
+// Clear all streams and hide the plot
+function clearPlot() {
+	$( '#plotClearButton' ).click(function() {
+		plotStreams = [];
+		$( '#plotWindow' ).prop('hidden', true);
+	});
+}
+
+
+// Variable watch /////////////////////////////////////////////////////////////////////////////////
+
+// Show changed value of watched variable, highlighted until the next change
+function updateWatch(index, value) {
+	const cell = $( '#watchTable td.value' ).eq(index);
+	cell.text(value);
+	cell.removeClass('changed');
+	// Restart highlight
+	void cell[0].offsetWidth;
+	cell.addClass('changed');
+	clearTimeout(cell.data('timer'));
+	cell.data('timer', setTimeout(() => cell.removeClass('changed'), 300));
+}
+
+// Subscribe to variables, values are pushed only when they change
+function watchVariables() {
+	$( '#watchButton' ).click(function() {
+		const names = $( '#watchNamesIn' ).val().trim().split(/\s+/).filter(s => s);
+		const interval = Number($( '#watchIntervalIn' ).val()) || 100;
+
+		// One row per name, in subscription order (pushes refer to the index)
+		const table = $( '#watchTable' ).empty();
+		names.forEach(function(name) {
+			table.append($( '<tr></tr>' )
+				.append($( '<td></td>' ).text(name))
+				.append($( '<td class="value"></td>' ).text('?')));
+		});
+		table.prop('hidden', names.length == 0);
+
+		ws.send(JSON.stringify({type: 'watch', names: names.join(' '), interval: interval}));
+	});
+}
+
+
 // Code editor ////////////////////////////////////////////////////////////////////////////////////
 
 let jar; // CodeJar object
@@ -193,13 +689,30 @@ function getFileSelect() {
 }
 
 
+// Log page load time and bytes transferred (0 for resources answered 304 or cached)
+function reportPageLoad() {
+	const nav = performance.getEntriesByType('navigation')[0];
+	if (!nav) {
+		return;
+	}
+	let bytes = nav.transferSize;
+	for (const res of performance.getEntriesByType('resource')) {
+		bytes += res.transferSize;
+	}
+	console.log(`Page loaded in ${Math.round(nav.loadEventStart)} ms, ${bytes} bytes transferred`);
+}
+
+
 // DOM event handlers /////////////////////////////////////////////////////////////////////////////
 
 // Handler: On button click, kill running ATLAST program
 function killProgram() {
 	// Send KILL request JSON, include parameter from checkbox
 	$( '#killButton' ).click(function() {
-		if ($( '#restartTaskBox ').is(':checked')) {
+		const restart = $( '#restartTaskBox ').is(':checked');
+		if (binaryProto) {
+			sendBinary(WSB.KILL, ++requestId, new Uint8Array([restart ? 1 : 0]));
+		} else if (restart) {
 			ws.send('{"type":"kill","data":true}');
 		} else {
 			ws.send('{"type":"kill","data":false}');
@@ -207,6 +720,13 @@ function killProgram() {
 	});
 }
 
+// Handler: On button click take control from another client
+function takeControl() {
+	$( '#controlButton' ).click(function() {
+		ws.send('{"type":"role","role":"controller"}');
+	});
+}
+
 // Handler: on ENTER key send CLI input
 function sendInput() {
 	const cliIn = $( '#cliIn' );
@@ -222,12 +742,8 @@ function sendInput() {
 				return;
 			}
 
-			// Wrap message in JSON and send
-			let obj = {
-				type: 'cli',
-				data: msg
-			};
-			ws.send(JSON.stringify(obj));
+			// Send message
+			sendCli(msg);
 
 			// Clear input
 			cliIn.val('');
@@ -285,26 +801,21 @@ function executeFile() {
 		// Get file path
 		let path = getFileSelect();
 		if (path) {
-			// ATLAST code to run
-			// Declare file (non-unique descriptor "FEXE" when repeated - ugly, but harmless)
-			let code = 'FILE FEXE ';
-			// Open desired file for reading, discard return value
-			code += '"' + path + '" 1 FEXE FOPEN DROP ';
-			// Execute file, discard return value
-			code += 'FEXE FLOAD DROP ';
-			// Close file after execution
-			code += 'FEXE FCLOSE';
-
-			// Wrap code in JSON and send
-			let obj = {
-				type: 'cli',
-				data: code
-			};
-			ws.send(JSON.stringify(obj));
+			// Fetch file and run it (no file descriptor word is left behind)
+			$.get(path, function(data) {
+				sendRun(data);
+			}, 'text');
 		}
 	})
 }
 
+// Handler: On click run code from editor
+function runEditorCode() {
+	$( '#editorRunButton' ).click(function() {
+		sendRun(jar.toString());
+	});
+}
+
 // Handler: On click delete file from ESP
 function deleteFile() {
 	// On delete button click
@@ -312,6 +823,10 @@ function deleteFile() {
 		// Get file path
 		let path = getFileSelect();
 		if (path) {
+			if (binaryProto) {
+				sendBinary(WSB.DELETE, ++requestId, textEncoder.encode(path));
+				return;
+			}
 			// Send delete request with file path in JSON
 			let obj = {
 				type: 'delete',
@@ -342,13 +857,8 @@ function requestCodeUpload() {
 			{type: 'text/plain;charset=utf-8'}
 		);
 
-		// Send upload request in JSON
-		let obj = {
-			type: 'upload',
-			name: path,
-			size: code.length
-		};
-		ws.send(JSON.stringify(obj));
+		// Request upload (size in bytes, not characters)
+		requestUpload(path);
 	});
 }
 
@@ -371,13 +881,8 @@ function requestFileUpload() {
 		if (path) {
 			pendingFile = fileUpDialog[0].files[0];
 
-			// Send upload request in JSON
-			let obj = {
-				type: 'upload',
-				name: path,
-				size: pendingFile.size
-			};
-			ws.send(JSON.stringify(obj));
+			// Request upload
+			requestUpload(path);
 		}
 
 		// Clear file dialog value (so same filename can trigger this event)
@@ -419,16 +924,24 @@ function editLocalFile() {
 
 // Create code editor
 $(initEditor);
+// Set up console
+$(initCliOut);
 // Connect to WebSocket
 $(connectWS);
 // Set up DOM event handlers
 $(killProgram);
+$(takeControl);
+$(clearPlot);
+$(watchVariables);
 $(sendInput);
 $(refreshFileList);
 $(downloadFile);
 $(editDeviceFile);
 $(executeFile);
+$(runEditorCode);
 $(deleteFile);
 $(requestCodeUpload);
 $(requestFileUpload);
-$(editLocalFile);
\ No newline at end of file
+$(editLocalFile);
+// Report page load once all assets are in
+$(window).on('load', () => setTimeout(reportPageLoad));
\ No newline at end of file
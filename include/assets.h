@@ -0,0 +1,46 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define ASSETS_DIR "/www/"
+#define ASSETS_MAX 16                   // Precompressed files indexed at boot
+#define ASSETS_CACHE "no-cache"         // Revalidate with ETag on every load (answered 304)
+
+/**
+ * Assets index
+ * 
+ * Find gzipped web assets and compute their ETags (CRC-32 of file content).
+ * Call once before serving.
+ */
+void assetsIndex();
+
+/**
+ * Assets handler
+ * 
+ * Serve a web asset, "/" maps to the index page. Indexed assets are sent
+ * precompressed with ETag and Cache-Control, matching If-None-Match gets
+ * 304. Other files are served as they are.
+ * A handler of its own rather than server.on(), whose handler never asks
+ * the server to keep the If-None-Match header.
+ */
+class AssetsHandler : public AsyncWebHandler {
+public:
+    bool canHandle(AsyncWebServerRequest * request) override;
+    void handleRequest(AsyncWebServerRequest * request) override;
+};
@@ -16,42 +16,95 @@
  */
 
 #include <Arduino.h>
-#include <SPIFFS.h>
-#include <queue>
-
-#include "atlast-1.2-esp32/atldef.h"
 
 #define ATL_TASK_NAME "atl"
+#define ATL_RESTART_TASK_NAME "atl_restart"
+#define ATL_CORE 1  // Core running ATLAST (the other one is left to jobs)
+
+#define ATL_CMD_SLOTS 16    // Number of preallocated command slots
+#define ATL_CMD_LEN 256     // Command length held in slot, longer ones go to heap
+#define ATL_RESULT_LEN 1024 // Maximum output captured for a command result
+
+#define ATL_CMD_REJECTED -100   // Result status of a command not enqueued
+
+#define ATL_KILL_TIMEOUT_MS 200 // Time for killed program to stop before restart
+
+#define ATL_RUN_STREAM 4096     // Buffer between run message and interpreter
+#define ATL_RUN_LINE 256        // Longest run line, longer lines are split
+#define ATL_RUN_WAIT_MS 20      // Interpreter check interval while starved
+#define ATL_RUN_BACKLOG 32768   // Run source held on heap while the buffer is full
+
 
+#ifdef __cplusplus  // Certain functions are included by C files
+
+// Command slot
+struct atlastCmd {
+    char text[ATL_CMD_LEN];
+    char * longText;    // Heap copy of command not fitting `text`, or NULL
+    int64_t enqueued;   // Time of enqueueing in us (esp_timer)
+    uint32_t id;        // Client-chosen command ID
+    uint32_t client;    // Websocket client to send result to
+    bool hasId;         // Send structured result on completion
+    bool quiet;         // Do not echo command and acknowledgement
+    bool run;           // Load source from run stream instead of text
+    bool watch;         // Look up watched variable names instead of evaluating text
+};
 
 // Run Data
 struct runData {
-    std::queue<std::string> commands;
-    bool startFlag;
     volatile bool killFlag;
-    bool isRunning;
+    volatile bool isRunning;
+    int64_t lastLatency;    // Enqueue-to-start time of last command in us
+    int64_t maxLatency;     // Maximum enqueue-to-start time in us
 };
 extern struct runData rd;
 
-// Run Data mutex
-extern SemaphoreHandle_t atlastRunMutex;
 extern TaskHandle_t atlastTaskHandle;
 
 
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * ATLAST last latency
+ * 
+ * Return enqueue-to-start time of the last executed command in us.
+ */
+int64_t atlastLastLatency();
+
+/**
+ * ATLAST sleep
+ * 
+ * Block the interpreter task for `ms` milliseconds.
+ * Returns early if ATLAST is killed meanwhile.
+ */
+void atlastSleep(uint32_t ms);
+
+/**
+ * ATLAST killed
+ * 
+ * Return true if the running program is being killed.
+ */
+bool atlastKilled();
+
+#ifdef __cplusplus
+}
+
+
 /**
- * ATLAST start run
+ * ATLAST next command
  * 
- * Check start flag. If true, start execution.
- * Returns true on program start, false otherwise.
+ * Block until a command is enqueued.
+ * Returns index of the command slot to execute.
  */
-bool atlastStartRun();
+uint8_t atlastNextCommand();
 
 /**
- * ATLAST reset run
+ * ATLAST release command
  * 
- * Reset Run Data and release mutex.
+ * Return command slot to the pool of free slots.
  */
-void atlastResetRun();
+void atlastReleaseCommand(uint8_t slot);
 
 /**
  * ATLAST interpreter loop
@@ -65,8 +118,55 @@ void atlastInterpreterLoop(void * pvParameter);
  * ATLAST command
  * 
  * Evaluate ATLAST command.
+ * Waits up to `wait` ticks for a free command slot.
+ * Returns false if the command could not be enqueued.
+ */
+bool atlastCommand(char* command, TickType_t wait = 0);
+
+/**
+ * ATLAST command with ID
+ * 
+ * Evaluate ATLAST command submitted with a client-chosen ID.
+ * Output is captured and sent back in a structured result on completion.
+ * Quiet commands are neither echoed nor acknowledged in CLI output.
+ * Returns false if the command could not be enqueued.
+ */
+bool atlastCommandId(char* command, uint32_t id, bool quiet);
+
+/**
+ * ATLAST run begin
+ * 
+ * Start streaming source of a run message to the interpreter, which loads
+ * it line by line like a file. Called from the websocket task.
+ * Returns false if another run is in progress or the queue is full.
+ */
+bool atlastRunBegin(uint32_t id, bool hasId);
+
+/**
+ * ATLAST run write
+ * 
+ * Pass part of run message source to the interpreter without waiting.
+ * Source not fitting the buffer is kept on heap up to ATL_RUN_BACKLOG,
+ * the run is aborted beyond that.
+ */
+void atlastRunWrite(const char * data, size_t len);
+
+/**
+ * ATLAST run end
+ * 
+ * Mark end of run message source. Incomplete (interrupted) source is
+ * not loaded any further and the load is unwound.
  */
-void atlastCommand(char* command);
+void atlastRunEnd(bool complete);
+
+/**
+ * ATLAST watch resolve
+ * 
+ * Have the interpreter task look up names of subscribed variable watches
+ * once the commands before are done.
+ * Returns false if no command slot is free.
+ */
+bool atlastWatchResolve();
 
 /**
  * ATLAST create task
@@ -86,8 +186,12 @@ void atlastInit();
  * ATLAST kill
  * 
  * Sets KILL flag to clear interpreter command queue.
- * Breaks running ATLAST program.
- * Restarts ATLAST in new task if requested.
+ * Breaks running ATLAST program and wakes it from ATLAST sleep.
+ * If requested, restarts ATLAST in a new task when the program does not stop
+ * within ATL_KILL_TIMEOUT_MS. Does not wait for that, a timer wakes the
+ * task doing the check.
  * Does not call ATLAST ABORT (that would reset ATLAST interpreter).
  */
-void atlastKill(bool restartTask);
\ No newline at end of file
+void atlastKill(bool restartTask);
+
+#endif // __cplusplus
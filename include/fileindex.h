@@ -0,0 +1,78 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "storage.h"
+
+#define FILE_INDEX_PATH STORAGE_PATH    // Longest path including terminator
+#define FILE_INDEX_OPEN 8               // Forth files tracked until closed
+
+// Indexed file
+struct fileEntry {
+    char path[FILE_INDEX_PATH];
+    uint32_t size;
+    uint32_t mtime;     // Last modification (0 if not kept by the filesystem)
+};
+
+
+#ifdef __cplusplus
+
+/**
+ * File index each
+ * 
+ * Call `fn` for indexed files in path order until it returns false.
+ * The index is locked meanwhile, so `fn` must not change it.
+ * Returns sequence number of the last change pushed to clients.
+ */
+uint32_t fileIndexEach(bool (*fn)(const struct fileEntry * entry, void * arg), void * arg);
+
+/**
+ * File index build
+ * 
+ * Walk the filesystem (directories too) once and index all files.
+ * Call after mounting.
+ */
+void fileIndexBuild();
+
+
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * File index update
+ * 
+ * Take size and mtime of `path` from the filesystem after it was written,
+ * created or removed. A change is pushed to all websocket clients.
+ */
+void fileIndexUpdate(const char * path);
+
+/**
+ * File index opened / changed / closed
+ * 
+ * Track file opened by Forth, its entry is updated again once flushed
+ * or closed.
+ */
+void fileIndexOpened(const char * path, void * handle);
+void fileIndexChanged(void * handle);
+void fileIndexClosed(void * handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,6 +18,7 @@
 #ifdef __cplusplus  // Certain functions are included by C files
 
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
 #include <stdint.h>
 
 #define STATIC_JSON_SIZE 384
@@ -26,6 +27,18 @@
 extern "C" {
 #endif // __cplusplus
 
+// Output sinks (mask bits)
+#define OUT_SINK_SERIAL 1
+#define OUT_SINK_WS 2
+#define OUT_SINK_CAPTURE 4
+#define OUT_SINK_ALL 7
+#define OUT_SINKS 3     // Number of sinks
+
+#define OUT_REDIRECT_NEST 4 // Deepest nesting of output redirections
+
+#define I2C_LOCK_WAIT_MS 100    // Longest wait for I2C bus used by another task
+#define I2C_BUSY 4      // writeI2C() status if the bus stayed locked ("other error")
+
 /**
  * Multi printf
  * 
@@ -33,6 +46,126 @@ extern "C" {
  */
 int multiPrintf(char * format, ...);
 
+/**
+ * Multi write
+ * 
+ * Write unformatted text to multiple outputs.
+ */
+int multiWrite(const char * text, size_t len);
+
+/**
+ * Output task deleted
+ * 
+ * Release output state held by the ATLAST task deleted on restart.
+ * Its unfinished ring record is committed empty, so that the websocket
+ * output behind it is not held up forever. Its redirection and capture
+ * end, the new task might get the same handle. A serial writer lock it
+ * held is released.
+ */
+void outputTaskDeleted(TaskHandle_t task);
+
+/**
+ * Output blocking
+ * 
+ * Enable or disable blocking ATLAST while websocket output ring is full.
+ */
+void outputSetBlocking(bool blocking);
+
+/**
+ * Output blocking mode
+ * 
+ * Return true if ATLAST waits for the websocket client on full output ring.
+ */
+bool outputBlocking();
+
+/**
+ * Output set sinks
+ * 
+ * Select outputs (OUT_SINK_* mask) that receive printed data.
+ */
+void outputSetSinks(uint8_t sinks);
+
+/**
+ * Output sinks
+ * 
+ * Return mask of enabled outputs.
+ */
+uint8_t outputSinks();
+
+/**
+ * Output sink stats
+ * 
+ * Get bytes passed to a sink and bytes it dropped (no space, truncated).
+ * Returns false on invalid sink.
+ */
+bool outputSinkStats(uint8_t sink, uint32_t * bytes, uint32_t * dropped);
+
+/**
+ * Output capture start
+ * 
+ * Copy output of the calling task into provided buffer (null-terminated).
+ * Output exceeding the buffer is not captured.
+ */
+void outputCaptureStart(char * buf, size_t size);
+
+/**
+ * Output capture stop
+ * 
+ * Stop copying output into capture buffer.
+ * Returns the number of bytes captured, `overflow` is set if some
+ * output did not fit.
+ */
+size_t outputCaptureStop(bool * overflow);
+
+/**
+ * Output redirect start
+ * 
+ * Redirect output of the calling task into buffer (null-terminated),
+ * instead of all sinks. Redirections nest, the innermost one receives
+ * output. Output exceeding the buffer is dropped.
+ * Returns false if nested too deep or redirected by another task.
+ */
+bool outputRedirectStart(char * buf, size_t size);
+
+/**
+ * Output redirect stop
+ * 
+ * End innermost redirection, output goes where it went before.
+ * Returns false if output of the calling task is not redirected.
+ */
+bool outputRedirectStop(char ** buf, size_t * len);
+
+/**
+ * Output redirect reset
+ * 
+ * End all redirections (errors, start and end of command, restart).
+ * Only the ATLAST task redirects output.
+ */
+void outputRedirectReset();
+
+/**
+ * I2C lock
+ * 
+ * Take the shared I2C bus for one transaction, waiting up to
+ * I2C_LOCK_WAIT_MS for another task to finish.
+ * Returns false if the bus stayed locked.
+ */
+bool i2cLock();
+
+/**
+ * I2C unlock
+ * 
+ * Release the I2C bus taken by i2cLock().
+ */
+void i2cUnlock();
+
+/**
+ * I2C unlock task
+ * 
+ * Release the I2C bus if it is held by `task` (deleted while holding it).
+ */
+void i2cUnlockTask(TaskHandle_t task);
+
 /**
  * Scan I2C
  * 
@@ -45,6 +178,7 @@ void scanI2C();
  * Write I2C
  * 
  * Write data to I2C slave at specified 7-bit address.
+ * Returns Wire status, I2C_BUSY if the bus stayed locked.
  */
 uint8_t writeI2C(uint8_t address, uint8_t * data, size_t len);
 
@@ -52,6 +186,7 @@ uint8_t writeI2C(uint8_t address, uint8_t * data, size_t len);
  * Read I2C
  * 
  * Request and read data from I2C slave at specified 7-bit address.
+ * Bytes not received (or all if the bus stayed locked) read as zero.
  */
 void readI2C(uint8_t address, uint8_t * data, size_t len);
 
@@ -59,20 +194,27 @@ void readI2C(uint8_t address, uint8_t * data, size_t len);
 }
 
 
+/**
+ * Output configure
+ * 
+ * Apply "serial" and "output" settings from config.json.
+ */
+void outputConfigure();
+
 /**
  * Serial read line
  * 
- * Store chars from serial input into provided buffer.
- * Loops until newline is read or when size limit is met.
- * Returns true if a complete line has been read, false otherwise.
- * WARNING: Discards the rest of incoming UART buffer!
+ * Store a line of serial input into provided buffer.
+ * Blocks until newline is read.
+ * Returns true if a complete line has been read, false if it exceeded
+ * the size limit (the rest of such line is discarded).
  */
 bool serialReadLine(char * buf, size_t limit);
 
 /**
  * Print file list
  * 
- * List all files in CLI.
+ * List all files with sizes in CLI.
  */
 void printFileList();
 
@@ -80,9 +222,10 @@ void printFileList();
  * Incoming text
  * 
  * Handle input string from serial or websocket (evaluate ATLAST).
- * Maximum input length is 256.
+ * Commands longer than ATL_CMD_LEN go to the heap rather than the slot.
+ * Waits up to `wait` ticks for queue space.
  */
-void incomingText(char * inputData);
+void incomingText(char * inputData, TickType_t wait = 0);
 
 /**
  * Remove file
@@ -99,11 +242,35 @@ bool removeFile(const char * path);
 /**
  * Incoming data
  * 
- * Save received part of file from websocket in SPIFFS.
- * Incoming file is stored under 'uploadPath'.
+ * Pass received part of raw file upload (after JSON request) to the writer.
  */
 void incomingData(void * arg, uint8_t * data, size_t dataLen);
 
+/**
+ * Incoming text run
+ * 
+ * Handle part of text run message: header line {"type":"run"[,"id":ID]}
+ * followed by source, possibly in multiple frames.
+ * Returns false if the text is not a run message.
+ */
+bool incomingTextRun(void * arg, uint8_t * data, size_t dataLen);
+
+/**
+ * Incoming disconnect
+ * 
+ * Abandon messages interrupted by disconnection of client.
+ */
+void incomingDisconnect(uint32_t client);
+
+/**
+ * Incoming binary
+ * 
+ * Handle part of binary protocol message: [opcode] [request ID] [payload].
+ * Upload data is written as it arrives, other payloads are buffered
+ * until the message is complete.
+ */
+void incomingBinary(void * arg, uint8_t * data, size_t dataLen);
+
 /**
  * Incoming JSON CLI
  * 
@@ -132,11 +299,47 @@ void incomingJsonUpload(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
  */
 void incomingJsonDelete(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
 
+/**
+ * Incoming JSON binary
+ * 
+ * Handle binary protocol negotiation, enabled unless "enable" is false.
+ */
+void incomingJsonBinary(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
+
+/**
+ * Incoming JSON role
+ * 
+ * Handle client role request ("controller" takes over control).
+ */
+void incomingJsonRole(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
+
+/**
+ * Incoming JSON clients
+ * 
+ * Handle connected clients statistics request.
+ */
+void incomingJsonClients(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
+
+/**
+ * Incoming JSON scan stats
+ * 
+ * Handle incoming scan cycle statistics request.
+ */
+void incomingJsonScanStats(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
+
+/**
+ * Incoming JSON watch
+ * 
+ * Handle variable watch subscription: space-separated names sampled every
+ * "interval" ms, changed values are pushed. No names unsubscribes.
+ */
+void incomingJsonWatch(StaticJsonDocument<STATIC_JSON_SIZE> & doc);
+
 /**
  * Incoming JSON
  * 
- * Parse and handle incoming JSON document.
+ * Parse and handle incoming JSON document (in place, strings point into input).
  */
-void incomingJson(const char* inputData);
+void incomingJson(char* inputData);
 
 #endif // __cplusplus
\ No newline at end of file
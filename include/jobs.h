@@ -0,0 +1,72 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+
+#define JOB_TASK_NAME "atl_job"
+
+#define JOB_SLOTS 8 // Number of jobs submitted at once
+#define JOB_ARGS 4  // Maximum number of kernel arguments
+
+// Job states
+#define JOB_FREE 0
+#define JOB_QUEUED 1
+#define JOB_RUNNING 2
+#define JOB_DONE 3
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Job kernel: computes result from arguments (e.g. heap buffer and length)
+typedef long (*jobKernel)(long * args);
+
+/**
+ * Jobs init
+ * 
+ * Create job worker task pinned to the core not running ATLAST.
+ */
+void jobsInit();
+
+/**
+ * Job submit
+ * 
+ * Queue kernel with up to JOB_ARGS arguments for execution by the worker.
+ * Buffers passed in arguments must stay valid until the job is done.
+ * Returns job handle, or 0 if all job slots are taken.
+ */
+int jobSubmit(jobKernel kernel, long * args, int argc);
+
+/**
+ * Job status
+ * 
+ * Returns state of the job with handle (JOB_FREE if handle is invalid).
+ */
+int jobStatus(int handle);
+
+/**
+ * Job wait
+ * 
+ * Block until job is done, store its result and release the handle.
+ * Returns false if the handle is invalid or ATLAST was killed meanwhile.
+ */
+bool jobWait(int handle, long * result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,66 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FMT_INT_MAX (sizeof(long) * 8 + 2)  // Longest integer (base 2, sign, terminator)
+#define FMT_REAL_MAX 32     // Longest shortest-form real (with terminator)
+#define FMT_DIGITS 40       // Significant digits kept of exact expansion
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Format integer
+ * 
+ * Write value in base 2..36 into buffer (null-terminated). Base 10 is
+ * signed, other bases show the unsigned cell (as %lX did).
+ * Returns the number of chars written.
+ */
+size_t fmtInt(char * buf, long value, int base);
+
+/**
+ * Format real
+ * 
+ * Write the shortest decimal that reads back as the same double,
+ * in %g-like notation (null-terminated, at most FMT_REAL_MAX bytes).
+ * Returns the number of chars written.
+ */
+size_t fmtReal(char * buf, double value);
+
+/**
+ * Format with integer
+ * 
+ * Write format with its one %d/%i/%u/%x/%X/%o conversion (optional l,
+ * no flags, width or precision) into buffer, without printf.
+ * Returns false for formats needing sprintf.
+ */
+bool fmtFormatInt(char * buf, const char * format, long value);
+
+/**
+ * Format with real
+ * 
+ * Like fmtFormatInt() for one %f/%e/%g conversion with optional precision.
+ */
+bool fmtFormatReal(char * buf, const char * format, double value);
+
+#ifdef __cplusplus
+}
+#endif
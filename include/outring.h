@@ -0,0 +1,73 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUT_RING_SIZE 8192      // Ring capacity in bytes (power of two)
+#define OUT_RECORD_MAX 1024     // Longest record, longer output is truncated
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Output ring reserve
+ * 
+ * Reserve record of `size` bytes for a producer (any task, lock-free).
+ * Size above OUT_RECORD_MAX is truncated and the excess counted as dropped.
+ * Returns record data, or NULL (counted as dropped) if the ring is full.
+ */
+char * outRingReserve(size_t * size);
+
+/**
+ * Output ring try reserve
+ * 
+ * Like outRingReserve(), but a full ring is not counted as dropped,
+ * so that the producer can wait and retry.
+ */
+char * outRingTryReserve(size_t * size);
+
+/**
+ * Output ring commit
+ * 
+ * Publish first `len` bytes of record reserved with `size` bytes.
+ * Every reserved record must be committed.
+ */
+void outRingCommit(char * data, size_t size, size_t len);
+
+/**
+ * Output ring read
+ * 
+ * Move committed output in order into buffer (null-terminated) for the
+ * single consumer. Stops at a record that does not fit or is not yet
+ * committed. Buffer NULL discards output. Returns the number of bytes read.
+ * Buffer must be larger than OUT_RECORD_MAX to guarantee progress.
+ */
+size_t outRingRead(char * buf, size_t size);
+
+/**
+ * Output ring dropped
+ * 
+ * Returns total number of output bytes dropped or truncated.
+ */
+uint32_t outRingDropped();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SAMPLER_TASK_NAME "atl_sampler"
+
+#define SAMPLER_CHANNELS 8  // Maximum number of channels
+
+// Channel sources
+#define SAMPLER_NONE 0
+#define SAMPLER_ADC 1   // analogRead(pin)
+#define SAMPLER_GPIO 2  // digitalRead(pin)
+#define SAMPLER_I2C 3   // Big-endian register read from I2C slave
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sampler channel
+ * 
+ * Allocate channel storing samples into ring of `blocks` blocks of
+ * `blockLen` cells at `buffer`, sampled every `divider` timer periods.
+ * The channel is inactive until a source is set.
+ * Returns channel number, or -1 if no channel is left.
+ */
+int samplerChannel(long * buffer, uint32_t blockLen, uint32_t blocks, uint32_t divider);
+
+/**
+ * Sampler source
+ * 
+ * Set channel source and activate channel.
+ * For I2C, `pin` is the 7-bit address, `reg` the register and `bytes`
+ * the number of bytes read (1..4). Returns false on invalid channel.
+ */
+bool samplerSource(int ch, uint8_t source, uint8_t pin, uint8_t reg, uint8_t bytes);
+
+/**
+ * Sampler start
+ * 
+ * Start sampler timer with period in us.
+ */
+bool samplerStart(uint32_t periodUs);
+
+/**
+ * Sampler stop
+ * 
+ * Stop sampler timer (channels are kept).
+ */
+void samplerStop();
+
+/**
+ * Sampler clear
+ * 
+ * Stop sampler and remove all channels.
+ */
+void samplerClear();
+
+/**
+ * Sampler block
+ * 
+ * Return address of the oldest filled block of channel, NULL if none.
+ */
+long * samplerBlock(int ch);
+
+/**
+ * Sampler release
+ * 
+ * Return the oldest filled block of channel to the sampler.
+ */
+void samplerRelease(int ch);
+
+/**
+ * Sampler drops
+ * 
+ * Return number of samples dropped because all blocks were filled.
+ */
+uint32_t samplerDrops(int ch);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,112 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCAN_MAX_PINS 32    // Bits of the input/output process image
+#define SCAN_BADPERIOD 1    // Status of scan with period below one tick
+
+
+// Scan cycle statistics (times in us)
+struct scanStats {
+    bool running;
+    uint32_t periodMs;
+    uint32_t cycles;
+    uint32_t overruns;  // Cycles that did not fit into the period
+    int64_t minTime;    // Shortest cycle (latch, body, commit)
+    int64_t maxTime;    // Longest cycle
+    int64_t sumTime;    // Sum of cycle times (for mean)
+    int64_t maxJitter;  // Latest cycle start relative to schedule
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Scan add input
+ * 
+ * Map digital input pin to the next bit of the input image.
+ * Returns false if the image is full.
+ */
+bool scanAddInput(uint8_t pin);
+
+/**
+ * Scan add output
+ * 
+ * Map the next bit of the output image to digital output pin.
+ * Returns false if the image is full.
+ */
+bool scanAddOutput(uint8_t pin);
+
+/**
+ * Scan clear
+ * 
+ * Remove all pins from the process image.
+ */
+void scanClear();
+
+/**
+ * Scan get inputs
+ * 
+ * Return input image latched at the start of the current cycle.
+ */
+uint32_t scanGetInputs();
+
+/**
+ * Scan get outputs
+ * 
+ * Return output image to be committed at the end of the current cycle.
+ */
+uint32_t scanGetOutputs();
+
+/**
+ * Scan set outputs
+ * 
+ * Set output image to be committed at the end of the current cycle.
+ */
+void scanSetOutputs(uint32_t image);
+
+/**
+ * Scan run
+ * 
+ * Run scan cycles with fixed period: latch inputs, call body, commit outputs.
+ * Stops on scanStop(), on kill or when body returns nonzero.
+ * Returns the last status returned by body, or SCAN_BADPERIOD if the period
+ * is shorter than one tick.
+ */
+int scanRun(int (*body)(void *), void * arg, uint32_t periodMs);
+
+/**
+ * Scan stop
+ * 
+ * Stop scan cycles after the current one.
+ */
+void scanStop();
+
+/**
+ * Scan get stats
+ * 
+ * Copy statistics of the running or last scan.
+ */
+void scanGetStats(struct scanStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200      // Baud rate until config.json is loaded
+#endif
+#define SERIAL_RX_RING 16384    // UART receive ring filled by the driver ISR
+#define SERIAL_WAIT_MS 20       // Longest wait for a receive event
+#define SERIAL_TX_RING 8192     // Output waiting for UART transmitter
+#define SERIAL_TX_CHUNK 128     // Most bytes moved to UART FIFO at once
+#define SERIAL_TX_LOCK_MS 5     // Longest wait for another writer's copy
+#define SERIAL_LINE_MAX 4096    // Longest input line passed to the interpreter
+
+#define SERIAL_TX_TASK_NAME "serial_tx"
+
+
+/**
+ * Serial begin
+ * 
+ * Initialize UART with a large receive ring. Input is read by the calling
+ * task, which is woken by receive events where the core supports them.
+ * Output is transmitted from a ring by a separate task.
+ */
+void serialBegin();
+
+/**
+ * Serial set baud
+ * 
+ * Switch UART baud rate once pending output is transmitted.
+ */
+void serialSetBaud(unsigned long baud);
+
+/**
+ * Serial write
+ * 
+ * Queue output for transmission without waiting for the UART.
+ * Returns the number of bytes queued, the rest did not fit the ring
+ * (or another writer held the ring for over SERIAL_TX_LOCK_MS).
+ */
+size_t serialWrite(const char * data, size_t len);
+
+/**
+ * Serial unlock task
+ * 
+ * Release the output ring if its writer lock is held by `task` (deleted
+ * while holding it).
+ */
+void serialUnlockTask(TaskHandle_t task);
+
+/**
+ * Serial read piece
+ * 
+ * Block until a line is received or `limit` - 1 chars of it are buffered.
+ * Overlong lines are returned in pieces with `more` set on all but the last.
+ */
+void serialReadPiece(char * buf, size_t limit, bool * more);
+
+/**
+ * Serial poll
+ * 
+ * Read a line and pass it to the interpreter.
+ * Waits for free command slot, so pasted input is kept whole and in order.
+ * Overlong lines are joined on heap and evaluated whole, pieces would cut
+ * comments and strings. Lines over SERIAL_LINE_MAX chars are discarded.
+ */
+void serialPoll();
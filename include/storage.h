@@ -0,0 +1,82 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Filesystem backend is chosen at build time, SPIFFS unless STORAGE_LITTLEFS is defined
+#ifdef STORAGE_LITTLEFS
+#define STORAGE_NAME "LittleFS"
+#define STORAGE_MOUNT "/littlefs"   // VFS mount point (for C stdio)
+#else
+#define STORAGE_NAME "SPIFFS"
+#define STORAGE_MOUNT "/spiffs"
+#endif
+
+#define STORAGE_PATH 32     // Longest path including terminator (SPIFFS limit, kept for both)
+#define STORAGE_VFS_PATH (sizeof(STORAGE_MOUNT) - 1 + STORAGE_PATH)
+
+
+#ifdef __cplusplus
+#include <FS.h>
+
+// Mounted filesystem
+extern fs::FS & storage;
+
+/**
+ * Storage file path
+ * 
+ * Returns full path of file met walking a directory.
+ */
+const char * storageFilePath(fs::File & file);
+
+
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * Storage begin
+ * 
+ * Mount the filesystem. Returns false on failure.
+ */
+bool storageBegin();
+
+/**
+ * Storage info
+ * 
+ * Get filesystem size and used space in bytes.
+ */
+void storageInfo(size_t * total, size_t * used);
+
+/**
+ * Storage VFS path
+ * 
+ * Prepend mount point to `path` for C stdio into `buf` (STORAGE_VFS_PATH bytes).
+ * Returns false if the path is too long.
+ */
+bool storageVfsPath(char * buf, const char * path);
+
+/**
+ * Storage make parents
+ * 
+ * Create directories leading to `path` (nothing to do on flat SPIFFS).
+ */
+void storageMakeParents(const char * path);
+
+#ifdef __cplusplus
+}
+#endif
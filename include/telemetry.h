@@ -0,0 +1,55 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TLM_STREAMS 8   // Telemetry stream IDs 0..7
+#define TLM_WAIT_MS 20  // Longest wait for a free frame before samples are dropped
+#define TLM_OFFSET 8    // Samples start in message (aligned for typed arrays)
+
+// Sample types
+#define TLM_CELLS 0     // int32
+#define TLM_BYTES 1     // uint8
+#define TLM_FLOATS 2    // float64
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Telemetry send
+ * 
+ * Send `count` samples of `type` as binary frames tagged with `stream`
+ * to every client using binary protocol. Samples are copied straight
+ * into pooled frames, split across as many frames as needed.
+ * Returns false if samples were dropped for lack of a free frame.
+ */
+bool telemetrySend(uint8_t stream, uint8_t type, const void * data, size_t count);
+
+/**
+ * Telemetry drops
+ * 
+ * Returns the number of samples dropped (per client) since boot.
+ */
+uint32_t telemetryDrops();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "storage.h"
+
+#define UPLOAD_TASK_NAME "upload"
+
+#define UPLOAD_BLOCK 4096       // Flash write size (one erase block), resume offsets are aligned
+#define UPLOAD_BUFFERS 2        // Blocks filled by the network while another one is written
+#define UPLOAD_EXTRA 4          // Heap blocks taken while flash falls behind
+#define UPLOAD_PATH_LEN STORAGE_PATH    // Longest path including terminator
+#define UPLOAD_WAIT_MS 100      // Longest wait for a written block (network is held meanwhile)
+
+// Report of finished upload: WSB_* status, bytes received and time taken by
+// the session, client and request ID passed to uploadFinish()
+typedef void (*uploadReport)(uint8_t status, uint32_t bytes, uint32_t ms,
+                             uint32_t client, uint32_t id);
+
+/**
+ * Upload init
+ * 
+ * Create the task writing uploaded files to flash.
+ */
+void uploadInit();
+
+/**
+ * Upload begin
+ * 
+ * Start upload of `size` bytes with CRC-32 `crc` (checked if `verify`)
+ * to `path`. If `resume` is set and an interrupted upload of the same
+ * file is pending, it continues where it stopped.
+ * Fails without waiting while the writer still closes the previous file.
+ * Returns WSB_* status, `offset` is the first byte expected.
+ */
+uint8_t uploadBegin(const char * path, uint32_t size, uint32_t crc, bool verify, bool resume,
+                    uint32_t * offset);
+
+/**
+ * Upload write
+ * 
+ * Pass received file data to the writer. Blocks up to UPLOAD_WAIT_MS
+ * while all buffers wait for flash, then takes blocks from heap.
+ * Data at other than the expected offset is refused.
+ * Returns false on error (the upload is abandoned, or suspended for
+ * resuming if flash cannot keep up).
+ */
+bool uploadWrite(uint32_t offset, const uint8_t * data, size_t len);
+
+/**
+ * Upload complete
+ * 
+ * Returns true once all bytes of the active upload have been received.
+ */
+bool uploadComplete();
+
+/**
+ * Upload finish
+ * 
+ * Have the writer close the file once written and verify its CRC-32
+ * (the file is removed if it does not match). Does not wait, `report`
+ * is called by the writer with the result.
+ */
+void uploadFinish(uploadReport report, uint32_t client, uint32_t id);
+
+/**
+ * Upload suspend
+ * 
+ * Have the writer write whole received blocks, close the file and keep
+ * the upload for resuming (e.g. on disconnect). Does not wait.
+ */
+void uploadSuspend();
+
+/**
+ * Upload resume offset
+ * 
+ * Returns the offset an upload of `path` with `size` and `crc` would
+ * resume from, 0 if it would start over.
+ */
+uint32_t uploadResumeOffset(const char * path, uint32_t size, uint32_t crc);
+
+/**
+ * Upload path
+ * 
+ * Returns path of the active or suspended upload.
+ */
+const char * uploadPath();
@@ -0,0 +1,95 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WATCH_TASK_NAME "atl_watch"
+
+#define WATCH_VARS 16       // Variables watched per client
+#define WATCH_MIN_MS 20     // Shortest sampling interval
+#define WATCH_NAMES 250     // Longest list of names (fits a JSON request)
+
+
+#ifdef __cplusplus
+
+/**
+ * Watch begin
+ * 
+ * Create the task sampling watched variables.
+ */
+void watchBegin();
+
+/**
+ * Watch subscribe
+ * 
+ * Replace watch set of client with variables named in space-separated
+ * `names`, sampled every `intervalMs`. Values are pushed in binary if
+ * `binary` is set, otherwise in JSON. Names are resolved once by the
+ * interpreter task, which acknowledges the set (unknown names are listed
+ * and never reported).
+ * Returns false if no client slot is free or the lookup was not enqueued.
+ */
+bool watchSubscribe(uint32_t client, const char * names, uint32_t intervalMs, bool binary);
+
+/**
+ * Watch resolve
+ * 
+ * Look up names of subscribed watch sets and acknowledge them.
+ * Call on the interpreter task only, the dictionary is not locked.
+ */
+void watchResolve();
+
+/**
+ * Watch cancel
+ * 
+ * Drop subscribed watch sets whose lookup was discarded (killed program).
+ */
+void watchCancel();
+
+/**
+ * Watch unlock task
+ * 
+ * Release the lock of watch sets if it is held by `task` (deleted while
+ * holding it).
+ */
+void watchUnlockTask(TaskHandle_t task);
+
+/**
+ * Watch remove
+ * 
+ * Drop watch set of client.
+ */
+void watchRemove(uint32_t client);
+
+
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * Watch drop all
+ * 
+ * Drop all watch sets once watched variables may be gone (FORGET,
+ * interpreter restart) and tell their clients.
+ */
+void watchDropAll();
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,9 +15,56 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// Outgoing CLI text buffer and mutex
-extern std::string wsOutString;
-extern SemaphoreHandle_t wsOutMutex;
+#define WS_OUT_CHUNK 4096  // Largest CLI output moved to fan-out at once
+#define WS_OUT_BATCH_MS 10  // Output batching window under continuous output
+#define WS_OUT_BACKOFF_MS 5 // Wait for client send queue to drain
+
+// Binary protocol message: [opcode] [request ID, uint32 LE] [payload]
+#define WSB_HEADER 5
+#define WSB_MESSAGE_MAX 512     // Longest buffered payload (upload data streams)
+// Opcodes (-> to ESP, <- from ESP)
+#define WSB_CLI 0x01            // -> command text, ID other than 0 requests result
+#define WSB_OUTPUT 0x02         // <- console output text
+#define WSB_FILE_LIST 0x03      // -> empty; <- [seq, uint32] ([size, uint32] [path] \0)...
+#define WSB_UPLOAD 0x04         // -> [size, uint32] [CRC-32, uint32] [path]; <- ack [offset, uint32]
+#define WSB_UPLOAD_DATA 0x05    // -> [offset, uint32] file data; <- ack [bytes, ms] (uint32 each) when complete
+#define WSB_DELETE 0x06         // -> path; <- ack
+#define WSB_KILL 0x07           // -> [restart task, byte]
+#define WSB_ACK 0x08            // <- [request opcode] [status] [path] [\0 extra data]
+#define WSB_RESULT 0x09         // <- [status] [depth] [us] (int32 each) [truncated] [output]
+#define WSB_RUN 0x0A            // -> source loaded line by line, ID other than 0 requests result
+#define WSB_TELEMETRY 0x0B      // <- [stream] [type] [reserved] [samples], ID is index of first sample
+#define WSB_WATCH 0x0C          // <- changed watched variables: [index, byte] [value, int32]...
+#define WSB_FILE_DELTA 0x0D     // <- [size, int32, -1 if removed] [mtime, uint32] [path], ID is seq
+// Acknowledge statuses
+#define WSB_OK 0
+#define WSB_TOO_LARGE 1
+#define WSB_PROTECTED 2
+#define WSB_FAILED 3
+#define WSB_CORRUPT 4           // Upload failed CRC check
+
+#define WS_MAX_CLIENTS 8     // Connected clients
+#define WS_FANOUT_SIZE 8192  // Output kept for clients falling behind (power of two)
+
+// Client roles: observers see output, only the controller sends input
+#define WS_OBSERVER 0
+#define WS_CONTROLLER 1
+
+// Client output send states
+#define WS_IDLE 0
+#define WS_SENT 1
+#define WS_PENDING 2
+
+// Connected client
+struct wsClientState {
+    uint32_t id;        // AsyncWebSocket client ID, 0 if slot is free
+    uint8_t role;
+    bool binary;        // Negotiated binary protocol
+    uint32_t cursor;    // Fan-out position of the next output byte to send
+    uint32_t sent;      // Output bytes sent
+    uint32_t skipped;   // Output bytes lost falling too far behind
+    uint32_t maxLag;    // Largest output backlog in bytes
+};
 
 /**
  * Parse received
@@ -29,7 +76,7 @@ void parseReceived(void * arg, uint8_t * data, size_t len);
 /**
  * Setup web server
  * 
- * Setup websocket, start the server, configure hosting files in SPIFFS.
+ * Setup websocket, start the server, configure hosting files in storage.
  */
 void setupWebServer();
 
@@ -40,24 +87,156 @@ void setupWebServer();
  */
 void wsSendText(const char * data);
 
+/**
+ * Connected
+ * 
+ * Returns true if a websocket client is connected.
+ */
+bool wsConnected();
+
+/**
+ * Client ID
+ * 
+ * Returns ID of the client whose message is handled, 0 if none.
+ */
+uint32_t wsClientId();
+
+/**
+ * Is controller
+ * 
+ * Returns true if the client whose message is handled is the controller.
+ */
+bool wsIsController();
+
+/**
+ * Is binary
+ * 
+ * Returns true if the client whose message is handled negotiated
+ * binary protocol.
+ */
+bool wsIsBinary();
+
+/**
+ * Set binary
+ * 
+ * Switch protocol of the client whose message is handled.
+ */
+void wsSetBinary(bool binary);
+
+/**
+ * Client IDs
+ * 
+ * Copy IDs of connected clients and whether they use binary protocol.
+ * Returns the number of clients.
+ */
+size_t wsClientIds(uint32_t * ids, bool * binary, size_t max);
+
+/**
+ * Binary clients
+ * 
+ * Copy IDs of connected clients using binary protocol into `ids`.
+ * Returns the number of IDs copied.
+ */
+size_t wsBinaryClients(uint32_t * ids, size_t max);
+
+/**
+ * Binary header
+ * 
+ * Write binary protocol message header.
+ */
+void wsBinaryHeader(uint8_t * buf, uint8_t opcode, uint32_t id);
+
+/**
+ * Request role
+ * 
+ * Make the client whose message is handled controller (taking over from
+ * the current one) or observer.
+ */
+void wsRequestRole(bool controller);
+
+/**
+ * Notify output
+ * 
+ * Wake up the task sending CLI output. Callable from any task.
+ */
+void wsNotifyOutput();
+
 /**
  * Send CLI loop
  * 
- * Loop to send wsOutString to the last connected websocket client.
+ * Loop to send output ring to all connected websocket clients.
  * Run in its own task.
  */
 void wsSendCliLoop(void * pvParameter);
 
+/**
+ * Send clients
+ * 
+ * Send list of connected clients with roles and output lag statistics JSON.
+ */
+void wsSendClients();
+
 /**
  * Send file list
  * 
- * Send file list JSON for internal use of the web page.
+ * Send file index (paths and sizes) JSON for internal use of the web page,
+ * with sequence number of the last change pushed (see fileindex.h).
+ * Sent in binary with request ID if binary protocol is negotiated.
+ * Files not fitting a frame are left out.
  */
-void wsSendFileList();
+void wsSendFileList(uint32_t id = 0);
 
 /**
  * Send acknowledge
  * 
  * Send (negative-) acknowledge JSON for various requests.
+ * Transfers report `bytes` moved in `ms` and resulting throughput.
+ */
+void wsSendAck(const char * type, const char * status, const char * name,
+               uint32_t bytes = 0, uint32_t ms = 0);
+
+/**
+ * Send acknowledge to
+ * 
+ * Send acknowledge JSON to given client (from outside its message handler).
+ */
+void wsSendAckTo(uint32_t client, const char * type, const char * status, const char * name,
+                 uint32_t bytes = 0, uint32_t ms = 0);
+
+/**
+ * Send binary
+ * 
+ * Send binary protocol message to the last connected websocket client
+ * (or to given client).
+ */
+void wsSendBinary(uint8_t opcode, uint32_t id, const char * payload, size_t len);
+void wsSendBinaryTo(uint32_t client, uint8_t opcode, uint32_t id, const char * payload,
+                    size_t len);
+
+/**
+ * Send acknowledge binary
+ * 
+ * Send binary acknowledge of request with opcode and ID (to given client).
+ * Extra data (if any) follows the path after a null terminator.
+ */
+void wsSendAckBinary(uint8_t opcode, uint32_t id, uint8_t status, const char * path,
+                     const void * extra = NULL, size_t extraLen = 0);
+void wsSendAckBinaryTo(uint32_t client, uint8_t opcode, uint32_t id, uint8_t status,
+                       const char * path, const void * extra = NULL, size_t extraLen = 0);
+
+/**
+ * Send result
+ * 
+ * Send structured result JSON (or binary) of a command submitted with ID
+ * to the submitting client. Depth is -1 if the command was not evaluated,
+ * `truncated` is set if output did not fit the capture buffer.
+ */
+void wsSendResult(uint32_t clientId, uint32_t id, int status, const char * text,
+                  size_t textLen, long depth, int64_t duration, bool truncated);
+
+/**
+ * Send scan stats
+ * 
+ * Send scan cycle statistics JSON (times in us).
  */
-void wsSendAck(const char * type, const char * status, const char * name);
\ No newline at end of file
+void wsSendScanStats();
\ No newline at end of file
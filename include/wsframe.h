@@ -0,0 +1,152 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WS_FRAME_COUNT 6    // Preallocated outgoing websocket messages
+#define WS_FRAME_SIZE 4096  // Longest outgoing websocket message
+#define WS_FRAME_RESERVE 2  // Frames left for replies when CLI output is sent
+#define WS_JSON_CLOSE 8     // Frame space kept for closing JSON brackets
+
+
+#ifdef __cplusplus
+
+// Streaming JSON writer, no document or heap involved
+class JsonWriter {
+  public:
+    JsonWriter(char * buf, size_t size);
+
+    /**
+     * Begin object / array
+     * 
+     * Open nested object or array, `key` is NULL inside arrays and at top level.
+     */
+    void beginObject(const char * key = NULL);
+    void beginArray(const char * key = NULL);
+    void endObject();
+    void endArray();
+
+    /**
+     * Add string
+     * 
+     * Add escaped string member. With length, as much of the string is
+     * written as fits; returns the number of source chars written.
+     */
+    void addString(const char * key, const char * value);
+    size_t addString(const char * key, const char * value, size_t len);
+
+    /**
+     * Escaped length
+     * 
+     * Returns length of string once escaped (without quotes).
+     */
+    static size_t escapedLength(const char * value, size_t len);
+
+    /**
+     * Add number / bool
+     */
+    void addInt(const char * key, int64_t value);
+    void addBool(const char * key, bool value);
+
+    /**
+     * Mark / rewind
+     * 
+     * Drop everything written at the current level since mark,
+     * e.g. an array element that did not fit.
+     */
+    struct Mark {
+        size_t len;
+        uint32_t members;
+    };
+    Mark mark() const { return {_len, _members}; }
+    void rewind(const Mark & m) { _len = m.len; _members = m.members; _overflow = false; }
+
+    size_t length() const { return _len; }
+    bool overflow() const { return _overflow; }
+
+  private:
+    char * _buf;
+    size_t _size;
+    size_t _len;
+    bool _overflow;     // Something did not fit, output is incomplete
+    uint32_t _members;  // Bit per nesting level: level has a member
+    uint8_t _depth;
+
+    bool put(const char * s, size_t n);
+    bool member(const char * key);
+    void open(const char * key, char bracket);
+    void close(char bracket);
+};
+
+/**
+ * Frame acquire
+ * 
+ * Take a free frame of WS_FRAME_SIZE bytes from the pool.
+ * Unless `reply` is set, WS_FRAME_RESERVE frames are left free.
+ * A reply finding the pool empty gets a frame from heap instead.
+ * Returns NULL if no frame is available.
+ */
+char * wsFrameAcquire(bool reply);
+
+/**
+ * Frame release
+ * 
+ * Return unsent frame to the pool.
+ */
+void wsFrameRelease(char * frame);
+
+/**
+ * Frame send
+ * 
+ * Queue frame to client without copying it. The frame returns to the pool
+ * once sent (or when the client goes away). Heap frame is copied and freed.
+ * Returns false if the client is not connected (frame is released).
+ */
+bool wsFrameSend(uint32_t clientId, char * frame, size_t len, bool binary);
+
+/**
+ * Frame send JSON
+ * 
+ * Send JSON written into a frame, incomplete JSON is dropped.
+ */
+bool wsFrameSendJson(uint32_t clientId, char * frame, const JsonWriter & json);
+
+/**
+ * Frame misses
+ * 
+ * Returns the number of messages dropped or sent from heap
+ * for lack of a free frame.
+ */
+uint32_t wsFrameMisses();
+
+
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * Web mallocs
+ * 
+ * Returns the number of heap allocations made while queueing outgoing
+ * websocket messages (library queue nodes, replies sent from heap).
+ */
+uint32_t wsMallocs();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,126 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <rom/crc.h>
+
+#include "assets.h"
+#include "storage.h"
+
+
+// Indexed precompressed asset
+struct asset {
+    char path[32];  // Path of the uncompressed file
+    char etag[11];  // Quoted CRC-32 of the compressed file
+};
+
+static struct asset assets[ASSETS_MAX];
+static size_t assetCount = 0;
+
+
+/**
+ * Assets index
+ * 
+ * Find gzipped web assets and compute their ETags (CRC-32 of file content).
+ * Call once before serving.
+ */
+void assetsIndex() {
+    uint8_t buf[512];
+    File dir = storage.open(ASSETS_DIR);
+    File file;
+
+    assetCount = 0;
+    while (assetCount < ASSETS_MAX && (file = dir.openNextFile())) {
+        // Full path, the index is matched against request URLs
+        const char * name = storageFilePath(file);
+        size_t len = strlen(name);
+
+        if (len > 3 && len - 3 < sizeof(assets[0].path) && strcmp(name + len - 3, ".gz") == 0) {
+            struct asset * a = &assets[assetCount++];
+            uint32_t crc = 0;
+            size_t n;
+
+            memcpy(a->path, name, len - 3);
+            a->path[len - 3] = '\0';
+            while ((n = file.read(buf, sizeof(buf))) > 0) {
+                crc = crc32_le(crc, buf, n);
+            }
+            snprintf(a->etag, sizeof(a->etag), "\"%08x\"", crc);
+        }
+        file.close();
+    }
+    dir.close();
+}
+
+/**
+ * Assets handler can handle
+ * 
+ * Take GET requests for the root, "/favicon.ico" and "/www/...".
+ * Registers If-None-Match, the server drops headers no handler asked for.
+ */
+bool AssetsHandler::canHandle(AsyncWebServerRequest * request) {
+    if (request->method() != HTTP_GET) {
+        return false;
+    }
+    String url = request->url();
+    if (url != "/" && url != "/favicon.ico" && url != "/www" && !url.startsWith(ASSETS_DIR)) {
+        return false;
+    }
+    request->addInterestingHeader("If-None-Match");
+    return true;
+}
+
+/**
+ * Assets handler handle request
+ * 
+ * Serve a web asset, "/" maps to the index page. Indexed assets are sent
+ * precompressed with ETag and Cache-Control, matching If-None-Match gets
+ * 304. Other files are served as they are.
+ */
+void AssetsHandler::handleRequest(AsyncWebServerRequest * request) {
+    String path = request->url();
+    AsyncWebServerResponse * response;
+
+    if (path == "/") {
+        path = ASSETS_DIR "index.html";
+    } else if (path == "/favicon.ico") {
+        path = ASSETS_DIR "favicon.ico";
+    }
+
+    for (size_t i = 0; i < assetCount; i++) {
+        if (path != assets[i].path) {
+            continue;
+        }
+        if (request->header("If-None-Match") == assets[i].etag) {
+            response = request->beginResponse(304);
+        } else {
+            // Sends "<path>.gz" with "Content-Encoding: gzip", type taken from the plain name
+            response = request->beginResponse(storage, path);
+        }
+        response->addHeader("ETag", assets[i].etag);
+        response->addHeader("Cache-Control", ASSETS_CACHE);
+        request->send(response);
+        return;
+    }
+
+    if (storage.exists(path) || storage.exists(path + ".gz")) {
+        request->send(storage, path);
+    } else {
+        request->send(404);
+    }
+}
@@ -67,6 +67,10 @@
 #define STRING			      /* String functions */
 // ESP: Undefined SYSTEM
 //#define SYSTEM			      /* System command function */
+// ESP: Runaway program watchdog
+#define WATCHDOG		      /* Instruction and time limits */
+// ESP: Cooperative yielding (relies on WATCHDOG polling)
+#define YIELD			      /* Periodic yield of long computations */
 #ifndef NOMEMCHECK
 #define TRACE			      /* Execution tracing */
 #define WALKBACK		      /* Walkback trace */
@@ -87,6 +91,21 @@
 #include "io.h"
 #define	printf multiPrintf
 
+// ESP: Format numbers without printf() for console output
+#include "numfmt.h"
+
+// ESP: Keep file index up to date
+#include "fileindex.h"
+
+// ESP: Drop variable watches on FORGET
+#include "watch.h"
+
+// ESP: Stop sampling into forgotten buffers on FORGET
+#include "sampler.h"
+
+// ESP: Filesystem backend
+#include "storage.h"
+
 #ifdef MATH
 #include <math.h>
 #endif
@@ -142,6 +161,12 @@ atl_int atl_comment = Falsity;	      /* Currently ignoring a comment */
 atl_int atl_redef = Truth;	      /* Allow redefinition without issuing
                                          the "not unique" message. */
 atl_int atl_errline = 0;	      /* Line where last atl_load failed */
+// ESP: Runaway program watchdog limits
+atl_int atl_steplimit = 0;	      /* Instruction limit per command */
+atl_int atl_timelimit = 0;	      /* Time limit per command in ms */
+// ESP: Cooperative yielding intervals
+atl_int atl_yieldsteps = 0;	      /* Dispatches between yields */
+atl_int atl_yieldtime = 20000;	      /* Run time between yields in us */
 
 /*  Local variables  */
 
@@ -190,6 +215,9 @@ Exported stackitem *heapmax;	      /* Heap maximum excursion */
 #endif
 
 #ifdef FILEIO
+// ESP: Stdio buffer of each opened file (one flash block), VFS is called once per buffer
+#define FileBuffer  4096
+
 static char *fopenmodes[] = {
 #ifdef FBmode
 #define FMspecial
@@ -235,6 +263,21 @@ static Boolean stringlit = False;     /* String literal anticipated */
 #ifdef BREAK
 static Boolean broken = False;	      /* Asynchronous break received */
 #endif
+#ifdef WATCHDOG
+// ESP: Watchdog state.  The inner interpreter only decrements wdcount,
+// limits are checked once it runs out.
+#define WDINTERVAL  1024	      /* Maximum dispatches between checks */
+static long wdcount = WDINTERVAL;     /* Dispatches left until next check */
+static long wdreload = WDINTERVAL;    /* Dispatches in current interval */
+static long wdsteps = 0;	      /* Dispatches counted so far */
+static int64_t wdstart = 0;	      /* Time of last reset in us */
+#endif
+#ifdef YIELD
+static long ysteps = 0; 	      /* Dispatches since last yield */
+static int64_t ylast = 0;	      /* Time of last yield in us */
+static long ycount = 0; 	      /* Number of yields performed */
+static int64_t ytime = 0;	      /* Total time spent yielded in us */
+#endif
 
 #ifdef COPYRIGHT
 #ifndef HIGHC
@@ -573,6 +616,14 @@ void atl_memstat()
 }
 #endif /* MEMSTAT */
 
+// ESP: Stack depth accessor for the interpreter task
+/*  ATL_DEPTH  --  Return current evaluation stack depth.  */
+
+atl_int atl_depth()
+{
+    return (atl_int) (stk - stack);
+}
+
 /*  Primitive implementing functions.  */
 
 /*  ENTER  --  Enter word in dictionary.  Given token for word's
@@ -1170,7 +1221,9 @@ prim P_strform()		      /* Format integer using sprintf() */
     Sl(2);
     Hpc(S0);
     Hpc(S1);
-    V sprintf((char *) S0, (char *) S1, S2);
+    // ESP: Hand-written formatter for plain conversions
+    if (!fmtFormatInt((char *) S0, (char *) S1, S2))
+	V sprintf((char *) S0, (char *) S1, S2);
     Npop(3);
 }
 
@@ -1180,7 +1233,9 @@ prim P_fstrform()		      /* Format real using sprintf() */
     Sl(4);
     Hpc(S0);
     Hpc(S1);
-    V sprintf((char *) S0, (char *) S1, REAL1);
+    // ESP: Hand-written formatter for plain conversions
+    if (!fmtFormatReal((char *) S0, (char *) S1, REAL1))
+	V sprintf((char *) S0, (char *) S1, REAL1);
     Npop(4);
 }
 #endif /* REAL */
@@ -1364,8 +1419,13 @@ prim P_fleq()			      /* Test less than or equal */
 
 prim P_fdot()			      /* Print floating point top of stack */
 {
+    char buf[FMT_REAL_MAX + 1];       // ESP: Shortest round-trip digits
+    size_t n;
+
     Sl(Realsize);
-    V printf("%g ", REAL0);
+    n = fmtReal(buf, REAL0);
+    buf[n++] = ' ';
+    V multiWrite(buf, n);
     Realpop;
 }
 
@@ -1460,10 +1520,49 @@ prim P_tan()			      /* Tangent */
 
 #ifdef CONIO
 
+// ESP: Print number in current base without printf()
+
+static void dotnum(n)
+  stackitem n;
+{
+    char buf[FMT_INT_MAX + 1];
+    size_t len = fmtInt(buf, n, (int) base);
+
+    buf[len++] = ' ';
+    V multiWrite(buf, len);
+}
+
+// ESP: Print cells in current base, batched into one write per buffer
+
+static void dotcells(tsp, n)
+  stackitem *tsp;
+  stackitem n;
+{
+    char buf[256];
+    size_t len = 0;
+
+    while (n-- > 0) {
+	if (len > sizeof(buf) - FMT_INT_MAX - 1) {
+	    V multiWrite(buf, len);
+	    len = 0;
+	}
+	len += fmtInt(buf + len, *tsp++, (int) base);
+	buf[len++] = ' ';
+    }
+    if (len > 0)
+	V multiWrite(buf, len);
+}
+
+prim P_base()			      /* Push number base address */
+{				      /* ESP: -- addr */
+    So(1);
+    Push = (stackitem) &base;
+}
+
 prim P_dot()			      /* Print top of stack, pop it */
 {
     Sl(1);
-    V printf(base == 16 ? "%lX" : "%ld ", S0);
+    dotnum(S0);
     Pop;
 }
 
@@ -1471,7 +1570,7 @@ prim P_question()		      /* Print value at address */
 {
     Sl(1);
     Hpc(S0);
-    V printf(base == 16 ? "%lX" : "%ld ", *((stackitem *) S0));
+    dotnum(*((stackitem *) S0));
     Pop;
 }
 
@@ -1482,18 +1581,30 @@ prim P_cr()			      /* Carriage return */
 
 prim P_dots()			      /* Print entire contents of stack */
 {
-    stackitem *tsp;
-
     V printf("Stack: ");
     if (stk == stackbot)
         V printf("Empty.");
     else {
-	for (tsp = stack; tsp < stk; tsp++) {
-            V printf(base == 16 ? "%lX" : "%ld ", *tsp);
-	}
+	dotcells(stack, (stackitem) (stk - stack));
     }
 }
 
+prim P_dotarray()		      /* Print array of cells */
+{				      /* addr n -- */
+    Sl(2);
+    Hpc(S1);
+#ifndef NOMEMCHECK
+    if (S0 > heaptop - (stackitem *) S1) {  /* Bound n first, the end */
+	badpointer();			      /* address might wrap */
+	return;
+    }
+#endif
+    if (S0 > 0) {
+	dotcells((stackitem *) S1, S0);
+    }
+    Pop2;
+}
+
 prim P_dotquote()		      /* Print literal string that follows */
 {
     Compiling;
@@ -1566,16 +1677,24 @@ prim P_fopen()			      /* Open file: fname fmodes fd -- flag */
     Hpc(S0);
     Isfile(S0);
 
-    // ESP: Prepend file path with SPIFFS mount point prefix
-    char spiffsPath[40];
-    strncpy(stpcpy(spiffsPath, "/spiffs"), (char *) S2, 32);
-
-    fd = fopen(spiffsPath, fopenmodes[S1]);
+    // ESP: Prepend file path with storage mount point prefix (see storage.h)
+    char vfsPath[STORAGE_VFS_PATH];
+    fd = NULL;
+    if (storageVfsPath(vfsPath, (char *) S2)) {
+	if (fopenmodes[S1][0] == 'w' || fopenmodes[S1][0] == 'a') {
+	    storageMakeParents((char *) S2);
+	}
+	fd = fopen(vfsPath, fopenmodes[S1]);
+    }
     if (fd == NULL) {
 	stat = Falsity;
     } else {
 	*(((stackitem *) S0) + 1) = (stackitem) fd;
 	stat = Truth;
+	// ESP: Buffer writes until full, FFLUSH or FCLOSE (allocated on first use)
+	V setvbuf(fd, NULL, _IOFBF, FileBuffer);
+	// ESP: File may be created, its size is updated once closed
+	fileIndexOpened((char *) S2, fd);
     }
     Pop2;
     S0 = stat;
@@ -1588,6 +1707,8 @@ prim P_fclose() 		      /* Close file: fd -- */
     Isfile(S0);
     Isopen(S0);
     V fclose(FileD(S0));
+    // ESP: Update file index with the written size
+    fileIndexClosed(FileD(S0));
     *(((stackitem *) S0) + 1) = (stackitem) NULL;
     Pop;
 }
@@ -1597,11 +1718,16 @@ prim P_fdelete()		      /* Delete file: fname -- flag */
     Sl(1);
     Hpc(S0);
 
-    // ESP: Prepend file path with SPIFFS mount point prefix	
-    char spiffsPath[40];	
-    strncpy(stpcpy(spiffsPath, "/spiffs"), (char *) S0, 32);
+    // ESP: Prepend file path with storage mount point prefix (see storage.h)
+    char vfsPath[STORAGE_VFS_PATH];
+    if (!storageVfsPath(vfsPath, (char *) S0)) {
+	S0 = Falsity;
+	return;
+    }
 
-    S0 = (unlink(spiffsPath) == 0) ? Truth : Falsity;
+    S0 = (unlink(vfsPath) == 0) ? Truth : Falsity;
+    // ESP: Drop from file index
+    fileIndexUpdate(vfsPath + sizeof(STORAGE_MOUNT) - 1);
 }
 
 prim P_fgetline()		      /* Get line: fd string -- flag */
@@ -1618,6 +1744,54 @@ prim P_fgetline()		      /* Get line: fd string -- flag */
     Pop;
 }
 
+// ESP: Line reading into buffer of given size, without the FGETS limit
+
+prim P_fgetlinen()		      /* Get line: fd buf len -- length */
+{
+    FILE *fd;
+    char *s;
+    int i = 0, n, ch;
+
+    Sl(3);
+    Hpc(S1);
+    Isfile(S2);
+    Isopen(S2);
+    fd = FileD(S2);
+    s = (char *) S1;
+    n = (int) S0;
+    if (n < 1) {
+	trouble("Bad line buffer length");
+	return;
+    }
+    Hpc(s + n - 1);
+
+    /* Line ends like in atl_fgetsp(). A line longer than the buffer
+       is returned in pieces of length - 1, the rest follows. */
+    while (True) {
+	ch = getc(fd);
+	if (ch == EOF) {
+	    if (i == 0)
+		i = -1;
+	    break;
+	}
+	if (ch == '\r' || ch == '\n') {
+	    int next = getc(fd);
+	    if (next != (ch == '\r' ? '\n' : '\r') && next != EOF)
+		V ungetc(next, fd);
+	    break;
+	}
+	if (i == n - 1) {
+	    V ungetc(ch, fd);
+	    break;
+	}
+	s[i++] = ch;
+    }
+    if (i >= 0)
+	s[i] = EOS;
+    Pop2;
+    S0 = i;
+}
+
 prim P_fputline()		      /* Put line: string fd -- flag */
 {
     Sl(2);
@@ -1652,6 +1826,79 @@ prim P_fwrite() 		      /* File write: len buf fd -- length */
     Pop2;
 }
 
+// ESP: Write-behind control and whole array transfers
+
+prim P_fflush() 		      /* Flush file buffer to flash: fd -- flag */
+{
+    Sl(1);
+    Isfile(S0);
+    Isopen(S0);
+    if (fflush(FileD(S0)) == EOF || fsync(fileno(FileD(S0))) != 0) {
+	S0 = Falsity;
+    } else {
+	fileIndexChanged(FileD(S0));
+	S0 = Truth;
+    }
+}
+
+#ifdef ARRAY
+/* Find data and size in bytes of array whose word address is given
+   (from ' or [']), NULL if the word is not an array. */
+
+static char *fblock(word, size)
+  stackitem word;
+  size_t *size;
+{
+    stackitem *array = ((stackitem *) word) + Dictwordl;
+    int i, nsubs, esize;
+
+    if (((dictword *) word)->wcode != P_arraysub)
+	return NULL;
+    nsubs = *array++;
+    esize = *array++;
+    *size = esize;
+    for (i = 0; i < nsubs; i++)
+	*size *= *array++;
+    return (char *) array;
+}
+
+prim P_freadblock()		      /* Read whole array: array fd -- length */
+{
+    char *data;
+    size_t size;
+
+    Sl(2);
+    Hpc(S1);
+    Isfile(S0);
+    Isopen(S0);
+    if ((data = fblock(S1, &size)) == NULL) {
+	trouble("Not an array");
+	return;
+    }
+    Hpc(data + size - 1);
+    S1 = fread(data, 1, size, FileD(S0));
+    Pop;
+}
+
+prim P_fwriteblock()		      /* Write whole array: array fd -- length */
+{
+    char *data;
+    size_t size;
+
+    Sl(2);
+    Hpc(S1);
+    Isfile(S0);
+    Isopen(S0);
+    if ((data = fblock(S1, &size)) == NULL) {
+	trouble("Not an array");
+	return;
+    }
+    Hpc(data + size - 1);
+    S1 = fwrite(data, 1, size, FileD(S0));
+    Pop;
+}
+#endif /* ARRAY */
+
 prim P_fgetc()			      /* File get character: fd -- char */
 {
     Sl(1);
@@ -2622,6 +2869,47 @@ prim P_walkback()		      /* Set or clear error walkback */
 }
 #endif /* WALKBACK */
 
+#ifdef WATCHDOG
+// ESP: Watchdog limits
+prim P_steplimit()		      /* Set instruction limit per command */
+{				      /* steps -- */
+    Sl(1);
+    atl_steplimit = (S0 < 0) ? 0 : S0;
+    Pop;
+}
+
+prim P_timelimit()		      /* Set time limit per command */
+{				      /* ms -- */
+    Sl(1);
+    atl_timelimit = (S0 < 0) ? 0 : S0;
+    Pop;
+}
+#endif /* WATCHDOG */
+
+#ifdef YIELD
+// ESP: Cooperative yielding
+prim P_yieldsteps()		      /* Set dispatches between yields */
+{				      /* steps -- */
+    Sl(1);
+    atl_yieldsteps = (S0 < 0) ? 0 : S0;
+    Pop;
+}
+
+prim P_yieldtime()		      /* Set run time between yields */
+{				      /* us -- */
+    Sl(1);
+    atl_yieldtime = (S0 < 0) ? 0 : S0;
+    Pop;
+}
+
+prim P_yieldstat()		      /* Yield overhead statistics */
+{				      /* -- yields us */
+    So(2);
+    Push = ycount;
+    Push = (stackitem) ytime;
+}
+#endif /* YIELD */
+
 #ifdef WORDSUSED
 
 prim P_wordsused()		      /* List words used by program */
@@ -2906,6 +3194,15 @@ static struct primfcn primt[] = {
 #ifdef WALKBACK
     {"0WALKBACK", P_walkback},
 #endif
+#ifdef WATCHDOG
+    {"0STEPLIMIT", P_steplimit},
+    {"0TIMELIMIT", P_timelimit},
+#endif
+#ifdef YIELD
+    {"0YIELDSTEPS", P_yieldsteps},
+    {"0YIELDTIME", P_yieldtime},
+    {"0YIELDSTAT", P_yieldstat},
+#endif
 
 #ifdef WORDSUSED
     {"0WORDSUSED", P_wordsused},
@@ -2954,10 +3251,12 @@ static struct primfcn primt[] = {
 #endif /* COMPILERW */
 
 #ifdef CONIO
+    {"0BASE", P_base},                // ESP: Number output base
     {"0.", P_dot},
     {"0?", P_question},
     {"0CR", P_cr},
     {"0.S", P_dots},
+    {"0.ARRAY", P_dotarray},          // ESP: Print array of cells
     {"1.\"", P_dotquote},
     {"1.(", P_dotparen},
     {"0TYPE", P_type},
@@ -2970,9 +3269,15 @@ static struct primfcn primt[] = {
     {"0FCLOSE", P_fclose},
     {"0FDELETE", P_fdelete},
     {"0FGETS", P_fgetline},
+    {"0FGETLINE", P_fgetlinen},       // ESP: Line of any length
     {"0FPUTS", P_fputline},
     {"0FREAD", P_fread},
     {"0FWRITE", P_fwrite},
+    {"0FFLUSH", P_fflush},            // ESP: Write buffered data
+#ifdef ARRAY
+    {"0FREAD-BLOCK", P_freadblock},   // ESP: Whole array
+    {"0FWRITE-BLOCK", P_fwriteblock}, // ESP: Whole array
+#endif /* ARRAY */
     {"0FGETC", P_fgetc},
     {"0FPUTC", P_fputc},
     {"0FTELL", P_ftell},
@@ -3072,6 +3377,7 @@ static void pwalkback()
 static void trouble(kind)
   char *kind;
 {
+    outputRedirectReset();	      // ESP: Errors are never captured
 #ifdef MEMMESSAGE
     V printf("\n%s.\n", kind);
 #endif
@@ -3093,6 +3399,17 @@ Exported void atl_error(kind)
     evalstat = ATL_APPLICATION;       /* Signify application-detected error */
 }
 
+// ESP: Errors of nested atl_exec() are not seen by the caller otherwise
+/*  ATL_FAIL  --  Fail the current evaluation with the status of a word
+		  executed by atl_exec() from a primitive.  The nested
+		  error has already aborted execution.  */
+
+Exported void atl_fail(status)
+  int status;
+{
+    evalstat = status;
+}
+
 #ifndef NOMEMCHECK
 
 /*  STAKOVER  --  Recover from stack overflow.	*/
@@ -3164,6 +3481,81 @@ static void divzero()
 
 #endif /* !NOMEMCHECK */
 
+#ifdef WATCHDOG
+
+/*  WDCHECK  --  Check watchdog limits of the running command.  Called
+		 by exword() every wdreload dispatches.  Yields to other
+		 tasks when due and aborts the command if a limit has
+		 been exceeded.  */
+
+static void wdcheck()
+{
+    long reload = WDINTERVAL;
+
+    wdsteps += wdreload;
+#ifdef YIELD
+    ysteps += wdreload;
+    if (((atl_yieldsteps > 0) && (ysteps >= atl_yieldsteps)) ||
+	((atl_yieldtime > 0) &&
+	    ((esp_timer_get_time() - ylast) >= atl_yieldtime))) {
+	int64_t ystart = esp_timer_get_time();
+
+	/* Block for a tick so that tasks of lower priority (idle task,
+	   network stack) get to run. */
+	vTaskDelay(1);
+	ylast = esp_timer_get_time();
+	ytime += ylast - ystart;
+	ycount++;
+	ysteps = 0;
+    }
+    if (atl_yieldsteps > 0) {
+	reload = min(reload, atl_yieldsteps - ysteps);
+    }
+#endif /* YIELD */
+    if (atl_steplimit > 0) {
+	if (wdsteps >= atl_steplimit) {
+	    wdcount = wdreload = WDINTERVAL;
+	    trouble("Instruction limit exceeded");
+	    evalstat = ATL_STEPLIMIT;
+	    return;
+	}
+	/* Land the next check exactly on the limit */
+	reload = min(reload, atl_steplimit - wdsteps);
+    }
+    if ((atl_timelimit > 0) &&
+	    ((esp_timer_get_time() - wdstart) >= atl_timelimit * 1000LL)) {
+	wdcount = wdreload = WDINTERVAL;
+	trouble("Time limit exceeded");
+	evalstat = ATL_TIMELIMIT;
+	return;
+    }
+    wdcount = wdreload = reload;
+}
+
+/*  ATL_WDRESET  --  Restart watchdog budget.  Called by the host before
+		     evaluating each command.  */
+
+void atl_wdreset()
+{
+    wdsteps = 0;
+    wdcount = wdreload = (atl_steplimit > 0) ?
+	min(WDINTERVAL, atl_steplimit) : WDINTERVAL;
+    wdstart = esp_timer_get_time();
+}
+#endif /* WATCHDOG */
+
+#ifdef YIELD
+
+/*  ATL_YIELDED  --  Note that the host has blocked the interpreter task
+		     (e.g. in a delay), restarting the yield interval.  */
+
+void atl_yielded()
+{
+    ylast = esp_timer_get_time();
+    ysteps = 0;
+}
+#endif /* YIELD */
+
 /*  EXWORD  --	Execute a word (and any sub-words it may invoke). */
 
 static void exword(wp)
@@ -3187,6 +3579,13 @@ static void exword(wp)
 	    break;
 	}
 #endif /* BREAK */
+#ifdef WATCHDOG
+	if (--wdcount <= 0) {	      /* Check limits once in a while */
+	    wdcheck();
+	    if (ip == NULL)	      /* Limit exceeded, command aborted */
+		break;
+	}
+#endif /* WATCHDOG */
 	curword = *ip++;
 #ifdef TRACE
 	if (atl_trace) {
@@ -3354,6 +3753,31 @@ stackitem *atl_body(dw)
     return ((stackitem *) dw) + Dictwordl;
 }
 
+/*  ESP: ATL_VARADDR  --  Look up a variable by name and return the
+		  address of its value, or NULL if there is no such
+		  variable.  Unlike atl_lookup(), the token buffer is not
+		  used and words are not marked used.  Call between
+		  evaluations on the interpreter task only: FORGET frees
+		  the names walked here.  */
+
+atl_int *atl_varaddr(name)
+  char *name;
+{
+    dictword *dw;
+    char key[sizeof tokbuf];
+
+    V strncpy(key, name, sizeof key - 1);
+    key[sizeof key - 1] = EOS;
+    ucase(key);
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+	if (!(dw->wname[0] & WORDHIDDEN) &&
+	     (strcmp(dw->wname + 1, key) == 0)) {
+	    return (dw->wcode == P_var) ? atl_body(dw) : NULL;
+	}
+    }
+    return NULL;
+}
+
 /*  ATL_EXEC  --  Execute a word, given its dictionary address.  The
                   evaluation status for that word's execution is
 		  returned.  The in-progress evaluation status is
@@ -3519,6 +3943,73 @@ int atl_load(fp)
     return es;
 }
 
+/*  ESP: ATL_LOADBEGIN, ATL_LOADLINE, ATL_LOADEND  --  Load source
+	 streamed line by line with the semantics of atl_load(): lines
+	 are numbered and an error unwinds everything loaded so far.
+	 Only one streamed load may be in progress (atl_load() may nest
+	 within it).  */
+
+static struct {
+    atl_statemark mk;		      /* State to unwind to on error */
+    atl_int scomm;		      /* Stack comment pending state */
+    dictword **sip;		      /* Stack instruction pointer */
+    char *sinstr;		      /* Stack input stream */
+    int lineno; 		      /* Current line number */
+    int es;			      /* Status of the load */
+} lstream;
+
+void atl_loadbegin()
+{
+    lstream.es = ATL_SNORM;
+    lstream.scomm = atl_comment;
+    lstream.sip = ip;
+    lstream.sinstr = instream;
+    lstream.lineno = 0;
+    atl_errline = 0;		      /* Reset line number of error */
+    atl_mark(&lstream.mk);
+    ip = NULL;			      /* Fool atl_eval into interp state */
+}
+
+/*  Returns the status of the load, lines after an error are ignored.  */
+
+int atl_loadline(s)
+  char *s;
+{
+    if (lstream.es != ATL_SNORM)
+	return lstream.es;
+    lstream.lineno++;
+    if ((lstream.es = atl_eval(s)) != ATL_SNORM) {
+	atl_errline = lstream.lineno; /* Save line number of error */
+	atl_unwind(&lstream.mk);
+    }
+    return lstream.es;
+}
+
+/*  Status es other than ATL_SNORM aborts the load (e.g. the stream
+    was cut off) and unwinds it.  */
+
+int atl_loadend(es)
+  int es;
+{
+    if ((lstream.es == ATL_SNORM) && (es != ATL_SNORM)) {
+	lstream.es = es;
+	atl_errline = lstream.lineno;
+	atl_unwind(&lstream.mk);
+    }
+    /* Check for a runaway comment, as atl_load() does.  */
+    if ((lstream.es == ATL_SNORM) && (atl_comment == Truth)) {
+#ifdef MEMMESSAGE
+        V printf("\nRunaway `(' comment.\n");
+#endif
+	lstream.es = ATL_RUNCOMM;
+	atl_unwind(&lstream.mk);
+    }
+    atl_comment = lstream.scomm;      /* Unstack comment pending status */
+    ip = lstream.sip;		      /* Unstack instruction pointer */
+    instream = lstream.sinstr;	      /* Unstack input stream */
+    return lstream.es;
+}
+
 /*  ATL_PROLOGUE  --  Recognise and process prologue statement.
 		      Returns 1 if the statement was part of the
 		      prologue and 0 otherwise. */
@@ -3642,6 +4133,9 @@ V printf(" Forgetting DOES> word. ");
 #endif
 				hptr--;
 			    }
+			    // ESP: Watched variables and sampler buffers may be gone
+			    watchDropAll();
+			    samplerClear();
 			}
 		    } else {
 #ifdef MEMMESSAGE
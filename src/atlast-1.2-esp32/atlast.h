@@ -37,6 +37,12 @@ extern atl_int atl_redef;	      /* Allow redefinition of words without
                                          issuing the "not unique" warning. */
 extern atl_int atl_errline;	      /* Line number where last atl_load()
 					 errored or zero if no error. */
+// ESP: Runaway program watchdog limits
+extern atl_int atl_steplimit;	      /* Instruction limit per command, 0 if none */
+extern atl_int atl_timelimit;	      /* Time limit per command in ms, 0 if none */
+// ESP: Cooperative yielding intervals
+extern atl_int atl_yieldsteps;	      /* Dispatches between yields, 0 if none */
+extern atl_int atl_yieldtime;	      /* Run time between yields in us, 0 if none */
 
 /*  ATL_EVAL return status codes  */
 
@@ -55,6 +61,9 @@ extern atl_int atl_errline;	      /* Line number where last atl_load()
 #define ATL_BREAK	-12	      /* Asynchronous break signal received */
 #define ATL_DIVZERO	-13	      /* Attempt to divide by zero */
 #define ATL_APPLICATION -14	      /* Application primitive atl_error() */
+// ESP: Watchdog status codes
+#define ATL_STEPLIMIT	-15	      /* Instruction limit exceeded */
+#define ATL_TIMELIMIT	-16	      /* Time limit exceeded */
 
 /*  Entry points  */
 // ESP: C/C++ linker compatibility
@@ -64,6 +73,19 @@ extern "C" {
 extern void atl_init(), atl_mark(), atl_unwind(), atl_break();
 extern int atl_eval(char*), atl_load();
 extern void atl_memstat();
+// ESP: Stack depth accessor for the interpreter task
+extern atl_int atl_depth();
+// ESP: Restart watchdog budget of a command
+extern void atl_wdreset();
+// ESP: Restart yield interval after the host blocked the interpreter
+extern void atl_yielded();
+// ESP: Load source streamed line by line
+extern void atl_loadbegin();
+extern int atl_loadline(char*), atl_loadend(int);
+// ESP: Fail evaluation with status of a nested atl_exec()
+extern void atl_fail(int);
+// ESP: Variable lookup callable from other tasks
+extern atl_int *atl_varaddr(char*);
 #ifdef __cplusplus
 }
 #endif
@@ -16,12 +16,19 @@
  */
 
 #include <Arduino.h>
-#include <esp_spiffs.h>
 #include <stdlib.h>
 
 #include "atlast-1.2-esp32/atldef.h"
 #include "atlast-prims.h"
+#include "atlast-task.h"
 #include "io.h"
+#include "jobs.h"
+#include "outring.h"
+#include "sampler.h"
+#include "wsframe.h"
+#include "scan.h"
+#include "storage.h"
+#include "telemetry.h"
 
 // NOTE: Do not forget to add definitions to the table in atlastAddPrims()!
 
@@ -113,12 +120,13 @@ prim P_adcr_mv() {
  * [interval] -> DELAY_MS
  * 
  * Shorter periods would require busy wait.
+ * Interrupted when ATLAST is killed.
  */
 prim P_delay_ms() {
     Sl(1);
     // Prevent extreme task delay on negative argument
     if ((long) S0 >= 0) {
-        delay(S0);
+        atlastSleep(S0);
     }
     Pop;
 }
@@ -149,6 +157,139 @@ prim P_uptime_s() {
     Push = time_s;
 }
 
+/**
+ * Command latency in microseconds
+ * 
+ * CMD_LATENCY_US -> [value]
+ * 
+ * Time between enqueueing the running command and start of its execution.
+ */
+prim P_cmd_latency_us() {
+    // Check for overflow and place latency on stack
+    So(1);
+    Push = (stackitem) atlastLastLatency();
+}
+
+/**
+ * Output dropped
+ * 
+ * OUT_DROPPED -> [bytes]
+ * 
+ * Output bytes not sent to websocket because the output ring was full.
+ */
+prim P_out_dropped() {
+    So(1);
+    Push = (stackitem) outRingDropped();
+}
+
+/**
+ * Output blocking
+ * 
+ * [flag] -> OUT_BLOCKING
+ * 
+ * True makes output wait for a slow websocket client, throttling ATLAST,
+ * false (default) drops output that does not fit the output ring.
+ */
+prim P_out_blocking() {
+    Sl(1);
+    outputSetBlocking(S0 != 0);
+    Pop;
+}
+
+/**
+ * Output sinks
+ * 
+ * [mask] -> OUT_SINKS
+ * 
+ * Select outputs receiving printed data: 1 serial, 2 websocket,
+ * 4 capture buffer (command results), 0 none.
+ */
+prim P_out_sinks() {
+    Sl(1);
+    outputSetSinks((uint8_t) S0);
+    Pop;
+}
+
+/**
+ * Output sinks query
+ * 
+ * OUT_SINKS? -> [mask]
+ */
+prim P_out_sinksq() {
+    So(1);
+    Push = (stackitem) outputSinks();
+}
+
+/**
+ * Output sink stats
+ * 
+ * [sink] -> OUT_SINK_STATS -> [bytes] [dropped]
+ * 
+ * Bytes passed to a single sink (one mask bit) and bytes it dropped.
+ */
+prim P_out_sink_stats() {
+    Sl(1);
+    So(1);
+    uint32_t bytes, dropped;
+    if (!outputSinkStats((uint8_t) S0, &bytes, &dropped)) {
+        bytes = dropped = 0;
+    }
+    S0 = (stackitem) bytes;
+    Push = (stackitem) dropped;
+}
+
+/**
+ * Capture start
+ * 
+ * [addr] [size] -> >CAPTURE
+ * Redirect output into heap buffer (null-terminated) until CAPTURE>.
+ * Captures nest, errors and the end of command restore output.
+ */
+prim P_capture_start() {
+    Sl(2);
+    if (S0 < 1) {
+        atl_error("Invalid capture buffer");
+        return;
+    }
+    Hpc(S1);
+    Hpc(((char *) S1) + S0 - 1);
+    if (!outputRedirectStart((char *) S1, S0)) {
+        atl_error("Captures nested too deep");
+        return;
+    }
+    Pop2;
+}
+
+/**
+ * Capture end
+ * 
+ * CAPTURE> -> [addr] [length]
+ * End innermost capture, return its buffer and length of captured output.
+ */
+prim P_capture_end() {
+    So(2);
+    char * buf;
+    size_t len;
+    if (!outputRedirectStop(&buf, &len)) {
+        atl_error("No capture active");
+        return;
+    }
+    Push = (stackitem) buf;
+    Push = (stackitem) len;
+}
+
+/**
+ * Websocket mallocs
+ * 
+ * WS_MALLOCS -> [count]
+ * 
+ * Heap allocations made while queueing websocket messages since boot.
+ */
+prim P_ws_mallocs() {
+    So(1);
+    Push = (stackitem) wsMallocs();
+}
+
 /**
  * Filesystem size in bytes
  * 
@@ -158,7 +299,7 @@ prim P_fssize() {
     // Check for overflow, get FS size and place on stack.
     So(1);
     size_t totalBytes, usedBytes;
-    esp_spiffs_info(NULL, &totalBytes, &usedBytes);
+    storageInfo(&totalBytes, &usedBytes);
     Push = totalBytes;
 }
 
@@ -171,7 +312,7 @@ prim P_fsused() {
     // Check for overflow, get used space and place on stack.
     So(1);
     size_t totalBytes, usedBytes;
-    esp_spiffs_info(NULL, &totalBytes, &usedBytes);
+    storageInfo(&totalBytes, &usedBytes);
     Push = usedBytes;
 }
 
@@ -184,7 +325,7 @@ prim P_fsfree() {
     // Check for overflow, calculate free space and place on stack.
     So(1);
     size_t totalBytes, usedBytes;
-    esp_spiffs_info(NULL, &totalBytes, &usedBytes);
+    storageInfo(&totalBytes, &usedBytes);
     size_t freeBytes = totalBytes - usedBytes;
     Push = freeBytes;
 }
@@ -284,25 +425,482 @@ prim P_parseaccel() {
     multiPrintf("X: %f Y: %f Z: %f\n", axesXYZ[0], axesXYZ[1], axesXYZ[2]);
 }
 
+/**
+ * Job done
+ * 
+ * [handle] -> JOB? -> [flag]
+ * Puts true on stack if the job has finished, false otherwise.
+ */
+prim P_jobq() {
+    Sl(1);
+    S0 = (jobStatus(S0) == JOB_DONE) ? -1 : 0;
+}
+
+/**
+ * Job wait
+ * 
+ * [handle] -> JOB-WAIT -> [result]
+ * Waits for the job to finish, puts its result on stack and releases handle.
+ * Interrupted when ATLAST is killed.
+ */
+prim P_jobwait() {
+    Sl(1);
+    long result;
+    if (!jobWait(S0, &result)) {
+        if (!atlastKilled()) {
+            atl_error("Invalid job handle");
+        }
+        return;
+    }
+    S0 = result;
+}
+
+/**
+ * CRC-32 kernel
+ * 
+ * Job kernel computing CRC-32 (IEEE 802.3) of args[1] bytes at args[0].
+ */
+static long crc32Kernel(long * args) {
+    const uint8_t * data = (const uint8_t *) args[0];
+    size_t len = args[1];
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return (long) ~crc;
+}
+
+/**
+ * CRC-32 job
+ * 
+ * [address] [length] -> CRC32_JOB -> [handle]
+ * Computes CRC-32 of heap buffer on the other core.
+ * Collect the result with JOB-WAIT, leave the buffer untouched until then.
+ */
+prim P_crc32_job() {
+    Sl(2);
+    // Check that the whole buffer lies in the heap
+    if (S0 > 0) {
+        Hpc(S1);
+        Hpc(S1 + S0 - 1);
+    }
+    long args[2] = {S1, S0};
+    int handle = jobSubmit(crc32Kernel, args, 2);
+    if (!handle) {
+        atl_error("No free job slot");
+        return;
+    }
+    Pop;
+    S0 = handle;
+}
+
+/**
+ * Scan input
+ * 
+ * [pin] -> SCAN_IN
+ * Maps digital input pin to the next bit of the scan input image.
+ */
+prim P_scan_in() {
+    Sl(1);
+    if (!scanAddInput(S0)) {
+        atl_error("Scan input image full");
+        return;
+    }
+    Pop;
+}
+
+/**
+ * Scan output
+ * 
+ * [pin] -> SCAN_OUT
+ * Maps the next bit of the scan output image to digital output pin.
+ */
+prim P_scan_out() {
+    Sl(1);
+    if (!scanAddOutput(S0)) {
+        atl_error("Scan output image full");
+        return;
+    }
+    Pop;
+}
+
+/**
+ * Scan clear
+ * 
+ * SCAN_CLEAR
+ * Removes all pins from the scan process image.
+ */
+prim P_scan_clear() {
+    scanClear();
+}
+
+/**
+ * Scan input image
+ * 
+ * SCAN_I@ -> [image]
+ * Puts input image latched at the start of the cycle on stack.
+ */
+prim P_scan_ifetch() {
+    So(1);
+    Push = scanGetInputs();
+}
+
+/**
+ * Scan output image fetch
+ * 
+ * SCAN_Q@ -> [image]
+ */
+prim P_scan_qfetch() {
+    So(1);
+    Push = scanGetOutputs();
+}
+
+/**
+ * Scan output image store
+ * 
+ * [image] -> SCAN_Q!
+ * Sets output image committed at the end of the cycle.
+ */
+prim P_scan_qstore() {
+    Sl(1);
+    scanSetOutputs(S0);
+    Pop;
+}
+
+/**
+ * Scan body
+ * 
+ * Execute word given by compile address as a scan cycle body.
+ */
+static int scanBody(void * word) {
+    return atl_exec((dictword *) word);
+}
+
+/**
+ * Scan run
+ * 
+ * [word address] [period ms] -> SCAN_RUN
+ * Runs scan cycles with fixed period until SCAN_STOP, error or kill.
+ * Each cycle latches inputs, executes the word and commits outputs.
+ * Error of the word fails SCAN_RUN with the same status.
+ */
+prim P_scan_run() {
+    Sl(2);
+    if (S0 <= 0 || !pdMS_TO_TICKS(S0)) {
+        atl_error("Scan period shorter than one tick");
+        return;
+    }
+    dictword * word = (dictword *) S1;
+    uint32_t period = S0;
+    // Pop arguments, so that the word sees the stack below them
+    Pop2;
+
+    int status = scanRun(scanBody, word, period);
+    if (status != ATL_SNORM) {
+        multiPrintf("Scan stopped: error %d\n", status);
+        atl_fail(status);
+    }
+}
+
+/**
+ * Scan stop
+ * 
+ * SCAN_STOP
+ * Stops scan cycles after the current one.
+ */
+prim P_scan_stop() {
+    scanStop();
+}
+
+/**
+ * Scan statistics
+ * 
+ * SCAN_STATS -> [cycles] [overruns] [min] [max] [mean] [jitter]
+ * Statistics of the running or last scan, times in us.
+ */
+prim P_scan_stats() {
+    So(6);
+    struct scanStats stats;
+    scanGetStats(&stats);
+    Push = stats.cycles;
+    Push = stats.overruns;
+    Push = (stackitem) stats.minTime;
+    Push = (stackitem) stats.maxTime;
+    Push = stats.cycles ? (stackitem) (stats.sumTime / stats.cycles) : 0;
+    Push = (stackitem) stats.maxJitter;
+}
+
+/**
+ * Sampler channel
+ * 
+ * [buffer] [block cells] [blocks] [divider] -> SAMPLER_CHANNEL -> [channel]
+ * Declares channel filling heap buffer of `blocks` blocks of `block cells`
+ * cells with a sample every `divider` sampler periods.
+ * The buffer must stay allocated until SAMPLER_CLEAR.
+ */
+prim P_sampler_channel() {
+    Sl(4);
+    uint32_t blockLen = S2;
+    uint32_t blocks = S1;
+    // Check that the whole buffer lies in the heap
+    if (S2 > 0 && S1 > 0) {
+        Hpc(S3);
+#ifndef NOMEMCHECK
+        // Bound the length first, the end address might wrap
+        if (S1 > (heaptop - (stackitem *) S3) / S2) {
+            badpointer();
+            return;
+        }
+#endif
+    }
+    int ch = samplerChannel((long *) S3, blockLen, blocks, S0);
+    if (ch < 0) {
+        atl_error("Invalid or too many sampler channels");
+        return;
+    }
+    Npop(3);
+    S0 = ch;
+}
+
+/**
+ * Sampler source
+ * 
+ * Set source of channel on top of the stack, pop arguments.
+ */
+static void samplerSetSource(int args, uint8_t source, uint8_t pin, uint8_t reg, uint8_t bytes) {
+    if (!samplerSource(S0, source, pin, reg, bytes)) {
+        atl_error("Invalid sampler source");
+        return;
+    }
+    Npop(args);
+}
+
+/**
+ * Sample ADC
+ * 
+ * [pin] [channel] -> SAMPLE_ADC
+ * Samples analog input pin on channel.
+ */
+prim P_sample_adc() {
+    Sl(2);
+    samplerSetSource(2, SAMPLER_ADC, S1, 0, 0);
+}
+
+/**
+ * Sample GPIO
+ * 
+ * [pin] [channel] -> SAMPLE_GPIO
+ * Samples digital input pin on channel.
+ */
+prim P_sample_gpio() {
+    Sl(2);
+    samplerSetSource(2, SAMPLER_GPIO, S1, 0, 0);
+}
+
+/**
+ * Sample I2C
+ * 
+ * [address] [register] [bytes] [channel] -> SAMPLE_I2C
+ * Samples big-endian register of I2C slave on channel (-1 on bus error).
+ */
+prim P_sample_i2c() {
+    Sl(4);
+    samplerSetSource(4, SAMPLER_I2C, S3, S2, S1);
+}
+
+/**
+ * Sampler start
+ * 
+ * [period us] -> SAMPLER_START
+ * Starts sampling all channels, timed by high-resolution timer.
+ */
+prim P_sampler_start() {
+    Sl(1);
+    if (!samplerStart(S0)) {
+        atl_error("Invalid sampler period");
+        return;
+    }
+    Pop;
+}
+
+/**
+ * Sampler stop
+ * 
+ * SAMPLER_STOP
+ */
+prim P_sampler_stop() {
+    samplerStop();
+}
+
+/**
+ * Sampler clear
+ * 
+ * SAMPLER_CLEAR
+ * Stops sampling and removes all channels.
+ */
+prim P_sampler_clear() {
+    samplerClear();
+}
+
+/**
+ * Sample block
+ * 
+ * [channel] -> SAMPLE_BLOCK -> [address]
+ * Puts address of the oldest filled block of channel on stack, 0 if none.
+ */
+prim P_sample_block() {
+    Sl(1);
+    S0 = (stackitem) samplerBlock(S0);
+}
+
+/**
+ * Sample release
+ * 
+ * [channel] -> SAMPLE_RELEASE
+ * Returns the oldest filled block to the sampler for refilling.
+ */
+prim P_sample_release() {
+    Sl(1);
+    samplerRelease(S0);
+    Pop;
+}
+
+/**
+ * Sample drops
+ * 
+ * [channel] -> SAMPLE_DROPS -> [count]
+ * Number of samples dropped because no block was released in time.
+ */
+prim P_sample_drops() {
+    Sl(1);
+    S0 = samplerDrops(S0);
+}
+
+/**
+ * Telemetry send
+ * 
+ * Check that `n` samples of `size` bytes at S2 lie in the heap,
+ * send them to stream S0 and pop arguments.
+ */
+static void telemetryPrim(uint8_t type, size_t size) {
+    Sl(3);
+    if (S0 < 0 || S0 >= TLM_STREAMS) {
+        atl_error("Invalid telemetry stream");
+        return;
+    }
+    if (S1 > 0) {
+        Hpc(S2);
+#ifndef NOMEMCHECK
+        // Bound the count first, the end address might wrap
+        if (S1 > ((char *) heaptop - (char *) S2) / (stackitem) size) {
+            badpointer();
+            return;
+        }
+#endif
+        telemetrySend(S0, type, (const void *) S2, S1);
+    }
+    Npop(3);
+}
+
+/**
+ * Telemetry cells
+ * 
+ * [addr] [n] [stream] -> TELEMETRY_CELLS
+ * Send n cells to web clients as binary telemetry.
+ */
+prim P_telemetry_cells() {
+    telemetryPrim(TLM_CELLS, sizeof(stackitem));
+}
+
+/**
+ * Telemetry bytes
+ * 
+ * [addr] [n] [stream] -> TELEMETRY_BYTES
+ * Send n bytes to web clients as binary telemetry.
+ */
+prim P_telemetry_bytes() {
+    telemetryPrim(TLM_BYTES, 1);
+}
+
+/**
+ * Telemetry floats
+ * 
+ * [addr] [n] [stream] -> TELEMETRY_FLOATS
+ * Send n floating point numbers to web clients as binary telemetry.
+ */
+prim P_telemetry_floats() {
+    telemetryPrim(TLM_FLOATS, sizeof(double));
+}
+
+/**
+ * Telemetry drops
+ * 
+ * TELEMETRY_DROPS -> [count]
+ * Samples dropped (per client) because web clients fell behind.
+ */
+prim P_telemetry_drops() {
+    So(1);
+    Push = (stackitem) telemetryDrops();
+}
+
 // Primitive definition table
 static struct primfcn espPrims[] = {
-    {"0PINM",       P_pinm},
-    {"0PINW",       P_pinw},
-    {"0PINR",       P_pinr},
-    {"0DACW",       P_dacw},
-    {"0ADCR",       P_adcr},
-    {"0ADCR_MV",    P_adcr_mv},
-    {"0DELAY_MS",   P_delay_ms},
-    {"0UPTIME_MS",  P_uptime_ms},
-    {"0UPTIME_S",   P_uptime_s},
-    {"0FSSIZE",     P_fssize},
-    {"0FSUSED",     P_fsused},
-    {"0FSFREE",     P_fsfree},
-    {"0I2CSCAN",    P_i2cscan},
-    {"0I2CWRITE",   P_i2cwrite},
-    {"0I2CREAD",    P_i2cread},
-    {"0PARSEACCEL", P_parseaccel},
-    {NULL,          (codeptr) 0}
+    {"0PINM",             P_pinm},
+    {"0PINW",             P_pinw},
+    {"0PINR",             P_pinr},
+    {"0DACW",             P_dacw},
+    {"0ADCR",             P_adcr},
+    {"0ADCR_MV",          P_adcr_mv},
+    {"0DELAY_MS",         P_delay_ms},
+    {"0UPTIME_MS",        P_uptime_ms},
+    {"0UPTIME_S",         P_uptime_s},
+    {"0CMD_LATENCY_US",   P_cmd_latency_us},
+    {"0OUT_DROPPED",      P_out_dropped},
+    {"0OUT_BLOCKING",     P_out_blocking},
+    {"0OUT_SINKS",        P_out_sinks},
+    {"0OUT_SINKS?",       P_out_sinksq},
+    {"0OUT_SINK_STATS",   P_out_sink_stats},
+    {"0>CAPTURE",         P_capture_start},
+    {"0CAPTURE>",         P_capture_end},
+    {"0WS_MALLOCS",       P_ws_mallocs},
+    {"0FSSIZE",           P_fssize},
+    {"0FSUSED",           P_fsused},
+    {"0FSFREE",           P_fsfree},
+    {"0I2CSCAN",          P_i2cscan},
+    {"0I2CWRITE",         P_i2cwrite},
+    {"0I2CREAD",          P_i2cread},
+    {"0PARSEACCEL",       P_parseaccel},
+    {"0JOB?",             P_jobq},
+    {"0JOB-WAIT",         P_jobwait},
+    {"0CRC32_JOB",        P_crc32_job},
+    {"0SCAN_IN",          P_scan_in},
+    {"0SCAN_OUT",         P_scan_out},
+    {"0SCAN_CLEAR",       P_scan_clear},
+    {"0SCAN_I@",          P_scan_ifetch},
+    {"0SCAN_Q@",          P_scan_qfetch},
+    {"0SCAN_Q!",          P_scan_qstore},
+    {"0SCAN_RUN",         P_scan_run},
+    {"0SCAN_STOP",        P_scan_stop},
+    {"0SCAN_STATS",       P_scan_stats},
+    {"0SAMPLER_CHANNEL",  P_sampler_channel},
+    {"0SAMPLE_ADC",       P_sample_adc},
+    {"0SAMPLE_GPIO",      P_sample_gpio},
+    {"0SAMPLE_I2C",       P_sample_i2c},
+    {"0SAMPLER_START",    P_sampler_start},
+    {"0SAMPLER_STOP",     P_sampler_stop},
+    {"0SAMPLER_CLEAR",    P_sampler_clear},
+    {"0SAMPLE_BLOCK",     P_sample_block},
+    {"0SAMPLE_RELEASE",   P_sample_release},
+    {"0SAMPLE_DROPS",     P_sample_drops},
+    {"0TELEMETRY_CELLS",  P_telemetry_cells},
+    {"0TELEMETRY_BYTES",  P_telemetry_bytes},
+    {"0TELEMETRY_FLOATS", P_telemetry_floats},
+    {"0TELEMETRY_DROPS",  P_telemetry_drops},
+    {NULL,                (codeptr) 0}
 };
 
 /**
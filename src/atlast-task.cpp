@@ -15,104 +15,433 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <string>
+#include <esp_timer.h>
+#include <freertos/stream_buffer.h>
+
 #include "atlast-1.2-esp32/atlast.h"
 #include "atlast-prims.h"
 #include "atlast-task.h"
 #include "io.h"
+#include "jobs.h"
+#include "sampler.h"
+#include "watch.h"
+#include "webserver.h"
 
 
 // Run Data
 struct runData rd;
 
-// Run Data mutex and task handle
-SemaphoreHandle_t atlastRunMutex = xSemaphoreCreateMutex();
+// Task handle
 TaskHandle_t atlastTaskHandle = nullptr;
 
+// Preallocated command slots
+struct atlastCmd cmdSlots[ATL_CMD_SLOTS];
+// Queues of free and enqueued slot indices
+QueueHandle_t cmdFreeQueue = xQueueCreate(ATL_CMD_SLOTS, sizeof(uint8_t));
+QueueHandle_t cmdReadyQueue = xQueueCreate(ATL_CMD_SLOTS, sizeof(uint8_t));
+// Slot being executed, -1 if none
+volatile int cmdCurrentSlot = -1;
+// Signalled when the interpreter becomes idle
+SemaphoreHandle_t atlastIdleSemaphore = xSemaphoreCreateBinary();
+// Fires ATL_KILL_TIMEOUT_MS after a kill with restart and wakes the task
+// checking the killed program
+esp_timer_handle_t atlastKillTimer = NULL;
+TaskHandle_t atlastRestartTaskHandle = NULL;
+// Output captured for command result
+char resultOut[ATL_RESULT_LEN];
+
+// Run message source on its way to the interpreter
+StreamBufferHandle_t runStream = xStreamBufferCreate(ATL_RUN_STREAM, 1);
+// Source that did not fit the stream, follows it (list protected by runMux)
+struct runChunk {
+    struct runChunk * next;
+    size_t len;
+    size_t pos;     // Bytes already taken by the interpreter
+    char data[];
+};
+struct runChunk * volatile runBacklog = NULL;
+struct runChunk * runBacklogTail = NULL;
+volatile size_t runBacklogBytes = 0;
+// Run state, transitions protected by runMux
+struct {
+    bool open;      // Run in progress (message or interpreter not done)
+    bool ended;     // Whole message is in the stream
+    bool done;      // Interpreter finished or will never start
+    volatile bool aborted;  // Rest of the message is discarded
+} runState;
+portMUX_TYPE runMux = portMUX_INITIALIZER_UNLOCKED;
+
 
 /**
- * ATLAST start run
+ * ATLAST enqueue
  * 
- * Check start flag. If true, start execution. Otherwise wait a bit.
- * Returns true on program start, false otherwise.
+ * Copy text into a free command slot and enqueue it for execution.
+ * Waits up to `wait` ticks for a free slot.
+ * Returns false if no slot (or no heap for a long command) was available.
  */
-bool atlastStartRun() {
-    // Take mutex
-    xSemaphoreTake(atlastRunMutex, portMAX_DELAY);    
+static bool atlastEnqueue(const char * text, TickType_t wait,
+                          uint32_t id = 0, bool hasId = false, bool quiet = false,
+                          bool run = false, bool watch = false) {
+    uint8_t slot;
 
-    if (rd.startFlag) {
-        // Start execution and release mutex
-        rd.startFlag = false;
-        rd.isRunning = true;
-        xSemaphoreGive(atlastRunMutex);
-        return true;
+    // Get free slot
+    if (xQueueReceive(cmdFreeQueue, &slot, wait) != pdTRUE) {
+        return false;
+    }
+
+    // Fill slot and hand it over to the interpreter task,
+    // copy commands too long for the slot to heap
+    size_t len = strlen(text);
+    if (len < ATL_CMD_LEN) {
+        memcpy(cmdSlots[slot].text, text, len + 1);
+    } else if ((cmdSlots[slot].longText = (char *) malloc(len + 1))) {
+        memcpy(cmdSlots[slot].longText, text, len + 1);
     } else {
-        // Release mutex and wait 0.1s
-        xSemaphoreGive(atlastRunMutex);
-        vTaskDelay(100 / portTICK_RATE_MS);
+        atlastReleaseCommand(slot);
         return false;
     }
+    cmdSlots[slot].id = id;
+    cmdSlots[slot].hasId = hasId;
+    // Result goes to the client submitting the command
+    cmdSlots[slot].client = hasId ? wsClientId() : 0;
+    cmdSlots[slot].quiet = quiet;
+    cmdSlots[slot].run = run;
+    cmdSlots[slot].watch = watch;
+    cmdSlots[slot].enqueued = esp_timer_get_time();
+    xQueueSend(cmdReadyQueue, &slot, portMAX_DELAY);
+    return true;
 }
 
 /**
- * ATLAST reset run
+ * ATLAST run backlog free
  * 
- * Reset Run Data and release mutex.
+ * Drop run source kept on heap (no run in progress).
  */
-void atlastResetRun() {
-    // Empty the queue if nonempty
-    if (!rd.commands.empty()) {
-        std::queue<std::string> emptyQueue;
-        std::swap(rd.commands, emptyQueue);
+static void atlastRunBacklogFree() {
+    while (runBacklog) {
+        struct runChunk * c = runBacklog;
+        runBacklog = c->next;
+        free(c);
     }
-    rd.startFlag = false;
-    rd.killFlag = false;
-    rd.isRunning = false;
-    xSemaphoreGive(atlastRunMutex);
+    runBacklogTail = NULL;
+    runBacklogBytes = 0;
 }
 
 /**
- * ATLAST interpreter loop
+ * ATLAST run done
  * 
- * Execute ATLAST commands from queue when available.
- * Blocks atlastRunMutex.
- * Run in a separate task.
+ * Interpreter side of the run is over: the run is closed once the message
+ * has ended as well, the rest of the message is discarded otherwise.
+ * Whoever finishes last (this or atlastRunEnd()) closes the run.
  */
-void atlastInterpreterLoop(void * pvParameter) {
-    // Wait for execution
-    while(true) {
-        // If not ready to start, try again
-        if (!atlastStartRun())
-            continue;
-        
-        // Take mutex
-        xSemaphoreTake(atlastRunMutex, portMAX_DELAY); 
-
-        // Execute commands stored in Run Data
-        while (!rd.commands.empty()) {
-            // On KILL flag stop execution and reset Run Data
-            if (rd.killFlag) {
+static void atlastRunDone() {
+    portENTER_CRITICAL(&runMux);
+    runState.done = true;
+    bool closed = runState.ended;
+    if (!closed) {
+        runState.aborted = true;
+    }
+    portEXIT_CRITICAL(&runMux);
+
+    // Drop source left over after an error, then let the next run begin
+    if (closed) {
+        atlastRunBacklogFree();
+        portENTER_CRITICAL(&runMux);
+        runState.open = false;
+        portEXIT_CRITICAL(&runMux);
+    }
+}
+
+/**
+ * ATLAST drain
+ * 
+ * Return all enqueued command slots to the pool of free slots.
+ * Commands with ID are reported as broken.
+ */
+static void atlastDrain() {
+    uint8_t slot;
+    while (xQueueReceive(cmdReadyQueue, &slot, 0) == pdTRUE) {
+        if (cmdSlots[slot].hasId) {
+            wsSendResult(cmdSlots[slot].client, cmdSlots[slot].id, ATL_BREAK, "", 0, -1, 0, false);
+        }
+        if (cmdSlots[slot].run) {
+            atlastRunDone();
+        }
+        if (cmdSlots[slot].watch) {
+            watchCancel();
+        }
+        atlastReleaseCommand(slot);
+    }
+}
+
+/**
+ * ATLAST last latency
+ * 
+ * Return enqueue-to-start time of the last executed command in us.
+ */
+int64_t atlastLastLatency() {
+    return rd.lastLatency;
+}
+
+/**
+ * ATLAST sleep
+ * 
+ * Block the interpreter task for `ms` milliseconds.
+ * Returns early if ATLAST is killed meanwhile.
+ */
+void atlastSleep(uint32_t ms) {
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    if (!ticks) {
+        return;
+    }
+
+    // Wait for notification from atlastKill() or timeout, a stray
+    // notification does not cut the sleep short
+    TickType_t start = xTaskGetTickCount();
+    TickType_t slept = 0;
+    while (slept < ticks && !rd.killFlag) {
+        ulTaskNotifyTake(pdTRUE, ticks - slept);
+        slept = xTaskGetTickCount() - start;
+    }
+
+    // Other tasks had a chance to run, no need to yield soon
+    atl_yielded();
+}
+
+/**
+ * ATLAST killed
+ * 
+ * Return true if the running program is being killed.
+ */
+bool atlastKilled() {
+    return rd.killFlag;
+}
+
+/**
+ * ATLAST next command
+ * 
+ * Block until a command is enqueued.
+ * Returns index of the command slot to execute.
+ */
+uint8_t atlastNextCommand() {
+    uint8_t slot;
+
+    // If the queue is exhausted, execution has finished
+    if (uxQueueMessagesWaiting(cmdReadyQueue) == 0 && rd.isRunning) {
+        rd.isRunning = false;
+        rd.killFlag = false;
+        xSemaphoreGive(atlastIdleSemaphore);
+    }
+
+    // Sleep until a command arrives (no polling)
+    xQueueReceive(cmdReadyQueue, &slot, portMAX_DELAY);
+    atl_yielded();
+    rd.isRunning = true;
+    cmdCurrentSlot = slot;
+
+    // Measure enqueue-to-start latency
+    rd.lastLatency = esp_timer_get_time() - cmdSlots[slot].enqueued;
+    if (rd.lastLatency > rd.maxLatency) {
+        rd.maxLatency = rd.lastLatency;
+    }
+
+    return slot;
+}
+
+/**
+ * ATLAST release command
+ * 
+ * Return command slot to the pool of free slots.
+ */
+void atlastReleaseCommand(uint8_t slot) {
+    free(cmdSlots[slot].longText);
+    cmdSlots[slot].longText = NULL;
+    xQueueSend(cmdFreeQueue, &slot, portMAX_DELAY);
+}
+
+/**
+ * ATLAST run backlog take
+ * 
+ * Move up to `size` bytes of run source kept on heap into buffer.
+ * Returns the number of bytes taken.
+ */
+static size_t atlastRunBacklogTake(char * buf, size_t size) {
+    struct runChunk * c = runBacklog;
+    if (!c) {
+        return 0;
+    }
+
+    // Only the interpreter takes from the list, the head stays put
+    size_t n = min(size, c->len - c->pos);
+    memcpy(buf, c->data + c->pos, n);
+    c->pos += n;
+    if (c->pos < c->len) {
+        return n;
+    }
+
+    portENTER_CRITICAL(&runMux);
+    runBacklog = c->next;
+    if (!runBacklog) {
+        runBacklogTail = NULL;
+    }
+    runBacklogBytes -= c->len;
+    portEXIT_CRITICAL(&runMux);
+    free(c);
+    return n;
+}
+
+/**
+ * ATLAST run load
+ * 
+ * Load run stream line by line until the message ends.
+ * Returns status of the load.
+ */
+static int atlastRunLoad() {
+    char line[ATL_RUN_LINE];
+    char chunk[64];
+    size_t len = 0;
+    int status = ATL_SNORM;
+
+    atl_loadbegin();
+    while (status == ATL_SNORM) {
+        // Stream first, then the backlog behind it, then wait for more
+        size_t n = xStreamBufferReceive(runStream, chunk, sizeof(chunk), 0);
+        if (!n) {
+            n = atlastRunBacklogTake(chunk, sizeof(chunk));
+        }
+        if (!n) {
+            n = xStreamBufferReceive(runStream, chunk, sizeof(chunk),
+                                     pdMS_TO_TICKS(ATL_RUN_WAIT_MS));
+            atl_yielded();
+        }
+
+        // Killed, or the message was cut off
+        if (rd.killFlag || runState.aborted) {
+            status = ATL_BREAK;
+            break;
+        }
+        if (!n) {
+            if (runState.ended && xStreamBufferIsEmpty(runStream) && !runBacklog) {
                 break;
             }
+            continue;
+        }
+
+        // Evaluate complete lines, split overlong ones (like atl_fgetsp)
+        for (size_t i = 0; i < n && status == ATL_SNORM; i++) {
+            if (chunk[i] == '\r') {
+                continue;
+            }
+            if (chunk[i] != '\n') {
+                line[len++] = chunk[i];
+                if (len < sizeof(line) - 1) {
+                    continue;
+                }
+            }
+            line[len] = '\0';
+            len = 0;
+            status = atl_loadline(line);
+        }
+    }
+
+    // Last line without newline
+    if (status == ATL_SNORM && len) {
+        line[len] = '\0';
+        status = atl_loadline(line);
+    }
+
+    status = atl_loadend(status);
+    atlastRunDone();
+    return status;
+}
 
-            // Get pointer to the string in front of the queue
-            char *command = &rd.commands.front()[0];
-            // Release mutex during execution to allow addition of commands to queue
-            // Note: rd.commands.pop() must not be called in the meantime!
-            xSemaphoreGive(atlastRunMutex);
-            // Evaluate string in front of the queue
-            atl_eval(command);
+/**
+ * ATLAST execute
+ * 
+ * Evaluate command in slot, acknowledge it and report its result.
+ */
+static void atlastExecute(struct atlastCmd * cmd) {
+    // Dictionary lookup for variable watches, nothing is evaluated
+    if (cmd->watch) {
+        watchResolve();
+        return;
+    }
 
-            // Take mutex again
-            xSemaphoreTake(atlastRunMutex, portMAX_DELAY);
-            // Remove front string from the queue
-            rd.commands.pop();
+    // Output goes to sinks, whatever a killed command left redirected
+    outputRedirectReset();
 
-            // Print acknowledgement of executed command
+    // Capture output for structured result
+    if (cmd->hasId) {
+        outputCaptureStart(resultOut, ATL_RESULT_LEN);
+    }
+
+    // Discard stale wake-up from ATLAST sleep, arm watchdog
+    ulTaskNotifyTake(pdTRUE, 0);
+    atl_wdreset();
+
+    // Evaluate command in place (or load run stream) and measure execution time
+    int64_t start = esp_timer_get_time();
+    int status = cmd->run ? atlastRunLoad() :
+                 atl_eval(cmd->longText ? cmd->longText : cmd->text);
+    int64_t duration = esp_timer_get_time() - start;
+
+    // Output redirected by the command and not restored goes back to sinks
+    outputRedirectReset();
+
+    size_t outLen = 0;
+    bool overflow = false;
+    if (cmd->hasId) {
+        outLen = outputCaptureStop(&overflow);
+    }
+
+    // Print acknowledgement of executed command
+    if (!cmd->quiet) {
+        if (status == ATL_SNORM) {
             multiPrintf("\n< ok\n");
+        } else if (cmd->run && atl_errline) {
+            multiPrintf("\n< error %d in line %ld\n", status, atl_errline);
+        } else {
+            multiPrintf("\n< error %d\n", status);
+        }
+    }
+
+    // Send structured result to the client
+    if (cmd->hasId) {
+        wsSendResult(cmd->client, cmd->id, status, resultOut, outLen, atl_depth(), duration,
+                     overflow);
+    }
+}
+
+/**
+ * ATLAST interpreter loop
+ * 
+ * Execute ATLAST commands from queue when available.
+ * Run in a separate task.
+ */
+void atlastInterpreterLoop(void * pvParameter) {
+    while(true) {
+        // Wait for a command
+        uint8_t slot = atlastNextCommand();
+
+        // On KILL flag skip execution of remaining commands
+        if (!rd.killFlag) {
+            atlastExecute(&cmdSlots[slot]);
+        } else {
+            if (cmdSlots[slot].hasId) {
+                wsSendResult(cmdSlots[slot].client, cmdSlots[slot].id, ATL_BREAK, "", 0, -1, 0, false);
+            }
+            if (cmdSlots[slot].run) {
+                atlastRunDone();
+            }
+            if (cmdSlots[slot].watch) {
+                watchCancel();
+            }
         }
 
-        // Reset Run Data and release mutex
-        atlastResetRun(); 
+        // Return slot to the pool
+        cmdCurrentSlot = -1;
+        atlastReleaseCommand(slot);
     }
 }
 
@@ -120,21 +449,169 @@ void atlastInterpreterLoop(void * pvParameter) {
  * ATLAST command
  * 
  * Evaluate ATLAST command.
+ * Waits up to `wait` ticks for a free command slot.
+ * Returns false if the command could not be enqueued.
  */
-void atlastCommand(char* command) {
-    // Take mutex
-    xSemaphoreTake(atlastRunMutex, portMAX_DELAY);
-
+bool atlastCommand(char* command, TickType_t wait) {
     // Print incoming command
 	multiPrintf("> %s\n", command);
-    // Append command to Run Data and start execution, if needed
-    rd.commands.push(command);
-    if (!rd.isRunning) {
-        rd.startFlag = true;
+
+    // Append command to queue
+    if (!atlastEnqueue(command, wait)) {
+        multiPrintf("DISCARDED INPUT: Command queue full.\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * ATLAST command with ID
+ * 
+ * Evaluate ATLAST command submitted with a client-chosen ID.
+ * Output is captured and sent back in a structured result on completion.
+ * Quiet commands are neither echoed nor acknowledged in CLI output.
+ * Returns false if the command could not be enqueued.
+ */
+bool atlastCommandId(char* command, uint32_t id, bool quiet) {
+    // Print incoming command
+    if (!quiet) {
+        multiPrintf("> %s\n", command);
     }
 
-    // Release mutex
-    xSemaphoreGive(atlastRunMutex);
+    // Append command to queue, do not block the caller
+    if (!atlastEnqueue(command, 0, id, true, quiet)) {
+        multiPrintf("DISCARDED INPUT: Command queue full.\n");
+        wsSendResult(wsClientId(), id, ATL_CMD_REJECTED, "", 0, -1, 0, false);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * ATLAST watch resolve
+ * 
+ * Have the interpreter task look up names of subscribed variable watches
+ * once the commands before are done.
+ * Returns false if no command slot is free.
+ */
+bool atlastWatchResolve() {
+    return atlastEnqueue("", 0, 0, false, true, false, true);
+}
+
+/**
+ * ATLAST run begin
+ * 
+ * Start streaming source of a run message to the interpreter, which loads
+ * it line by line like a file. Called from the websocket task.
+ * Returns false if another run is in progress or the queue is full.
+ */
+bool atlastRunBegin(uint32_t id, bool hasId) {
+    portENTER_CRITICAL(&runMux);
+    bool busy = runState.open;
+    if (!busy) {
+        runState.open = true;
+        runState.ended = false;
+        runState.done = false;
+        runState.aborted = false;
+    }
+    portEXIT_CRITICAL(&runMux);
+    if (busy) {
+        multiPrintf("DISCARDED INPUT: Another run is in progress.\n");
+        if (hasId) {
+            wsSendResult(wsClientId(), id, ATL_CMD_REJECTED, "", 0, -1, 0, false);
+        }
+        return false;
+    }
+
+    // Nobody uses the stream and backlog between runs
+    xStreamBufferReset(runStream);
+    atlastRunBacklogFree();
+
+    multiPrintf("> (run)\n");
+    if (!atlastEnqueue("", 0, id, hasId, false, true)) {
+        multiPrintf("DISCARDED INPUT: Command queue full.\n");
+        if (hasId) {
+            wsSendResult(wsClientId(), id, ATL_CMD_REJECTED, "", 0, -1, 0, false);
+        }
+        portENTER_CRITICAL(&runMux);
+        runState.open = false;
+        portEXIT_CRITICAL(&runMux);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * ATLAST run write
+ * 
+ * Pass part of run message source to the interpreter without waiting.
+ * Source not fitting the buffer is kept on heap up to ATL_RUN_BACKLOG,
+ * the run is aborted beyond that.
+ */
+void atlastRunWrite(const char * data, size_t len) {
+    if (!len || runState.aborted) {
+        return;
+    }
+
+    // Keep order: the stream only takes source while the backlog is empty
+    // (only this function adds to it)
+    if (!runBacklog) {
+        size_t sent = xStreamBufferSend(runStream, data, len, 0);
+        data += sent;
+        len -= sent;
+        if (!len) {
+            return;
+        }
+    }
+
+    // Keep the rest on heap for the interpreter to take after the stream
+    struct runChunk * c = NULL;
+    if (runBacklogBytes + len <= ATL_RUN_BACKLOG) {
+        c = (struct runChunk *) malloc(sizeof(struct runChunk) + len);
+    }
+    if (!c) {
+        multiPrintf("DISCARDED INPUT: Run backlog full, rest of the code dropped.\n");
+        runState.aborted = true;
+        return;
+    }
+    memcpy(c->data, data, len);
+    c->next = NULL;
+    c->len = len;
+    c->pos = 0;
+
+    portENTER_CRITICAL(&runMux);
+    if (runBacklogTail) {
+        runBacklogTail->next = c;
+    } else {
+        runBacklog = c;
+    }
+    runBacklogTail = c;
+    runBacklogBytes += len;
+    portEXIT_CRITICAL(&runMux);
+}
+
+/**
+ * ATLAST run end
+ * 
+ * Mark end of run message source. Incomplete (interrupted) source is
+ * not loaded any further and the load is unwound.
+ */
+void atlastRunEnd(bool complete) {
+    portENTER_CRITICAL(&runMux);
+    if (!complete) {
+        runState.aborted = true;
+    }
+    runState.ended = true;
+    bool closed = runState.done;
+    portEXIT_CRITICAL(&runMux);
+
+    // Drop source the interpreter did not take, then let the next run begin
+    if (closed) {
+        atlastRunBacklogFree();
+        portENTER_CRITICAL(&runMux);
+        runState.open = false;
+        portEXIT_CRITICAL(&runMux);
+    }
 }
 
 /**
@@ -143,12 +620,13 @@ void atlastCommand(char* command) {
  * Create ATLAST machine task.
  */
 void atlastCreateTask() {
-    xTaskCreate(&atlastInterpreterLoop,
-                ATL_TASK_NAME,
-                4096,   // Stack size
-                NULL,
-                5,  // Priority
-                &atlastTaskHandle); // Store task handle
+    xTaskCreatePinnedToCore(&atlastInterpreterLoop,
+                            ATL_TASK_NAME,
+                            4096,   // Stack size
+                            NULL,
+                            5,  // Priority
+                            &atlastTaskHandle,  // Store task handle
+                            ATL_CORE);
 }
 
 /**
@@ -157,67 +635,152 @@ void atlastCreateTask() {
  * Initiate ATLAST and create interpreter task.
  */
 void atlastInit() {
+    // Fill the pool of free command slots
+    for (uint8_t slot = 0; slot < ATL_CMD_SLOTS; slot++) {
+        atlastReleaseCommand(slot);
+    }
+
     // Need to explicitly initialize ATLAST before extending dictionary
     atl_init();
 
     // Extend ATLAST dictionary with custom word definitions
     atlastAddPrims();
 
+    // Create worker for jobs offloaded from ATLAST primitives
+    jobsInit();
+
     // Create ATLAST interpreter task
     atlastCreateTask();
 
     // Run ATLAST source file "/atl/pins.atl"
-    xSemaphoreTake(atlastRunMutex, portMAX_DELAY);
-    rd.commands.push(
+    atlastEnqueue(
         "file startupfile "     // Create file descriptor
         "\"/atl/pins.atl\" 1 startupfile fopen "    // Open file
         "startupfile fload "    // Execute file
         "startupfile fclose "   // Close file
-        "clear"                 // Clear return values from stack
+        "clear",                // Clear return values from stack
+        portMAX_DELAY
     );
-    rd.startFlag = true;    // Star ATLAST machine
-    xSemaphoreGive(atlastRunMutex);
+}
+
+/**
+ * ATLAST restart
+ * 
+ * Restart ATLAST in a new task if the killed program did not stop.
+ */
+static void atlastRestart() {
+    // Keep the task (and its state) if the program stopped in time
+    if (!rd.isRunning || xSemaphoreTake(atlastIdleSemaphore, 0) == pdTRUE) {
+        return;
+    }
+
+    // Program is stuck outside the inner interpreter, restart the task
+    multiPrintf("Program did not stop, restarting ATLAST task.\n");
+
+    // Prevent passing NULL below (would delete calling task)
+    if (!atlastTaskHandle) {
+        multiPrintf("ERROR: Task handle is NULL, cannot restart task.\n");
+        return;
+    }
+
+    // Delete task (takes effect immediately for another task)
+    vTaskDelete(atlastTaskHandle);
+    i2cUnlockTask(atlastTaskHandle);
+    watchUnlockTask(atlastTaskHandle);
+    outputTaskDeleted(atlastTaskHandle);
+    // Dictionary might have been left halfway through a change
+    watchDropAll();
+    samplerClear();
+
+    // Reclaim slot held by the deleted task, discard the rest
+    if (cmdCurrentSlot >= 0) {
+        if (cmdSlots[cmdCurrentSlot].run) {
+            atlastRunDone();
+        }
+        atlastReleaseCommand(cmdCurrentSlot);
+        cmdCurrentSlot = -1;
+    }
+    atlastDrain();
+    rd.killFlag = false;
+    rd.isRunning = false;
+
+    atlastCreateTask();
+
+    // Command to clear return stack (keeps data stack), slots are free now
+    atlastEnqueue("quit", 0);
+}
+
+/**
+ * ATLAST restart loop
+ * 
+ * Check killed program whenever the kill timer fires.
+ * Run in its own task, the timer callback must not block.
+ */
+static void atlastRestartLoop(void * pvParameter) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        atlastRestart();
+    }
+}
+
+/**
+ * ATLAST kill timeout
+ * 
+ * Wake the restart task. Runs in the esp_timer task ATL_KILL_TIMEOUT_MS
+ * after atlastKill().
+ */
+static void atlastKillTimeout(void * arg) {
+    xTaskNotifyGive(atlastRestartTaskHandle);
 }
 
 /**
  * ATLAST kill
  * 
- * Sets KILL flag to reset Run Data.
- * Breaks running ATLAST program.
- * Restarts ATLAST in a new task if requested.
+ * Sets KILL flag and empties the command queue.
+ * Breaks running ATLAST program and wakes it from ATLAST sleep.
+ * If requested, restarts ATLAST in a new task when the program does not stop
+ * within ATL_KILL_TIMEOUT_MS. Does not wait for that, a timer wakes the
+ * task doing the check.
  * Does not call ATLAST ABORT (that would reset atlast.c state itself).
  */
 void atlastKill(bool restartTask) {
     if (rd.isRunning) {
+        // Discard stale idle signal
+        xSemaphoreTake(atlastIdleSemaphore, 0);
+
         // Set KILL flag for interpreter task
         rd.killFlag = true;
 
-        // Set BREAK flag for atl_exec
+        // Discard enqueued commands
+        atlastDrain();
+
+        // Set BREAK flag for atl_exec and interrupt ATLAST sleep
         atl_break();
+        xTaskNotifyGive(atlastTaskHandle);
     }
 
-    // Restart ATLAST task if requested
-    if (restartTask) {
-        // Prevent passing NULL below (would suspend and delete calling task)
-        if (!atlastTaskHandle) {
-            multiPrintf("ERROR: Task handle is NULL, cannot restart task.\n");
-            return;
-        }
-
-        // Suspend and delete task
-        vTaskSuspend(atlastTaskHandle);
-        vTaskDelete(atlastTaskHandle);
-
-        // Wait for the task to be deleted
-        do {
-            vTaskDelay(50 / portTICK_PERIOD_MS);
-        } while (!strcmp(pcTaskGetTaskName(atlastTaskHandle), ATL_TASK_NAME));
-
-        atlastResetRun();
-        atlastCreateTask();
+    if (!restartTask || !rd.isRunning) {
+        return;
+    }
 
-        // Command to clear return stack (keeps data stack)
-        rd.commands.push("quit");
-        rd.startFlag = true;
+    // Check the program ATL_KILL_TIMEOUT_MS later (restarts a pending check)
+    if (!atlastRestartTaskHandle) {
+        // Above ATLAST priority, so that a program spinning on its core
+        // does not hold off the restart, below the sampler
+        xTaskCreatePinnedToCore(&atlastRestartLoop,
+                                ATL_RESTART_TASK_NAME,
+                                3072,   // Stack size
+                                NULL,
+                                6,  // Priority
+                                &atlastRestartTaskHandle,
+                                ATL_CORE);
+    }
+    if (!atlastKillTimer) {
+        esp_timer_create_args_t args = {};
+        args.callback = &atlastKillTimeout;
+        args.name = ATL_TASK_NAME;
+        esp_timer_create(&args, &atlastKillTimer);
     }
-}
\ No newline at end of file
+    esp_timer_stop(atlastKillTimer);
+    esp_timer_start_once(atlastKillTimer, ATL_KILL_TIMEOUT_MS * 1000);
+}
@@ -0,0 +1,273 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "fileindex.h"
+#include "storage.h"
+#include "webserver.h"
+#include "wsframe.h"
+
+
+static std::vector<struct fileEntry> fileIndex;  // Sorted by path
+static SemaphoreHandle_t fileIndexMutex = NULL;
+static uint32_t fileIndexSeq = 0;   // Changes pushed to clients
+
+// Forth file handle and its path, slot is free if handle is NULL
+static struct {
+    void * handle;
+    char path[FILE_INDEX_PATH];
+} fileOpen[FILE_INDEX_OPEN];
+
+/**
+ * File stat
+ * 
+ * Fill entry from the filesystem. Returns false if the file does not exist.
+ */
+static bool fileStat(const char * path, struct fileEntry * entry) {
+    char vfsPath[STORAGE_VFS_PATH];
+    struct stat st;
+
+    if (!storageVfsPath(vfsPath, path) || stat(vfsPath, &st) != 0 || S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    strcpy(entry->path, path);
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    return true;
+}
+
+/**
+ * File index find
+ * 
+ * Returns position of path in the index, or where it would be inserted.
+ */
+static std::vector<struct fileEntry>::iterator fileIndexFind(const char * path) {
+    return std::lower_bound(fileIndex.begin(), fileIndex.end(), path,
+        [](const struct fileEntry & e, const char * p) { return strcmp(e.path, p) < 0; });
+}
+
+/**
+ * File index push
+ * 
+ * Send change of path to all clients, `entry` is NULL if it was removed.
+ * Binary: ID is the sequence number, [size, int32] [mtime, uint32] [path]
+ * JSON: {"type":"fileDelta","seq":n,"path":"...","size":n,"mtime":n}
+ * A client missing a change (no free frame) sees a gap in the sequence
+ * and requests the whole list. Called with the index locked.
+ */
+static void fileIndexPush(const char * path, const struct fileEntry * entry) {
+    uint32_t ids[WS_MAX_CLIENTS];
+    bool binary[WS_MAX_CLIENTS];
+    size_t n = wsClientIds(ids, binary, WS_MAX_CLIENTS);
+    int32_t size = entry ? (int32_t) entry->size : -1;
+    uint32_t mtime = entry ? entry->mtime : 0;
+    size_t pathLen = strlen(path);
+
+    fileIndexSeq++;
+    for (size_t i = 0; i < n; i++) {
+        char * frame = wsFrameAcquire(false);
+        if (!frame) {
+            continue;
+        }
+
+        if (binary[i]) {
+            wsBinaryHeader((uint8_t *) frame, WSB_FILE_DELTA, fileIndexSeq);
+            memcpy(frame + WSB_HEADER, &size, sizeof(size));
+            memcpy(frame + WSB_HEADER + sizeof(size), &mtime, sizeof(mtime));
+            memcpy(frame + WSB_HEADER + sizeof(size) + sizeof(mtime), path, pathLen);
+            wsFrameSend(ids[i], frame, WSB_HEADER + sizeof(size) + sizeof(mtime) + pathLen, true);
+            continue;
+        }
+
+        JsonWriter json(frame, WS_FRAME_SIZE);
+        json.beginObject();
+        json.addString("type", "fileDelta");
+        json.addInt("seq", fileIndexSeq);
+        json.addString("path", path);
+        json.addInt("size", size);
+        json.addInt("mtime", mtime);
+        json.endObject();
+        wsFrameSendJson(ids[i], frame, json);
+    }
+}
+
+/**
+ * File index each
+ * 
+ * Call `fn` for indexed files in path order until it returns false.
+ * The index is locked meanwhile, so `fn` must not change it.
+ * Returns sequence number of the last change pushed to clients.
+ */
+uint32_t fileIndexEach(bool (*fn)(const struct fileEntry * entry, void * arg), void * arg) {
+    if (!fileIndexMutex) {
+        return 0;
+    }
+    xSemaphoreTake(fileIndexMutex, portMAX_DELAY);
+    for (const struct fileEntry & e : fileIndex) {
+        if (!fn(&e, arg)) {
+            break;
+        }
+    }
+    uint32_t seq = fileIndexSeq;
+    xSemaphoreGive(fileIndexMutex);
+    return seq;
+}
+
+/**
+ * File index walk
+ * 
+ * Add files in directory and its subdirectories to the index.
+ */
+static void fileIndexWalk(File & dir) {
+    File file;
+    while ((file = dir.openNextFile())) {
+        const char * path = storageFilePath(file);
+        if (file.isDirectory()) {
+            fileIndexWalk(file);
+        } else if (strlen(path) < FILE_INDEX_PATH) {
+            struct fileEntry e;
+            strcpy(e.path, path);
+            e.size = file.size();
+            e.mtime = file.getLastWrite();
+            fileIndex.push_back(e);
+        }
+        file.close();
+    }
+}
+
+/**
+ * File index build
+ * 
+ * Walk the filesystem (directories too) once and index all files.
+ * Call after mounting.
+ */
+void fileIndexBuild() {
+    if (!fileIndexMutex) {
+        fileIndexMutex = xSemaphoreCreateMutex();
+    }
+
+    File root = storage.open("/");
+
+    xSemaphoreTake(fileIndexMutex, portMAX_DELAY);
+    fileIndex.clear();
+    fileIndexWalk(root);
+    std::sort(fileIndex.begin(), fileIndex.end(),
+        [](const struct fileEntry & a, const struct fileEntry & b) { return strcmp(a.path, b.path) < 0; });
+    xSemaphoreGive(fileIndexMutex);
+    root.close();
+}
+
+/**
+ * File index update
+ * 
+ * Take size and mtime of `path` from the filesystem after it was written,
+ * created or removed. A change is pushed to all websocket clients.
+ */
+void fileIndexUpdate(const char * path) {
+    if (!fileIndexMutex) {
+        return;
+    }
+    struct fileEntry e;
+    bool exists = fileStat(path, &e);
+
+    xSemaphoreTake(fileIndexMutex, portMAX_DELAY);
+    auto it = fileIndexFind(path);
+    bool found = it != fileIndex.end() && strcmp(it->path, path) == 0;
+
+    if (exists && found) {
+        if (it->size != e.size || it->mtime != e.mtime) {
+            *it = e;
+            fileIndexPush(path, &e);
+        }
+    } else if (exists) {
+        fileIndex.insert(it, e);
+        fileIndexPush(path, &e);
+    } else if (found) {
+        fileIndex.erase(it);
+        fileIndexPush(path, NULL);
+    }
+    xSemaphoreGive(fileIndexMutex);
+}
+
+/**
+ * File index tracked
+ * 
+ * Copy path of tracked Forth file into `path` (FILE_INDEX_PATH bytes),
+ * stop tracking it if `untrack` is set. Returns false if not tracked.
+ */
+static bool fileIndexTracked(void * handle, char * path, bool untrack) {
+    bool found = false;
+    if (!fileIndexMutex) {
+        return false;
+    }
+
+    xSemaphoreTake(fileIndexMutex, portMAX_DELAY);
+    for (int i = 0; i < FILE_INDEX_OPEN; i++) {
+        if (fileOpen[i].handle == handle) {
+            strcpy(path, fileOpen[i].path);
+            if (untrack) {
+                fileOpen[i].handle = NULL;
+            }
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(fileIndexMutex);
+    return found;
+}
+
+/**
+ * File index opened / changed / closed
+ * 
+ * Track file opened by Forth, its entry is updated again once flushed
+ * or closed.
+ */
+void fileIndexOpened(const char * path, void * handle) {
+    fileIndexUpdate(path);
+    if (!fileIndexMutex || strlen(path) >= FILE_INDEX_PATH) {
+        return;
+    }
+
+    xSemaphoreTake(fileIndexMutex, portMAX_DELAY);
+    for (int i = 0; i < FILE_INDEX_OPEN; i++) {
+        if (!fileOpen[i].handle) {
+            fileOpen[i].handle = handle;
+            strcpy(fileOpen[i].path, path);
+            break;
+        }
+    }
+    xSemaphoreGive(fileIndexMutex);
+}
+
+void fileIndexChanged(void * handle) {
+    char path[FILE_INDEX_PATH];
+    if (fileIndexTracked(handle, path, false)) {
+        fileIndexUpdate(path);
+    }
+}
+
+void fileIndexClosed(void * handle) {
+    char path[FILE_INDEX_PATH];
+    if (fileIndexTracked(handle, path, true)) {
+        fileIndexUpdate(path);
+    }
+}
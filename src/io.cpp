@@ -19,35 +19,132 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string>
-#include <SPIFFS.h>
 #include <Wire.h>
 
 #include "atlast-1.2-esp32/atlast.h"
 #include "atlast-task.h"
+#include "fileindex.h"
 #include "io.h"
+#include "outring.h"
+#include "serial-io.h"
+#include "storage.h"
+#include "upload.h"
+#include "watch.h"
 #include "webserver.h"
 
+#define OUT_BLOCK_WAIT_MS 5 // Wait between retries of full output ring
+#define RUN_PREFIX "{\"type\":\"run\""  // Start of run message header line
 
-// File upload: file path and handle
-char uploadPath[32] = "/";
-File uploadFileHandle;
-// File paths not to be deleted/overwritten
+
+// File upload: client sending it and bytes of raw upload received
+uint32_t uploadClient = 0;
+uint32_t uploadReceived = 0;
+// Output capture buffer
+struct {
+    TaskHandle_t task;  // Task whose output is captured, NULL if inactive
+    char * buf;
+    size_t size;
+    size_t len;
+    bool overflow;      // Some output did not fit
+} outCapture;
+// Output redirection stack (>CAPTURE ... CAPTURE>), innermost buffer on top
+struct outRedirectBuf {
+    char * buf;
+    size_t size;
+    size_t len;
+};
+struct {
+    TaskHandle_t task;  // Task whose output is redirected
+    uint8_t depth;      // Nested redirections, 0 if inactive
+    struct outRedirectBuf bufs[OUT_REDIRECT_NEST];
+} outRedirect;
+// Binary protocol message being received
+struct {
+    uint8_t opcode;
+    uint32_t id;
+    uint32_t offset;    // Upload data: file offset of the next byte
+    size_t len;
+    bool overflow;
+    char * data = buf;  // Payload, `buf` or heap for longer commands
+    size_t size = WSB_MESSAGE_MAX;
+    char buf[WSB_MESSAGE_MAX];
+} binIn;
+// Run message being received (text or binary)
+enum {RUN_NONE, RUN_STREAM, RUN_DROP} runIncoming = RUN_NONE;
+uint32_t runClient = 0;     // Client sending the run message
+// Block ATLAST on full output ring instead of dropping output
+volatile bool outBlocking = false;
+// Ring record reserved by ATLAST and not committed yet, committed empty
+// if the task is deleted meanwhile (records are consumed in order)
+struct {
+    char * volatile data;
+    size_t size;
+} outAtlastRecord;
+// I2C bus lock shared by ATLAST and the sampler. A semaphore rather than
+// a mutex, so that the lock of a deleted ATLAST task can be released.
+SemaphoreHandle_t i2cSemaphore = xSemaphoreCreateCounting(1, 1);
+volatile TaskHandle_t i2cOwner = NULL;
+// Enabled output sinks (OUT_SINK_* mask) and their throughput,
+// counters guarded by spinlock (any task prints)
+volatile uint8_t outSinks = OUT_SINK_ALL;
+struct {
+    uint32_t bytes;     // Bytes passed to sink
+    uint32_t dropped;   // Bytes that did not fit sink
+} outStats[OUT_SINKS];
+portMUX_TYPE outStatsMux = portMUX_INITIALIZER_UNLOCKED;
+// File paths not to be deleted/overwritten (web assets are stored gzipped, see tools/gzip_www.py)
 std::vector<std::string> corePaths {
     "/",
-    "/www/codejar.min.js",
-    "/www/dracula.css",
-    "/www/esp32-atlast.js",
-    "/www/favicon.ico",
-    "/www/FileSaver.min.js",
-    "/www/forth.min.js",
-    "/www/index.html",
-    "/www/jquery-3.5.1.min.js",
-    "/www/linenumbers.min.js",
-    "/www/runmode-standalone.min.js",
-    "/www/style.css"
+    "/www/codejar.min.js.gz",
+    "/www/dracula.css.gz",
+    "/www/esp32-atlast.js.gz",
+    "/www/favicon.ico.gz",
+    "/www/FileSaver.min.js.gz",
+    "/www/forth.min.js.gz",
+    "/www/index.html.gz",
+    "/www/jquery-3.5.1.min.js.gz",
+    "/www/linenumbers.min.js.gz",
+    "/www/runmode.min.js.gz",
+    "/www/style.css.gz"
 };
 
 
+/**
+ * I2C lock
+ * 
+ * Take the shared I2C bus for one transaction, waiting up to
+ * I2C_LOCK_WAIT_MS for another task to finish.
+ * Returns false if the bus stayed locked.
+ */
+bool i2cLock() {
+    if (xSemaphoreTake(i2cSemaphore, pdMS_TO_TICKS(I2C_LOCK_WAIT_MS)) != pdTRUE) {
+        return false;
+    }
+    i2cOwner = xTaskGetCurrentTaskHandle();
+    return true;
+}
+
+/**
+ * I2C unlock
+ * 
+ * Release the I2C bus taken by i2cLock().
+ */
+void i2cUnlock() {
+    i2cOwner = NULL;
+    xSemaphoreGive(i2cSemaphore);
+}
+
+/**
+ * I2C unlock task
+ * 
+ * Release the I2C bus if it is held by `task` (deleted while holding it).
+ */
+void i2cUnlockTask(TaskHandle_t task) {
+    if (task && i2cOwner == task) {
+        i2cUnlock();
+    }
+}
+
 /**
  * Scan I2C
  * 
@@ -60,9 +157,15 @@ void scanI2C() {
 
     // Iterate through valid slave addreses
     for (uint8_t address = 8; address < 120; address++) {
-        // Probe address and check return state
+        // Probe address and check return state, bus is locked per probe
+        if (!i2cLock()) {
+            multiPrintf("I2C bus busy.\n");
+            return;
+        }
         Wire.beginTransmission(address);
-        if (Wire.endTransmission() == I2C_ERROR_OK) {
+        uint8_t error = Wire.endTransmission();
+        i2cUnlock();
+        if (error == I2C_ERROR_OK) {
             // Device found, print address in HEX and DEC
             multiPrintf("0x%02x  %3u\n", address, address);
             found = true;
@@ -80,19 +183,31 @@ void scanI2C() {
  * Write I2C
  * 
  * Write data to I2C slave at specified 7-bit address.
+ * Returns Wire status, I2C_BUSY if the bus stayed locked.
  */
 uint8_t writeI2C(uint8_t address, uint8_t * data, size_t len) {
+    if (!i2cLock()) {
+        return I2C_BUSY;
+    }
     Wire.beginTransmission(address);
     Wire.write(data, len);
-    return Wire.endTransmission();
+    uint8_t error = Wire.endTransmission();
+    i2cUnlock();
+    return error;
 }
 
 /**
  * Read I2C
  * 
  * Request and read data from I2C slave at specified 7-bit address.
+ * Bytes not received (or all if the bus stayed locked) read as zero.
  */
 void readI2C(uint8_t address, uint8_t * data, size_t len) {
+    memset(data, 0, len);
+    if (!i2cLock()) {
+        return;
+    }
+
     // Request `len` amount of data
     Wire.requestFrom(address, len);
 
@@ -107,6 +222,117 @@ void readI2C(uint8_t address, uint8_t * data, size_t len) {
             i++;
         }
     }
+    i2cUnlock();
+}
+
+/**
+ * Output reserve
+ * 
+ * Reserve output ring record. In blocking mode, ATLAST waits for the
+ * websocket client to catch up instead of dropping output.
+ */
+static char * outputReserve(size_t * size) {
+    if (xTaskGetCurrentTaskHandle() != atlastTaskHandle) {
+        return outRingReserve(size);
+    }
+
+    char * record;
+    size_t wanted = *size;
+    // Client may disconnect (ring is discarded) or ATLAST may be killed
+    while (!(record = outRingTryReserve(size)) && outBlocking &&
+           wsConnected() && !atlastKilled()) {
+        wsNotifyOutput();
+        atlastSleep(OUT_BLOCK_WAIT_MS);
+        *size = wanted;
+    }
+    if (!record) {
+        record = outRingReserve(size);
+    }
+    outAtlastRecord.size = *size;
+    outAtlastRecord.data = record;
+    return record;
+}
+
+/**
+ * Output sink index
+ * 
+ * Return index of sink counters, -1 for invalid sink.
+ */
+static int outputSinkIndex(uint8_t sink) {
+    switch (sink) {
+        case OUT_SINK_SERIAL: return 0;
+        case OUT_SINK_WS: return 1;
+        case OUT_SINK_CAPTURE: return 2;
+        default: return -1;
+    }
+}
+
+/**
+ * Output count
+ * 
+ * Add to throughput counters of a sink.
+ */
+static void outputCount(uint8_t sink, size_t bytes, size_t dropped) {
+    int i = outputSinkIndex(sink);
+    portENTER_CRITICAL(&outStatsMux);
+    outStats[i].bytes += bytes;
+    outStats[i].dropped += dropped;
+    portEXIT_CRITICAL(&outStatsMux);
+}
+
+/**
+ * Output redirected
+ * 
+ * Return innermost redirection buffer if output of the calling task
+ * is redirected, NULL otherwise.
+ */
+static struct outRedirectBuf * outputRedirected() {
+    if (!outRedirect.depth || outRedirect.task != xTaskGetCurrentTaskHandle()) {
+        return NULL;
+    }
+    return &outRedirect.bufs[outRedirect.depth - 1];
+}
+
+/**
+ * Output emit
+ * 
+ * Pass text to enabled sinks and commit websocket record (if reserved),
+ * `length` is the text length before truncation.
+ */
+static void outputEmit(uint8_t sinks, const char * text, size_t len, size_t length,
+                       char * record, size_t size) {
+    // Copy to capture buffer if printed by the capturing task
+    if ((sinks & OUT_SINK_CAPTURE) &&
+        outCapture.task && outCapture.task == xTaskGetCurrentTaskHandle()) {
+        size_t space = outCapture.size - 1 - outCapture.len;
+        size_t n = len < space ? len : space;
+        memcpy(outCapture.buf + outCapture.len, text, n);
+        outCapture.len += n;
+        outCapture.buf[outCapture.len] = '\0';
+        if (n < length) {
+            outCapture.overflow = true;
+        }
+        outputCount(OUT_SINK_CAPTURE, n, length - n);
+    }
+
+    // Queue for serial transmission
+    if (sinks & OUT_SINK_SERIAL) {
+        size_t n = serialWrite(text, len);
+        outputCount(OUT_SINK_SERIAL, n, length - n);
+    }
+
+    // Pass record to websocket
+    if (record) {
+        size_t n = len < size ? len : size - 1;
+        if (record == outAtlastRecord.data) {
+            outAtlastRecord.data = NULL;
+        }
+        outRingCommit(record, size, n);
+        wsNotifyOutput();
+        outputCount(OUT_SINK_WS, n, length - n);
+    } else if (sinks & OUT_SINK_WS) {
+        outputCount(OUT_SINK_WS, 0, length);
+    }
 }
 
 /**
@@ -115,93 +341,326 @@ void readI2C(uint8_t address, uint8_t * data, size_t len) {
  * Print formatted data to multiple outputs.
  */
 int multiPrintf(char * format, ...){
-    char buffer[256];
-
-    // Format string
     va_list args;
     va_start(args, format);
-    int length = vsprintf(buffer, format, args);
-    va_end(args);
 
-    // Output serial
-    Serial.print(buffer);
+    // Redirected output is formatted straight into the buffer, nowhere else
+    struct outRedirectBuf * r = outputRedirected();
+    if (r) {
+        size_t space = r->size - r->len;
+        int length = vsnprintf(r->buf + r->len, space, format, args);
+        va_end(args);
+        if (length >= 0) {
+            size_t n = (size_t) length < space ? length : space - 1;
+            r->len += n;
+            outputCount(OUT_SINK_CAPTURE, n, length - n);
+        }
+        return length;
+    }
 
-    // Add string to outgoing websocket buffer
-    xSemaphoreTake(wsOutMutex, portMAX_DELAY);
-    wsOutString.append(buffer);
-    xSemaphoreGive(wsOutMutex);
+    // Measure formatted length, so that the ring reservation is exact
+    va_list measure;
+    va_copy(measure, args);
+    int length = vsnprintf(NULL, 0, format, measure);
+    va_end(measure);
+    if (length < 0) {
+        va_end(args);
+        return length;
+    }
 
+    // Format directly into websocket output ring,
+    // into local buffer if the ring is full or websocket sink is off
+    uint8_t sinks = outSinks;
+    size_t size = length + 1;
+    char * record = (sinks & OUT_SINK_WS) ? outputReserve(&size) : NULL;
+    char local[256];
+    char * text = record ? record : local;
+    if (!record) {
+        size = sizeof(local);
+    }
+    vsnprintf(text, size, format, args);
+    va_end(args);
+    size_t len = (size_t) length < size ? length : size - 1;
+
+    outputEmit(sinks, text, len, length, record, size);
     return length;
 }
 
 /**
- * Serial read line
+ * Multi write
  * 
- * Store chars from serial input into provided buffer.
- * Loops until newline is read or when size limit is met.
- * Returns true if a complete line has been read, false otherwise.
- * WARNING: Discards the rest of incoming UART buffer!
+ * Write unformatted text to multiple outputs.
  */
-bool serialReadLine(char * buf, size_t limit) {
-    // Length of incomplete line stored in buffer
-    size_t len = 0;
+int multiWrite(const char * text, size_t len) {
+    struct outRedirectBuf * r = outputRedirected();
+    if (r) {
+        size_t n = min(len, r->size - 1 - r->len);
+        memcpy(r->buf + r->len, text, n);
+        r->len += n;
+        r->buf[r->len] = '\0';
+        outputCount(OUT_SINK_CAPTURE, n, len - n);
+        return len;
+    }
 
-    while (len < limit) {
-        // Wait for input
-        while (!Serial.available()) {
-            delay(50);
-        }
+    // Copy into websocket output ring, other sinks take the text as is
+    uint8_t sinks = outSinks;
+    size_t size = len + 1;
+    char * record = (sinks & OUT_SINK_WS) ? outputReserve(&size) : NULL;
+    if (record) {
+        memcpy(record, text, len < size ? len : size - 1);
+    }
 
-        // Read byte
-        char newByte = (char) Serial.read();
+    outputEmit(sinks, text, len, len, record, size);
+    return len;
+}
 
-        // Add byte to buffer, terminate on newline
-        if (newByte != '\n' && newByte != '\r') {
-            buf[len] = newByte;
-        } else {
-            buf[len] = '\0';
-            // Dump unread bytes
-            while (Serial.available()) {
-                Serial.read();
+/**
+ * Output task deleted
+ * 
+ * Release output state held by the ATLAST task deleted on restart.
+ * Its unfinished ring record is committed empty, so that the websocket
+ * output behind it is not held up forever. Its redirection and capture
+ * end, the new task might get the same handle. A serial writer lock it
+ * held is released.
+ */
+void outputTaskDeleted(TaskHandle_t task) {
+    if (outAtlastRecord.data) {
+        outRingCommit(outAtlastRecord.data, outAtlastRecord.size, 0);
+        outAtlastRecord.data = NULL;
+    }
+    serialUnlockTask(task);
+    outputRedirectReset();
+    outCapture.task = NULL;
+}
+
+/**
+ * Output blocking
+ * 
+ * Enable or disable blocking ATLAST while websocket output ring is full.
+ */
+void outputSetBlocking(bool blocking) {
+    outBlocking = blocking;
+}
+
+/**
+ * Output blocking mode
+ * 
+ * Return true if ATLAST waits for the websocket client on full output ring.
+ */
+bool outputBlocking() {
+    return outBlocking;
+}
+
+/**
+ * Output set sinks
+ * 
+ * Select outputs (OUT_SINK_* mask) that receive printed data.
+ */
+void outputSetSinks(uint8_t sinks) {
+    outSinks = sinks & OUT_SINK_ALL;
+}
+
+/**
+ * Output sinks
+ * 
+ * Return mask of enabled outputs.
+ */
+uint8_t outputSinks() {
+    return outSinks;
+}
+
+/**
+ * Output sink stats
+ * 
+ * Get bytes passed to a sink and bytes it dropped (no space, truncated).
+ * Returns false on invalid sink.
+ */
+bool outputSinkStats(uint8_t sink, uint32_t * bytes, uint32_t * dropped) {
+    int i = outputSinkIndex(sink);
+    if (i < 0) {
+        return false;
+    }
+    portENTER_CRITICAL(&outStatsMux);
+    *bytes = outStats[i].bytes;
+    *dropped = outStats[i].dropped;
+    portEXIT_CRITICAL(&outStatsMux);
+    return true;
+}
+
+/**
+ * Output configure
+ * 
+ * Apply "serial" and "output" settings from config.json.
+ */
+void outputConfigure() {
+    File confFile = storage.open("/cfg/config.json");
+    if (!confFile) {
+        return;
+    }
+
+    // Deserialize only the relevant part of configuration
+    StaticJsonDocument<64> filter;
+    filter["serial"] = true;
+    filter["output"] = true;
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, confFile,
+                                                 DeserializationOption::Filter(filter));
+    confFile.close();
+    if (error) {
+        return;
+    }
+
+    // Switch baud rate, let the last message at the old rate get out first
+    unsigned long baud = doc["serial"]["baud"] | 0UL;
+    if (baud && baud != SERIAL_BAUD) {
+        multiPrintf("Switching UART to %lu baud\n", baud);
+        serialSetBaud(baud);
+    }
+
+    // Output sinks by name, e.g. ["serial", "websocket"]
+    JsonArray sinks = doc["output"]["sinks"];
+    if (!sinks.isNull()) {
+        uint8_t mask = 0;
+        for (JsonVariant sink : sinks) {
+            const char * name = sink.as<const char *>();
+            if (!name) {
+                continue;
+            }
+            if (!strcmp(name, "serial")) {
+                mask |= OUT_SINK_SERIAL;
+            } else if (!strcmp(name, "websocket")) {
+                mask |= OUT_SINK_WS;
+            } else if (!strcmp(name, "capture")) {
+                mask |= OUT_SINK_CAPTURE;
             }
-            return true;
         }
+        outputSetSinks(mask);
+    }
+}
 
-        len++;
+/**
+ * Output capture start
+ * 
+ * Copy output of the calling task into provided buffer (null-terminated).
+ * Output exceeding the buffer is not captured.
+ */
+void outputCaptureStart(char * buf, size_t size) {
+    outCapture.buf = buf;
+    outCapture.size = size;
+    outCapture.len = 0;
+    outCapture.overflow = false;
+    buf[0] = '\0';
+    outCapture.task = xTaskGetCurrentTaskHandle();
+}
+
+/**
+ * Output capture stop
+ * 
+ * Stop copying output into capture buffer.
+ * Returns the number of bytes captured, `overflow` is set if some
+ * output did not fit.
+ */
+size_t outputCaptureStop(bool * overflow) {
+    outCapture.task = NULL;
+    *overflow = outCapture.overflow;
+    return outCapture.len;
+}
+
+/**
+ * Output redirect start
+ * 
+ * Redirect output of the calling task into buffer.
+ */
+bool outputRedirectStart(char * buf, size_t size) {
+    if (size < 1 || outRedirect.depth >= OUT_REDIRECT_NEST ||
+        (outRedirect.depth && outRedirect.task != xTaskGetCurrentTaskHandle())) {
+        return false;
+    }
+    buf[0] = '\0';
+    outRedirect.bufs[outRedirect.depth] = {buf, size, 0};
+    outRedirect.task = xTaskGetCurrentTaskHandle();
+    outRedirect.depth++;
+    return true;
+}
+
+/**
+ * Output redirect stop
+ * 
+ * End innermost redirection, output goes where it went before.
+ */
+bool outputRedirectStop(char ** buf, size_t * len) {
+    if (!outputRedirected()) {
+        return false;
     }
+    outRedirect.depth--;
+    *buf = outRedirect.bufs[outRedirect.depth].buf;
+    *len = outRedirect.bufs[outRedirect.depth].len;
+    return true;
+}
 
-    // Buffer size limit reached, dump unread bytes
-    while (Serial.available()) {
-        Serial.read();
+/**
+ * Output redirect reset
+ * 
+ * End all redirections (errors, start and end of command, restart).
+ * Only the ATLAST task redirects output.
+ */
+void outputRedirectReset() {
+    outRedirect.depth = 0;
+    outRedirect.task = NULL;
+}
+
+/**
+ * Serial read line
+ * 
+ * Store a line of serial input into provided buffer.
+ * Blocks until newline is read.
+ * Returns true if a complete line has been read, false if it exceeded
+ * the size limit (the rest of such line is discarded).
+ */
+bool serialReadLine(char * buf, size_t limit) {
+    bool more;
+    serialReadPiece(buf, limit, &more);
+    if (!more) {
+        return true;
+    }
+
+    // Skip the rest of overlong line, input that follows is kept
+    while (more) {
+        serialReadPiece(buf, limit, &more);
     }
     return false;
 }
 
+/**
+ * Print file entry
+ * 
+ * Print indexed file path and size in CLI.
+ */
+static bool printFileEntry(const struct fileEntry * entry, void * arg) {
+    multiPrintf("%-31s %u\n", entry->path, entry->size);
+    return true;
+}
+
 /**
  * Print file list
  * 
- * List all files in CLI.
+ * List all files with sizes in CLI.
  */
 void printFileList() {
-    File root = SPIFFS.open("/");
-    File file = root.openNextFile();
- 
-    while(file) {
-        multiPrintf("%s\n", file.name());
-        file = root.openNextFile();
-    }
+    fileIndexEach(printFileEntry, NULL);
 }
 
 /**
  * Incoming text
  * 
  * Handle input string from serial or websocket (evaluate ATLAST).
- * Maximum input length is 256.
+ * Commands longer than ATL_CMD_LEN go to the heap rather than the slot.
+ * Waits up to `wait` ticks for queue space.
  */
-void incomingText(char * inputData) {
+void incomingText(char * inputData, TickType_t wait) {
     // Pass command to ATLAST interpreter (ignore empty string)
     if (inputData[0]) {
-        atlastCommand(inputData);
+        atlastCommand(inputData, wait);
     }
 }
 
@@ -223,60 +682,363 @@ bool removeFile(const char * path) {
     }
 
     // Remove existing file
-    if (SPIFFS.exists(path)) {
-        SPIFFS.remove(path);
+    if (storage.exists(path)) {
+        storage.remove(path);
+        fileIndexUpdate(path);
     }
     return true;
 }
 
+/**
+ * Upload done
+ * 
+ * Print result of finished upload (called by the flash writer).
+ */
+static void uploadDone(uint8_t status) {
+    if (status == WSB_OK) {
+        multiPrintf("Upload finished: \"%s\"\n", uploadPath());
+    } else if (status == WSB_CORRUPT) {
+        multiPrintf("Upload error: \"%s\" failed CRC check, removed.\n", uploadPath());
+    } else {
+        multiPrintf("Upload error: \"%s\" not saved entirely!\n", uploadPath());
+    }
+}
+
+/**
+ * Upload done JSON / binary
+ * 
+ * Report finished upload with throughput to the uploading client.
+ */
+static void uploadDoneJson(uint8_t status, uint32_t bytes, uint32_t ms,
+                           uint32_t client, uint32_t id) {
+    uploadDone(status);
+    wsSendAckTo(client, "uploaded",
+                status == WSB_OK ? "ok" : status == WSB_CORRUPT ? "corrupt" : "failed",
+                uploadPath(), bytes, ms);
+}
+
+static void uploadDoneBinary(uint8_t status, uint32_t bytes, uint32_t ms,
+                             uint32_t client, uint32_t id) {
+    uploadDone(status);
+    uint32_t stats[2] = {bytes, ms};
+    wsSendAckBinaryTo(client, WSB_UPLOAD_DATA, id, status, uploadPath(), stats, sizeof(stats));
+}
+
 /**
  * Incoming data
  * 
- * Save received part of file from websocket in SPIFFS.
- * Incoming file is stored under 'uploadPath'.
+ * Pass received part of raw file upload (after JSON request) to the writer.
  */
 void incomingData(void * arg, uint8_t * data, size_t dataLen) {
-    // Parse arguments
-    // (won't compile with `#include <ESPAsyncWebServer.h>` in header file)
+    // Data follows where the previous part ended
+    if (!uploadWrite(uploadReceived, data, dataLen)) {
+        wsSendAck("uploaded", "failed", uploadPath());
+        return;
+    }
+    uploadReceived += dataLen;
+
+    if (uploadComplete()) {
+        uploadFinish(uploadDoneJson, wsClientId(), 0);
+    }
+}
+
+/**
+ * Incoming binary CLI
+ * 
+ * Handle binary CLI message, ID other than 0 requests a result message.
+ */
+static void incomingBinaryCli(uint32_t id, char * text, size_t len) {
+    if (!id) {
+        incomingText(text);
+    } else if (text[0]) {
+        atlastCommandId(text, id, false);
+    } else {
+        wsSendResult(wsClientId(), id, ATL_SNORM, "", 0, -1, 0, false);
+    }
+}
+
+/**
+ * Incoming binary upload
+ * 
+ * Handle binary upload request: [size, uint32] [CRC-32, uint32] [path].
+ * Acknowledged with the offset to send data from (resumed upload).
+ * File data follows in WSB_UPLOAD_DATA messages.
+ */
+static void incomingBinaryUpload(uint32_t id, char * payload, size_t len) {
+    uint32_t fileSize, crc, offset = 0;
+    if (len < sizeof(fileSize) + sizeof(crc)) {
+        return;
+    }
+    memcpy(&fileSize, payload, sizeof(fileSize));
+    memcpy(&crc, payload + sizeof(fileSize), sizeof(crc));
+    const char * filePath = payload + sizeof(fileSize) + sizeof(crc);
+
+    // Compare file size with available space in storage
+    // 4096 = SPI flash block size
+    size_t totalBytes, usedBytes;
+    storageInfo(&totalBytes, &usedBytes);
+    size_t freeStorage = totalBytes > usedBytes + 4096 ? totalBytes - usedBytes - 4096 : 0;
+    // Resumed upload needs room for the rest only
+    if (fileSize - uploadResumeOffset(filePath, fileSize, crc) > freeStorage) {
+        wsSendAckBinary(WSB_UPLOAD, id, WSB_TOO_LARGE, filePath);
+        return;
+    }
+
+    uint8_t status = uploadBegin(filePath, fileSize, crc, true, true, &offset);
+    wsSendAckBinary(WSB_UPLOAD, id, status, filePath, &offset, sizeof(offset));
+    if (status != WSB_OK) {
+        return;
+    }
+    uploadClient = wsClientId();
+    if (offset) {
+        multiPrintf("Upload resumed: \"%s\" at %u...\n", filePath, offset);
+    } else {
+        multiPrintf("Upload pending: \"%s\"...\n", filePath);
+    }
+
+    // Empty (or completely written) file needs no data
+    if (uploadComplete()) {
+        uploadFinish(uploadDoneBinary, wsClientId(), id);
+    }
+}
+
+/**
+ * Incoming binary upload data
+ * 
+ * Pass part of binary upload data message to the writer,
+ * acknowledge with throughput once the file is complete.
+ */
+static void incomingBinaryUploadData(uint32_t id, uint32_t offset, uint8_t * data, size_t len) {
+    if (!uploadWrite(offset, data, len)) {
+        wsSendAckBinary(WSB_UPLOAD_DATA, id, WSB_FAILED, uploadPath());
+        return;
+    }
+
+    if (uploadComplete()) {
+        uploadFinish(uploadDoneBinary, wsClientId(), id);
+    }
+}
+
+/**
+ * Incoming run part
+ * 
+ * Pass part of run message source to the interpreter.
+ */
+static void incomingRunPart(const char * data, size_t len, bool complete) {
+    if (runIncoming == RUN_STREAM && len) {
+        atlastRunWrite(data, len);
+    }
+    if (complete) {
+        if (runIncoming == RUN_STREAM) {
+            atlastRunEnd(true);
+        }
+        runIncoming = RUN_NONE;
+    }
+}
+
+/**
+ * Incoming text run
+ * 
+ * Handle part of text run message: header line {"type":"run"[,"id":ID]}
+ * followed by source, possibly in multiple frames.
+ * Returns false if the text is not a run message.
+ */
+bool incomingTextRun(void * arg, uint8_t * data, size_t dataLen) {
     AwsFrameInfo * info = (AwsFrameInfo*) arg;
+    bool complete = info->final && info->index + dataLen == info->len;
+
+    if (info->num == 0 && info->index == 0) {
+        // Other JSON messages pass
+        if (dataLen < strlen(RUN_PREFIX) ||
+            strncmp((char *) data, RUN_PREFIX, strlen(RUN_PREFIX))) {
+            return false;
+        }
+
+        // Header line must arrive in the first part
+        uint8_t * source = (uint8_t *) memchr(data, '\n', dataLen);
+        StaticJsonDocument<STATIC_JSON_SIZE> doc;
+        if (!source || deserializeJson(doc, (char *) data, source - data)) {
+            multiPrintf("DISCARDED INPUT: Invalid run message header.\n");
+            runIncoming = RUN_DROP;
+        } else {
+            runIncoming = atlastRunBegin(doc["id"].as<uint32_t>(), doc.containsKey("id")) ? RUN_STREAM : RUN_DROP;
+            runClient = wsClientId();
+            source++;
+            dataLen -= source - data;
+            data = source;
+        }
+    } else if (runIncoming == RUN_NONE) {
+        return false;
+    }
+
+    incomingRunPart((char *) data, dataLen, complete);
+    return true;
+}
+
+/**
+ * Incoming disconnect
+ * 
+ * Abandon messages interrupted by disconnection of client.
+ */
+void incomingDisconnect(uint32_t client) {
+    // Only the controller sends messages in multiple parts
+    if (runIncoming != RUN_NONE && runClient == client) {
+        if (runIncoming == RUN_STREAM) {
+            atlastRunEnd(false);
+        }
+        runIncoming = RUN_NONE;
+        binIn.opcode = 0;
+    }
+
+    // Keep interrupted upload for resuming
+    if (uploadClient == client) {
+        uploadSuspend();
+        uploadClient = 0;
+    }
+}
 
-    // If this is the start of a frame
-    if (info->index == 0) {
-        // Notify of the start of a frame
-        multiPrintf("Upload pending: frame %u of \"%s\"...\n",
-            info->num, uploadPath);
-
-        // If this is the very first frame (see AwsFrameInfo.opcode)
-        if (info->opcode == WS_BINARY) {
-            // For safety, try closing potentially open file
-            uploadFileHandle.close();
-            // Remove old file if it exists, return if it's protected
-            if(!removeFile(uploadPath)) {
-                // Invalidate uploadPath
-                uploadPath[1] = '\0';
+/**
+ * Incoming binary reserve
+ * 
+ * Make room for `len` more payload bytes and terminator. Commands are not
+ * limited by WSB_MESSAGE_MAX, their buffer grows on heap.
+ * Returns false if there is no room.
+ */
+static bool incomingBinaryReserve(size_t len) {
+    size_t size = binIn.len + len + 1;
+    if (size <= binIn.size) {
+        return true;
+    }
+    if (binIn.opcode != WSB_CLI) {
+        return false;
+    }
+
+    // Grow at least twice to keep copying linear
+    size = max(size, 2 * binIn.size);
+    char * data = (char *) malloc(size);
+    if (!data) {
+        return false;
+    }
+    memcpy(data, binIn.data, binIn.len);
+    if (binIn.data != binIn.buf) {
+        free(binIn.data);
+    }
+    binIn.data = data;
+    binIn.size = size;
+    return true;
+}
+
+/**
+ * Incoming binary release
+ * 
+ * Free heap payload buffer of the last message.
+ */
+static void incomingBinaryRelease() {
+    if (binIn.data != binIn.buf) {
+        free(binIn.data);
+    }
+    binIn.data = binIn.buf;
+    binIn.size = sizeof(binIn.buf);
+}
+
+/**
+ * Incoming binary
+ * 
+ * Handle part of binary protocol message: [opcode] [request ID] [payload].
+ * Upload data is written as it arrives, other payloads are buffered
+ * until the message is complete.
+ */
+void incomingBinary(void * arg, uint8_t * data, size_t dataLen) {
+    AwsFrameInfo * info = (AwsFrameInfo*) arg;
+    bool complete = info->final && info->index + dataLen == info->len;
+
+    // Header is at the start of the first frame
+    if (info->num == 0 && info->index == 0) {
+        if (dataLen < WSB_HEADER) {
+            multiPrintf("DISCARDED INPUT: Binary message too short.\n");
+            binIn.opcode = 0;
+            return;
+        }
+        binIn.opcode = data[0];
+        memcpy(&binIn.id, data + 1, sizeof(binIn.id));
+        binIn.len = 0;
+        binIn.overflow = false;
+        incomingBinaryRelease();
+        data += WSB_HEADER;
+        dataLen -= WSB_HEADER;
+    }
+
+    // Upload data: [offset, uint32] [file data], written as it arrives
+    if (binIn.opcode == WSB_UPLOAD_DATA) {
+        if (info->num == 0 && info->index == 0) {
+            if (dataLen < sizeof(binIn.offset)) {
+                multiPrintf("DISCARDED INPUT: Upload data without offset.\n");
+                binIn.opcode = 0;
                 return;
             }
-            // Open file for writing
-            uploadFileHandle = SPIFFS.open(uploadPath, FILE_WRITE);
-            if (!uploadFileHandle) { 
-                multiPrintf("Upload error: "
-                    "failed to open file \"%s\" for writing.\n", uploadPath);
-                return; 
-            }
+            memcpy(&binIn.offset, data, sizeof(binIn.offset));
+            data += sizeof(binIn.offset);
+            dataLen -= sizeof(binIn.offset);
+        }
+        if (dataLen) {
+            incomingBinaryUploadData(binIn.id, binIn.offset, data, dataLen);
+            binIn.offset += dataLen;
         }
+        return;
     }
 
-    // Write data to open file and check the length written
-    if (uploadFileHandle.write(data, dataLen) != dataLen) {
-        // Notify of discrepancy
-        multiPrintf("Upload error: \"%s\" not saved entirely!\n", uploadPath);
+    if (binIn.opcode == WSB_RUN) {
+        if (info->num == 0 && info->index == 0) {
+            runIncoming = atlastRunBegin(binIn.id, binIn.id != 0) ? RUN_STREAM : RUN_DROP;
+            runClient = wsClientId();
+        }
+        incomingRunPart((char *) data, dataLen, complete);
+        return;
     }
-    
-    // If this was the last part of the last frame, close file
-    if (info->final && info->index + dataLen == info->len) {
-        uploadFileHandle.close();
-        multiPrintf("Upload finished: \"%s\"\n", uploadPath);
+
+    // Buffer payload
+    if (binIn.overflow || !incomingBinaryReserve(dataLen)) {
+        binIn.overflow = true;
+    } else {
+        memcpy(binIn.data + binIn.len, data, dataLen);
+        binIn.len += dataLen;
+    }
+    if (!complete) {
+        return;
+    }
+    binIn.data[binIn.len] = '\0';
+    if (binIn.overflow) {
+        multiPrintf("DISCARDED INPUT: Binary message too long.\n");
+        if (binIn.opcode == WSB_CLI && binIn.id) {
+            wsSendResult(wsClientId(), binIn.id, ATL_CMD_REJECTED, "", 0, -1, 0, false);
+        }
+        incomingBinaryRelease();
+        return;
+    }
+
+    // Decide message type
+    switch (binIn.opcode) {
+        case WSB_CLI:
+            incomingBinaryCli(binIn.id, binIn.data, binIn.len);
+            break;
+        case WSB_FILE_LIST:
+            wsSendFileList(binIn.id);
+            break;
+        case WSB_UPLOAD:
+            incomingBinaryUpload(binIn.id, binIn.data, binIn.len);
+            break;
+        case WSB_DELETE:
+            wsSendAckBinary(WSB_DELETE, binIn.id,
+                removeFile(binIn.data) ? WSB_OK : WSB_PROTECTED, binIn.data);
+            break;
+        case WSB_KILL:
+            atlastKill(binIn.len && binIn.data[0]);
+            break;
+        default:
+            multiPrintf("DISCARDED INPUT: Unknown binary opcode %u.\n", binIn.opcode);
+            break;
     }
+    incomingBinaryRelease();
 }
 
 /**
@@ -285,8 +1047,23 @@ void incomingData(void * arg, uint8_t * data, size_t dataLen) {
  * Handle incoming CLI input.
  */
 void incomingJsonCli(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
-    std::string data = doc["data"];
-    incomingText(&data[0]);
+    // Command text stays in the input buffer (no copy)
+    char * data = (char *) (doc["data"] | "");
+
+    // Commands without ID are handled as plain text
+    if (!doc.containsKey("id")) {
+        incomingText(data);
+        return;
+    }
+
+    // Pass command with ID to ATLAST interpreter (ignore empty string)
+    uint32_t id = doc["id"];
+    bool quiet = doc["quiet"] | false;
+    if (data[0]) {
+        atlastCommandId(data, id, quiet);
+    } else {
+        wsSendResult(wsClientId(), id, ATL_SNORM, "", 0, -1, 0, false);
+    }
 }
 
 /**
@@ -305,27 +1082,42 @@ void incomingJsonFileList(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
  * Handle incoming file upload request.
  */
 void incomingJsonUpload(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
-    // Compare file size with available space in SPIFFS
+    // Compare file size with available space in storage
     size_t fileSize = doc["size"];
     // 4096 = SPI flash block size
-    size_t freeStorage = SPIFFS.totalBytes() - SPIFFS.usedBytes() - 4096;
+    size_t totalBytes, usedBytes;
+    storageInfo(&totalBytes, &usedBytes);
+    size_t freeStorage = totalBytes > usedBytes + 4096 ? totalBytes - usedBytes - 4096 : 0;
     if (fileSize > freeStorage) {
         wsSendAck("upload", "tooLarge", "");
         return;
     }
 
-    // Get file path
-    const char * filePath = (const char*) doc["name"];
-    // Check file path length (SPIFFS limits to 31)
-    if (sizeof(filePath) > 31) {
-        multiPrintf("TRUNCATED FILEPATH: \"%s\" was longer than 31 characters", filePath);
+    // Get file path, reject path too long for storage (31 characters)
+    const char * filePath = doc["name"] | "";
+    if (strlen(filePath) >= UPLOAD_PATH_LEN) {
+        multiPrintf("Upload error: \"%s\" is longer than %u characters\n",
+                    filePath, UPLOAD_PATH_LEN - 1);
+        wsSendAck("upload", "failed", filePath);
+        return;
+    }
+
+    // Open file now, raw data frames only append (CRC-32 is optional)
+    uint32_t offset;
+    uint8_t status = uploadBegin(filePath, fileSize, doc["crc"] | 0,
+                                 doc.containsKey("crc"), false, &offset);
+    if (status != WSB_OK) {
+        wsSendAck("upload", status == WSB_PROTECTED ? "protected" : "failed", filePath);
+        return;
     }
-    // Update global path variable
-    strncpy(uploadPath, filePath, 31);
+    uploadClient = wsClientId();
+    uploadReceived = 0;
 
-    // Send approval of download
-    wsSendAck("upload", "ready", uploadPath);
-    //multiPrintf("DEBUG: Ready to receive file: %s\n", uploadPath);
+    // Send approval of upload
+    wsSendAck("upload", "ready", filePath);
+    if (uploadComplete()) {
+        uploadFinish(uploadDoneJson, wsClientId(), 0);
+    }
 }
 
 /**
@@ -359,13 +1151,70 @@ void incomingJsonKill(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
     atlastKill(restartTask);
 }
 
+/**
+ * Incoming JSON binary
+ * 
+ * Handle binary protocol negotiation, enabled unless "enable" is false.
+ */
+void incomingJsonBinary(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
+    bool binary = doc["enable"] | true;
+    wsSetBinary(binary);
+    wsSendAck("binary", binary ? "ok" : "off", "");
+}
+
+/**
+ * Incoming JSON role
+ * 
+ * Handle client role request ("controller" takes over control).
+ */
+void incomingJsonRole(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
+    wsRequestRole(doc["role"] == "controller");
+}
+
+/**
+ * Incoming JSON clients
+ * 
+ * Handle connected clients statistics request.
+ */
+void incomingJsonClients(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
+    wsSendClients();
+}
+
+/**
+ * Incoming JSON scan stats
+ * 
+ * Handle incoming scan cycle statistics request.
+ */
+void incomingJsonScanStats(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
+    wsSendScanStats();
+}
+
+/**
+ * Incoming JSON watch
+ * 
+ * Handle variable watch subscription: space-separated names sampled every
+ * "interval" ms, changed values are pushed. No names unsubscribes.
+ * Subscription is acknowledged once the interpreter has looked up the names.
+ */
+void incomingJsonWatch(StaticJsonDocument<STATIC_JSON_SIZE> & doc) {
+    const char * names = doc["names"] | "";
+    uint32_t interval = doc["interval"] | 100;
+
+    if (!names[0]) {
+        watchRemove(wsClientId());
+        wsSendAck("watch", "ok", "");
+    } else if (!watchSubscribe(wsClientId(), names, interval, wsIsBinary())) {
+        wsSendAck("watch", "failed", "");
+    }
+}
+
 /**
  * Incoming JSON
  * 
- * Parse and handle incoming JSON document.
+ * Parse and handle incoming JSON document (in place, strings point into input).
  * Maximum input length is 256.
  */
-void incomingJson(const char* inputData) {
+void incomingJson(char* inputData) {
     // Deserialize received JSON document
     StaticJsonDocument<STATIC_JSON_SIZE> doc;
     DeserializationError err = deserializeJson(doc, inputData);
@@ -374,6 +1223,14 @@ void incomingJson(const char* inputData) {
         return;
     }
 
+    // Observers may only query
+    if (!wsIsController() && doc["type"] != "fileList" && doc["type"] != "binary" &&
+        doc["type"] != "role" && doc["type"] != "clients" && doc["type"] != "scanStats" &&
+        doc["type"] != "watch") {
+        wsSendAck("role", "observer", "");
+        return;
+    }
+
     // Decide message type
     if (doc["type"] == "cli") {
         incomingJsonCli(doc);
@@ -385,5 +1242,15 @@ void incomingJson(const char* inputData) {
         incomingJsonDelete(doc);
     } else if (doc["type"] == "kill") {
         incomingJsonKill(doc);
+    } else if (doc["type"] == "scanStats") {
+        incomingJsonScanStats(doc);
+    } else if (doc["type"] == "binary") {
+        incomingJsonBinary(doc);
+    } else if (doc["type"] == "role") {
+        incomingJsonRole(doc);
+    } else if (doc["type"] == "clients") {
+        incomingJsonClients(doc);
+    } else if (doc["type"] == "watch") {
+        incomingJsonWatch(doc);
     }
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "atlast-task.h"
+#include "jobs.h"
+
+#define JOB_WAIT_SLICE_MS 100   // Longest wait between job state checks
+
+
+// Job slot
+struct job {
+    jobKernel kernel;
+    long args[JOB_ARGS];
+    long result;
+    volatile int state;
+    volatile TaskHandle_t waiter;   // Task to notify on completion
+    bool abandoned;     // Release slot on completion (waiter was killed)
+};
+
+// Job slots and queue of submitted slot indices
+struct job jobSlots[JOB_SLOTS];
+QueueHandle_t jobQueue = xQueueCreate(JOB_SLOTS, sizeof(uint8_t));
+// Protects slot state transitions
+portMUX_TYPE jobMux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * Job worker loop
+ * 
+ * Run submitted kernels one by one.
+ * Run in its own task.
+ */
+static void jobWorkerLoop(void * pvParameter) {
+    uint8_t slot;
+
+    while (true) {
+        // Sleep until a job is submitted
+        xQueueReceive(jobQueue, &slot, portMAX_DELAY);
+        struct job * j = &jobSlots[slot];
+
+        // Run kernel
+        j->state = JOB_RUNNING;
+        j->result = j->kernel(j->args);
+
+        // Finish job, nobody will collect an abandoned one
+        TaskHandle_t waiter;
+        portENTER_CRITICAL(&jobMux);
+        j->state = j->abandoned ? JOB_FREE : JOB_DONE;
+        waiter = j->abandoned ? NULL : j->waiter;
+        portEXIT_CRITICAL(&jobMux);
+
+        // Wake up waiting task once it can see the job done, otherwise it
+        // would sleep out a whole wait slice. A notification arriving after
+        // the waiter left is stray, ATLAST sleep ignores those.
+        if (waiter) {
+            xTaskNotifyGive(waiter);
+        }
+    }
+}
+
+/**
+ * Jobs init
+ * 
+ * Create job worker task pinned to the core not running ATLAST.
+ */
+void jobsInit() {
+    // Idle priority: shares its core with the idle task and does not
+    // starve the network stack or trigger the task watchdog
+    xTaskCreatePinnedToCore(&jobWorkerLoop,
+                            JOB_TASK_NAME,
+                            4096,   // Stack size
+                            NULL,
+                            tskIDLE_PRIORITY,   // Priority
+                            NULL,
+                            1 - ATL_CORE);  // The other core
+}
+
+/**
+ * Job submit
+ * 
+ * Queue kernel with up to JOB_ARGS arguments for execution by the worker.
+ * Buffers passed in arguments must stay valid until the job is done.
+ * Returns job handle, or 0 if all job slots are taken.
+ */
+int jobSubmit(jobKernel kernel, long * args, int argc) {
+    if (argc > JOB_ARGS) {
+        return 0;
+    }
+
+    // Find and claim free slot
+    int slot = -1;
+    portENTER_CRITICAL(&jobMux);
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        if (jobSlots[i].state == JOB_FREE) {
+            jobSlots[i].state = JOB_QUEUED;
+            slot = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&jobMux);
+    if (slot < 0) {
+        return 0;
+    }
+
+    // Fill slot and pass it to the worker
+    struct job * j = &jobSlots[slot];
+    j->kernel = kernel;
+    memcpy(j->args, args, argc * sizeof(long));
+    j->waiter = NULL;
+    j->abandoned = false;
+    uint8_t index = slot;
+    xQueueSend(jobQueue, &index, portMAX_DELAY);
+
+    // Handle 0 is reserved for failure
+    return slot + 1;
+}
+
+/**
+ * Job status
+ * 
+ * Returns state of the job with handle (JOB_FREE if handle is invalid).
+ */
+int jobStatus(int handle) {
+    if (handle < 1 || handle > JOB_SLOTS) {
+        return JOB_FREE;
+    }
+    return jobSlots[handle - 1].state;
+}
+
+/**
+ * Job wait
+ * 
+ * Block until job is done, store its result and release the handle.
+ * Returns false if the handle is invalid or ATLAST was killed meanwhile.
+ */
+bool jobWait(int handle, long * result) {
+    if (jobStatus(handle) == JOB_FREE) {
+        return false;
+    }
+    struct job * j = &jobSlots[handle - 1];
+
+    // Register for completion notification and wait
+    j->waiter = xTaskGetCurrentTaskHandle();
+    while (j->state != JOB_DONE) {
+        // atlastKill() notifies as well, give up on kill
+        if (atlastKilled()) {
+            portENTER_CRITICAL(&jobMux);
+            j->waiter = NULL;
+            if (j->state == JOB_DONE) {
+                j->state = JOB_FREE;
+            } else {
+                j->abandoned = true;
+            }
+            portEXIT_CRITICAL(&jobMux);
+            return false;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOB_WAIT_SLICE_MS));
+    }
+
+    // Worker notification is usually pending, do not let it wake a later sleep
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    // Collect result and release slot
+    *result = j->result;
+    j->waiter = NULL;
+    j->state = JOB_FREE;
+    return true;
+}
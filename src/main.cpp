@@ -16,11 +16,13 @@
  */
 
 #include <Arduino.h>
-#include <SPIFFS.h>
 #include <Wire.h>
 
 #include "atlast-task.h"
+#include "fileindex.h"
 #include "io.h"
+#include "serial-io.h"
+#include "storage.h"
 #include "webserver.h"
 #include "wlan.h"
 
@@ -28,22 +30,23 @@
 #define MY_SCL 18
 
 
-// A buffer to hold incoming data
-char inputString[256];
-
-
 void setup() {
-    // Initialize UART
-    Serial.begin(115200);
+    // Initialize UART (this task then reads serial input in loop)
+    serialBegin();
 
     // Initialize I2C
     Wire.begin(MY_SDA, MY_SCL);
 
-    // Initialize SPIFFS filesystem
-    if(!SPIFFS.begin()) {
-        Serial.println("An Error has occurred while mounting SPIFFS");
+    // Initialize filesystem (SPIFFS or LittleFS, see storage.h)
+    if(!storageBegin()) {
+        Serial.println("An Error has occurred while mounting " STORAGE_NAME);
         abort();
     }
+    // Index files once, kept up to date by writers
+    fileIndexBuild();
+
+    // Apply UART and output settings from config.json
+    outputConfigure();
 
     // Connect to access point
     if (connectWlan()) {
@@ -56,9 +59,6 @@ void setup() {
 }
 
 void loop() {
-    // Read UART input
-    if(Serial.available() && serialReadLine(inputString, 256)) {
-        // Once a whole line is read, handle received data
-        incomingText(inputString);
-    }
+    // Pass UART input to interpreter line by line
+    serialPoll();
 }
\ No newline at end of file
@@ -0,0 +1,699 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numfmt.h"
+
+#define FMT_BIG_WORDS 90    // Base 1e9 words of exact expansion (~800 digits)
+#define FMT_BIG_BASE 1000000000
+#define FMT_SHORTEST_MAX 17 // Significant digits that always read back exactly
+#define FMT_UNIQUE_MAX 15   // Significant digits that always survive a round trip
+#define FMT_POWER_MIN -348  // Decimal exponent of the first cached power
+#define FMT_POWER_STEP 8    // Decimal exponent step of cached powers
+
+
+// Significant digits of a positive real, the first digit has weight 10^exp
+struct fmtDecimal {
+    char d[FMT_DIGITS];
+    int n;          // Digits in d, 0 for zero
+    int exp;
+    bool sticky;    // Nonzero digits beyond d
+};
+
+// Binary floating point number f * 2^e with 64-bit significand
+struct fmtFp {
+    uint64_t f;
+    int e;
+};
+
+static const char fmtDigitChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static const uint32_t fmtPow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Powers of ten 10^k for k = -348, -340 .. 340, significands rounded
+// to 64 bits with the top bit set
+static const struct fmtFp fmtPowers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193},
+    {0x8b16fb203055ac76ULL, -1166}, {0xcf42894a5dce35eaULL, -1140},
+    {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034},
+    {0xbe5691ef416bd60cULL, -1007}, {0x8dd01fad907ffc3cULL, -980},
+    {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874},
+    {0x823c12795db6ce57ULL, -847}, {0xc21094364dfb5637ULL, -821},
+    {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715},
+    {0xb23867fb2a35b28eULL, -688}, {0x84c8d4dfd2c63f3bULL, -661},
+    {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555},
+    {0xf3e2f893dec3f126ULL, -529}, {0xb5b5ada8aaff80b8ULL, -502},
+    {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396},
+    {0xa6dfbd9fb8e5b88fULL, -369}, {0xf8a95fcf88747d94ULL, -343},
+    {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236},
+    {0xe45c10c42a2b3b06ULL, -210}, {0xaa242499697392d3ULL, -183},
+    {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77},
+    {0x9c40000000000000ULL, -50}, {0xe8d4a51000000000ULL, -24},
+    {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83},
+    {0xd5d238a4abe98068ULL, 109}, {0x9f4f2726179a2245ULL, 136},
+    {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242},
+    {0x924d692ca61be758ULL, 269}, {0xda01ee641a708deaULL, 295},
+    {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402},
+    {0xc83553c5c8965d3dULL, 428}, {0x952ab45cfa97a0b3ULL, 455},
+    {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561},
+    {0x88fcf317f22241e2ULL, 588}, {0xcc20ce9bd35c78a5ULL, 614},
+    {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720},
+    {0xbb764c4ca7a44410ULL, 747}, {0x8bab8eefb6409c1aULL, 774},
+    {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880},
+    {0x80444b5e7aa7cf85ULL, 907}, {0xbf21e44003acdd2dULL, 933},
+    {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039},
+    {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+
+/**
+ * Format unsigned
+ * 
+ * Write unsigned value in base 2..36, lowercase letters on request.
+ */
+static size_t fmtUnsigned(char * buf, unsigned long value, int base, bool lower) {
+    char tmp[FMT_INT_MAX];
+    size_t n = 0;
+    do {
+        char c = fmtDigitChars[value % base];
+        tmp[n++] = lower && c >= 'A' ? c - 'A' + 'a' : c;
+        value /= base;
+    } while (value);
+
+    size_t len = 0;
+    while (n) {
+        buf[len++] = tmp[--n];
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Format integer
+ * 
+ * Write value in base 2..36 into buffer (null-terminated). Base 10 is
+ * signed, other bases show the unsigned cell (as %lX did).
+ * Returns the number of chars written.
+ */
+size_t fmtInt(char * buf, long value, int base) {
+    if (base < 2 || base > 36) {
+        base = 10;
+    }
+    if (base == 10 && value < 0) {
+        buf[0] = '-';
+        return 1 + fmtUnsigned(buf + 1, -(unsigned long) value, 10, false);
+    }
+    return fmtUnsigned(buf, (unsigned long) value, base, false);
+}
+
+/**
+ * Big multiply
+ * 
+ * Multiply base 1e9 number by factor below 2^32.
+ */
+static void fmtBigMul(uint32_t * w, int * nw, uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < *nw; i++) {
+        uint64_t t = (uint64_t) w[i] * factor + carry;
+        w[i] = t % FMT_BIG_BASE;
+        carry = t / FMT_BIG_BASE;
+    }
+    while (carry) {
+        w[(*nw)++] = carry % FMT_BIG_BASE;
+        carry /= FMT_BIG_BASE;
+    }
+}
+
+/**
+ * Decimal push
+ * 
+ * Append digit, only remember whether nonzero digits overflowed.
+ */
+static void fmtPush(struct fmtDecimal * dec, char c) {
+    if (dec->n < FMT_DIGITS) {
+        dec->d[dec->n++] = c;
+    } else if (c != '0') {
+        dec->sticky = true;
+    }
+}
+
+/**
+ * Expand
+ * 
+ * Exact decimal expansion of a positive finite double:
+ * v = m * 2^e = m * 5^-e * 10^e for negative e.
+ */
+static void fmtExpand(double v, struct fmtDecimal * dec) {
+    int e;
+    uint64_t m = (uint64_t) ldexp(frexp(v, &e), 53);
+    e -= 53;
+    while (!(m & 1)) {
+        m >>= 1;
+        e++;
+    }
+
+    uint32_t w[FMT_BIG_WORDS];
+    int nw = 0;
+    while (m) {
+        w[nw++] = m % FMT_BIG_BASE;
+        m /= FMT_BIG_BASE;
+    }
+    int shift = 0;
+    for (int left = e; left > 0; left -= 29) {
+        fmtBigMul(w, &nw, 1UL << (left < 29 ? left : 29));
+    }
+    for (int left = -e; left > 0; left -= 13) {
+        uint32_t p = 1;
+        for (int i = 0; i < (left < 13 ? left : 13); i++) {
+            p *= 5;
+        }
+        fmtBigMul(w, &nw, p);
+    }
+    if (e < 0) {
+        shift = e;
+    }
+
+    // Most significant word without leading zeros, then 9 digits per word
+    char top[10];
+    int tn = 0;
+    for (uint32_t t = w[nw - 1]; t; t /= 10) {
+        top[tn++] = '0' + t % 10;
+    }
+    dec->n = 0;
+    dec->sticky = false;
+    dec->exp = tn + 9 * (nw - 1) - 1 + shift;
+    while (tn) {
+        fmtPush(dec, top[--tn]);
+    }
+    for (int k = nw - 2; k >= 0; k--) {
+        char nine[9];
+        uint32_t x = w[k];
+        for (int j = 8; j >= 0; j--) {
+            nine[j] = '0' + x % 10;
+            x /= 10;
+        }
+        for (int j = 0; j < 9; j++) {
+            fmtPush(dec, nine[j]);
+        }
+    }
+}
+
+/**
+ * Round
+ * 
+ * Round to `p` significant digits (half to even), p below FMT_DIGITS.
+ * Trailing zeros are dropped, zero result has no digits.
+ */
+static void fmtRound(struct fmtDecimal * dec, int p) {
+    if (p < 0) {
+        dec->n = 0;
+        return;
+    }
+    if (p < dec->n) {
+        bool rest = dec->sticky;
+        for (int i = p + 1; i < dec->n && !rest; i++) {
+            rest = dec->d[i] != '0';
+        }
+        char next = dec->d[p];
+        bool odd = p > 0 && (dec->d[p - 1] - '0') % 2;
+        bool up = next > '5' || (next == '5' && (rest || odd));
+
+        dec->n = p;
+        dec->sticky = false;
+        if (up) {
+            int i = p - 1;
+            while (i >= 0 && dec->d[i] == '9') {
+                dec->d[i--] = '0';
+            }
+            if (i >= 0) {
+                dec->d[i]++;
+            } else {
+                // All nines (or nothing) carried into a new leading digit
+                dec->d[0] = '1';
+                dec->n = 1;
+                dec->exp++;
+            }
+        }
+    }
+    while (dec->n && dec->d[dec->n - 1] == '0') {
+        dec->n--;
+    }
+}
+
+/**
+ * Fixed notation
+ * 
+ * Write digits with `frac` fraction digits (-1: as many as needed).
+ */
+static size_t fmtFixed(char * buf, const struct fmtDecimal * dec, int frac) {
+    size_t len = 0;
+    int x = dec->n ? dec->exp : 0;
+
+    // Integer part, digit i has weight 10^(exp - i)
+    if (!dec->n || x < 0) {
+        buf[len++] = '0';
+    } else {
+        for (int i = 0; i <= x; i++) {
+            buf[len++] = i < dec->n ? dec->d[i] : '0';
+        }
+    }
+
+    if (frac < 0) {
+        frac = dec->n && dec->n - 1 - x > 0 ? dec->n - 1 - x : 0;
+    }
+    if (frac) {
+        buf[len++] = '.';
+        for (int k = 1; k <= frac; k++) {
+            int i = x + k;
+            buf[len++] = dec->n && i >= 0 && i < dec->n ? dec->d[i] : '0';
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Exponent notation
+ * 
+ * Write d.ddde+XX with `frac` fraction digits (-1: as many as needed).
+ */
+static size_t fmtExp(char * buf, const struct fmtDecimal * dec, int frac) {
+    size_t len = 0;
+    buf[len++] = dec->n ? dec->d[0] : '0';
+
+    if (frac < 0) {
+        frac = dec->n > 1 ? dec->n - 1 : 0;
+    }
+    if (frac) {
+        buf[len++] = '.';
+        for (int k = 1; k <= frac; k++) {
+            buf[len++] = k < dec->n ? dec->d[k] : '0';
+        }
+    }
+
+    // At least two exponent digits, as printf
+    int x = dec->n ? dec->exp : 0;
+    buf[len++] = 'e';
+    buf[len++] = x < 0 ? '-' : '+';
+    if (x < 0) {
+        x = -x;
+    }
+    if (x < 10) {
+        buf[len++] = '0';
+    }
+    len += fmtUnsigned(buf + len, x, 10, false);
+    return len;
+}
+
+/**
+ * Special real
+ * 
+ * Write sign, and nan or inf. Returns true if value is not finite.
+ */
+static bool fmtSpecial(char * buf, size_t * len, double * value) {
+    *len = 0;
+    if (isnan(*value)) {
+        strcpy(buf, "nan");
+        *len = 3;
+        return true;
+    }
+    if (signbit(*value)) {
+        buf[(*len)++] = '-';
+        *value = -*value;
+    }
+    if (isinf(*value)) {
+        strcpy(buf + *len, "inf");
+        *len += 3;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Multiply
+ * 
+ * Upper 64 bits of the product of two significands, rounded. Built from
+ * 32-bit halves, a 32-bit core has no 128-bit product.
+ */
+static struct fmtFp fmtFpMul(struct fmtFp x, struct fmtFp y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFF;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFF;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF) + (1UL << 31);
+    struct fmtFp r = {ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64};
+    return r;
+}
+
+/**
+ * Shortest round
+ * 
+ * Move the last digit towards the value while it stays in the safe interval.
+ * Returns false if the digits might not be the shortest closest ones.
+ */
+static bool fmtShortRound(struct fmtDecimal * dec, uint64_t tooHighW, uint64_t unsafe,
+                          uint64_t rest, uint64_t tenKappa, uint64_t unit) {
+    uint64_t small = tooHighW - unit;
+    uint64_t big = tooHighW + unit;
+
+    while (rest < small && unsafe - rest >= tenKappa &&
+           (rest + tenKappa < small || small - rest >= rest + tenKappa - small)) {
+        dec->d[dec->n - 1]--;
+        rest += tenKappa;
+    }
+    // Undecided if the next lower digit string might be closer
+    if (rest < big && unsafe - rest >= tenKappa &&
+        (rest + tenKappa < big || big - rest > rest + tenKappa - big)) {
+        return false;
+    }
+    return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+/**
+ * Shortest
+ * 
+ * Shortest digits of a positive finite double, closest to it among those
+ * (Grisu3, Loitsch 2010: scaled by a cached power of ten, digits are cut
+ * from a 64-bit fixed point number).
+ * Returns false for the rare values it cannot decide.
+ */
+static bool fmtShortest(double v, struct fmtDecimal * dec) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint64_t f = bits & ((1ULL << 52) - 1);
+    int be = (bits >> 52) & 0x7FF;
+    int e = be ? be - 1075 : -1074;
+    if (be) {
+        f |= 1ULL << 52;
+    }
+
+    // Boundaries halfway to the neighbours, the lower one is closer
+    // above a power of two. All share the exponent of the normalized value.
+    struct fmtFp plus = {(f << 1) + 1, e - 1};
+    struct fmtFp minus = {(f << 1) - 1, e - 1};
+    if (f == 1ULL << 52 && be > 1) {
+        minus.f = (f << 2) - 1;
+        minus.e = e - 2;
+    }
+    int lz = __builtin_clzll(plus.f);
+    plus.f <<= lz;
+    plus.e -= lz;
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    struct fmtFp w = {f << (lz + 1), plus.e};
+
+    // Power of ten bringing the exponent of the products to -60..-32
+    int k = (int) ceil((-61 - plus.e) * 0.30102999566398114);
+    int i = (k - FMT_POWER_MIN + FMT_POWER_STEP - 1) / FMT_POWER_STEP;
+    while (plus.e + fmtPowers[i].e + 64 < -60) {
+        i++;
+    }
+    while (plus.e + fmtPowers[i].e + 64 > -32) {
+        i--;
+    }
+    int mk = FMT_POWER_MIN + i * FMT_POWER_STEP;
+    w = fmtFpMul(w, fmtPowers[i]);
+    plus = fmtFpMul(plus, fmtPowers[i]);
+    minus = fmtFpMul(minus, fmtPowers[i]);
+
+    // Widen by the multiplication error, digits inside are unsafe
+    uint64_t unit = 1;
+    uint64_t tooLow = minus.f - unit;
+    uint64_t tooHigh = plus.f + unit;
+    uint64_t unsafe = tooHigh - tooLow;
+    int shift = -w.e;
+    uint64_t one = 1ULL << shift;
+    uint32_t integrals = tooHigh >> shift;
+    uint64_t fractionals = tooHigh & (one - 1);
+
+    // Integral digits
+    int kappa = 9;
+    while (kappa > 0 && integrals < fmtPow10[kappa]) {
+        kappa--;
+    }
+    kappa++;
+    dec->n = 0;
+    dec->sticky = false;
+    bool ok;
+    while (true) {
+        if (kappa > 0) {
+            uint32_t divisor = fmtPow10[--kappa];
+            dec->d[dec->n++] = '0' + integrals / divisor;
+            integrals %= divisor;
+            uint64_t rest = ((uint64_t) integrals << shift) + fractionals;
+            if (rest < unsafe) {
+                ok = fmtShortRound(dec, tooHigh - w.f, unsafe, rest, (uint64_t) divisor << shift, unit);
+                break;
+            }
+        } else {
+            // Fraction digits, the error grows with each one
+            fractionals *= 10;
+            unit *= 10;
+            unsafe *= 10;
+            dec->d[dec->n++] = '0' + (fractionals >> shift);
+            fractionals &= one - 1;
+            kappa--;
+            if (fractionals < unsafe) {
+                ok = fmtShortRound(dec, (tooHigh - w.f) * unit, unsafe, fractionals, one, unit);
+                break;
+            }
+        }
+        if (dec->n == FMT_DIGITS) {
+            return false;
+        }
+    }
+
+    // First digit has weight 10^exp
+    dec->exp = dec->n - 1 + kappa - mk;
+    while (dec->n && dec->d[dec->n - 1] == '0') {
+        dec->n--;
+    }
+    return ok;
+}
+
+/**
+ * Format real
+ * 
+ * Write the shortest decimal that reads back as the same double,
+ * in %g-like notation (null-terminated, at most FMT_REAL_MAX bytes).
+ * Returns the number of chars written.
+ */
+size_t fmtReal(char * buf, double value) {
+    size_t len;
+    if (fmtSpecial(buf, &len, &value)) {
+        return len;
+    }
+
+    struct fmtDecimal exact, dec;
+    dec.n = 0;
+    if (value != 0 && !fmtShortest(value, &dec)) {
+        // Undecided: the nearest decimal of FMT_UNIQUE_MAX digits reads
+        // back if any shorter one does, otherwise try more digits
+        fmtExpand(value, &exact);
+        for (int p = FMT_UNIQUE_MAX; p <= FMT_SHORTEST_MAX; p++) {
+            char probe[FMT_REAL_MAX];
+            dec = exact;
+            fmtRound(&dec, p);
+            fmtExp(probe, &dec, -1);
+            if (strtod(probe, NULL) == value) {
+                break;
+            }
+        }
+    }
+
+    // Fixed for moderate exponents, scientific otherwise
+    if (dec.n && (dec.exp < -4 || dec.exp >= FMT_SHORTEST_MAX - 1)) {
+        return len + fmtExp(buf + len, &dec, -1);
+    }
+    return len + fmtFixed(buf + len, &dec, -1);
+}
+
+/**
+ * Format parse
+ * 
+ * Copy format up to its only conversion into buffer and return the
+ * conversion char (precision -1 if not given), 0 if not supported.
+ * `out` is advanced, `tail` is set to the format after the conversion.
+ */
+static char fmtParse(char ** out, const char * format, const char ** tail,
+                     int * precision, const char * conversions) {
+    char * buf = *out;
+    const char * f = format;
+
+    // Literal text up to the conversion
+    while (*f && !(f[0] == '%' && f[1] != '%')) {
+        if (*f == '%') {
+            f++;
+        }
+        *buf++ = *f++;
+    }
+    if (!*f) {
+        return 0;
+    }
+    f++;
+
+    // Only precision and length modifier, no flags or width
+    *precision = -1;
+    if (*f == '.') {
+        f++;
+        *precision = 0;
+        while (*f >= '0' && *f <= '9') {
+            *precision = *precision * 10 + (*f++ - '0');
+        }
+    }
+    if (*f == 'l') {
+        f++;
+    }
+    if (!*f || !strchr(conversions, *f)) {
+        return 0;
+    }
+    char conversion = *f++;
+
+    // No other conversion may follow
+    for (const char * r = f; *r; r++) {
+        if (*r == '%') {
+            if (r[1] != '%') {
+                return 0;
+            }
+            r++;
+        }
+    }
+
+    *out = buf;
+    *tail = f;
+    return conversion;
+}
+
+/**
+ * Format tail
+ * 
+ * Copy rest of format after the conversion (%% becomes %).
+ */
+static void fmtTail(char * buf, const char * tail) {
+    while (*tail) {
+        if (tail[0] == '%' && tail[1] == '%') {
+            tail++;
+        }
+        *buf++ = *tail++;
+    }
+    *buf = '\0';
+}
+
+/**
+ * Format with integer
+ * 
+ * Write format with its one %d/%i/%u/%x/%X/%o conversion (optional l,
+ * no flags, width or precision) into buffer, without printf.
+ * Returns false for formats needing sprintf.
+ */
+bool fmtFormatInt(char * buf, const char * format, long value) {
+    const char * tail;
+    int precision;
+    char * out = buf;
+    char conversion = fmtParse(&out, format, &tail, &precision, "diuxXo");
+    if (!conversion || precision >= 0) {
+        return false;
+    }
+
+    switch (conversion) {
+        case 'd':
+        case 'i':
+            out += fmtInt(out, value, 10);
+            break;
+        case 'u':
+            out += fmtUnsigned(out, value, 10, false);
+            break;
+        case 'o':
+            out += fmtUnsigned(out, value, 8, false);
+            break;
+        default:
+            out += fmtUnsigned(out, value, 16, conversion == 'x');
+    }
+    fmtTail(out, tail);
+    return true;
+}
+
+/**
+ * Format with real
+ * 
+ * Like fmtFormatInt() for one %f/%e/%g conversion with optional precision.
+ */
+bool fmtFormatReal(char * buf, const char * format, double value) {
+    const char * tail;
+    int precision;
+    char * out = buf;
+    char conversion = fmtParse(&out, format, &tail, &precision, "feg");
+    if (!conversion) {
+        return false;
+    }
+    if (precision < 0) {
+        precision = 6;
+    }
+
+    size_t len;
+    if (fmtSpecial(out, &len, &value)) {
+        fmtTail(out + len, tail);
+        return true;
+    }
+
+    // Significant digits needed by the conversion
+    struct fmtDecimal dec;
+    dec.n = 0;
+    dec.exp = 0;
+    if (value != 0) {
+        fmtExpand(value, &dec);
+    }
+    int p = conversion == 'f' ? dec.exp + 1 + precision :
+            conversion == 'e' ? precision + 1 :
+            precision ? precision : 1;
+    if (p >= FMT_DIGITS) {
+        return false;
+    }
+    fmtRound(&dec, p);
+
+    out += len;
+    if (conversion == 'f') {
+        out += fmtFixed(out, &dec, precision);
+    } else if (conversion == 'e') {
+        out += fmtExp(out, &dec, precision);
+    } else if (dec.n && (dec.exp < -4 || dec.exp >= p)) {
+        out += fmtExp(out, &dec, -1);
+    } else {
+        out += fmtFixed(out, &dec, -1);
+    }
+    fmtTail(out, tail);
+    return true;
+}
@@ -0,0 +1,166 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <atomic>
+
+#include "outring.h"
+
+// Record header: ready and padding flags, span in ring and data length
+#define OUT_HDR_SIZE 4
+#define OUT_READY 0x80000000
+#define OUT_PAD 0x40000000
+#define OUT_SPAN(h) (((h) >> 16) & 0x3FFF)
+#define OUT_LEN(h) ((h) & 0xFFFF)
+
+#define OUT_MASK (OUT_RING_SIZE - 1)
+
+
+// Ring storage, zeroed behind the consumer so that headers read not ready
+static char outRing[OUT_RING_SIZE] __attribute__((aligned(4)));
+// Bytes reserved by producers and consumed by the consumer (free-running)
+static std::atomic<uint32_t> outHead(0);
+static std::atomic<uint32_t> outTail(0);
+static std::atomic<uint32_t> outDropped(0);
+
+
+/**
+ * Output record span
+ * 
+ * Bytes taken in ring by record of `size` bytes (aligned header).
+ */
+static uint32_t outSpan(size_t size) {
+    return OUT_HDR_SIZE + ((size + 3) & ~3);
+}
+
+/**
+ * Output header store
+ * 
+ * Publish record header at ring position.
+ */
+static void outHeaderStore(uint32_t pos, uint32_t header) {
+    __atomic_store_n((uint32_t *) (outRing + pos), header, __ATOMIC_RELEASE);
+}
+
+/**
+ * Output ring try reserve
+ * 
+ * Like outRingReserve(), but a full ring is not counted as dropped,
+ * so that the producer can wait and retry.
+ */
+char * outRingTryReserve(size_t * size) {
+    if (*size > OUT_RECORD_MAX) {
+        outDropped += *size - OUT_RECORD_MAX;
+        *size = OUT_RECORD_MAX;
+    }
+    uint32_t span = outSpan(*size);
+
+    // Claim space, records never wrap: skip the end of the ring instead
+    uint32_t head = outHead.load(std::memory_order_relaxed);
+    uint32_t pos, pad;
+    do {
+        pos = head & OUT_MASK;
+        pad = (pos + span > OUT_RING_SIZE) ? OUT_RING_SIZE - pos : 0;
+        if (head + pad + span - outTail.load(std::memory_order_acquire) > OUT_RING_SIZE) {
+            return NULL;
+        }
+    } while (!outHead.compare_exchange_weak(head, head + pad + span,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_relaxed));
+
+    // Padding is ready at once, the consumer skips it
+    if (pad) {
+        outHeaderStore(pos, OUT_READY | OUT_PAD | (pad << 16));
+        pos = 0;
+    }
+    return outRing + pos + OUT_HDR_SIZE;
+}
+
+/**
+ * Output ring reserve
+ * 
+ * Reserve record of `size` bytes for a producer (any task, lock-free).
+ * Size above OUT_RECORD_MAX is truncated and the excess counted as dropped.
+ * Returns record data, or NULL (counted as dropped) if the ring is full.
+ */
+char * outRingReserve(size_t * size) {
+    char * data = outRingTryReserve(size);
+    if (!data) {
+        outDropped += *size;
+    }
+    return data;
+}
+
+/**
+ * Output ring commit
+ * 
+ * Publish first `len` bytes of record reserved with `size` bytes.
+ * Every reserved record must be committed.
+ */
+void outRingCommit(char * data, size_t size, size_t len) {
+    uint32_t pos = data - OUT_HDR_SIZE - outRing;
+    outHeaderStore(pos, OUT_READY | (outSpan(size) << 16) | len);
+}
+
+/**
+ * Output ring read
+ * 
+ * Move committed output in order into buffer (null-terminated) for the
+ * single consumer. Stops at a record that does not fit or is not yet
+ * committed. Buffer NULL discards output. Returns the number of bytes read.
+ * Buffer must be larger than OUT_RECORD_MAX to guarantee progress.
+ */
+size_t outRingRead(char * buf, size_t size) {
+    uint32_t tail = outTail.load(std::memory_order_relaxed);
+    size_t n = 0;
+
+    while (true) {
+        uint32_t pos = tail & OUT_MASK;
+        uint32_t header = __atomic_load_n((uint32_t *) (outRing + pos), __ATOMIC_ACQUIRE);
+        if (!(header & OUT_READY)) {
+            break;
+        }
+
+        // Copy record data, leave room for terminator
+        if (!(header & OUT_PAD) && buf) {
+            if (n + OUT_LEN(header) >= size) {
+                break;
+            }
+            memcpy(buf + n, outRing + pos + OUT_HDR_SIZE, OUT_LEN(header));
+            n += OUT_LEN(header);
+        }
+
+        // Free record
+        memset(outRing + pos, 0, OUT_SPAN(header));
+        tail += OUT_SPAN(header);
+        outTail.store(tail, std::memory_order_release);
+    }
+
+    if (buf) {
+        buf[n] = '\0';
+    }
+    return n;
+}
+
+/**
+ * Output ring dropped
+ * 
+ * Returns total number of output bytes dropped or truncated.
+ */
+uint32_t outRingDropped() {
+    return outDropped.load(std::memory_order_relaxed);
+}
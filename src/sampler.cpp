@@ -0,0 +1,292 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+
+#include "atlast-task.h"
+#include "io.h"
+#include "sampler.h"
+
+#define SAMPLER_MIN_PERIOD_US 50    // Shortest accepted timer period
+
+
+// Sampler channel
+struct samplerChan {
+    volatile uint8_t source;    // SAMPLER_NONE when inactive
+    uint8_t pin;        // Pin or I2C address
+    uint8_t reg;        // I2C register
+    uint8_t bytes;      // I2C bytes read
+    uint32_t divider;   // Timer periods per sample
+    uint32_t countdown; // Timer periods until next sample
+    long * buffer;      // Ring of blocks in ATLAST heap
+    uint32_t blockLen;  // Cells per block
+    uint32_t blocks;    // Blocks in ring
+    uint32_t pos;       // Write position in current block
+    volatile uint32_t head;     // Blocks filled (written by sampler)
+    volatile uint32_t tail;     // Blocks released (written by consumer)
+    volatile uint32_t drops;    // Samples dropped on full ring
+};
+
+struct samplerChan samplerChans[SAMPLER_CHANNELS];
+volatile int samplerChanCount = 0;
+
+esp_timer_handle_t samplerTimer = NULL;
+TaskHandle_t samplerTaskHandle = NULL;
+bool samplerRunning = false;
+volatile bool samplerTicking = false;   // Tick in progress
+
+
+/**
+ * Sampler read
+ * 
+ * Read one sample from channel source.
+ */
+static long samplerRead(struct samplerChan * c) {
+    switch (c->source) {
+        case SAMPLER_ADC:
+            return analogRead(c->pin);
+        case SAMPLER_GPIO:
+            return digitalRead(c->pin);
+        case SAMPLER_I2C: {
+            // Bus is shared with ATLAST I2C words
+            if (!i2cLock()) {
+                return -1;
+            }
+            Wire.beginTransmission(c->pin);
+            Wire.write(c->reg);
+            if (Wire.endTransmission(false) != I2C_ERROR_OK) {
+                i2cUnlock();
+                return -1;
+            }
+            Wire.requestFrom(c->pin, c->bytes);
+            long value = 0;
+            // Big-endian, missing bytes read as zero
+            for (int i = 0; i < c->bytes; i++) {
+                value = (value << 8) | (Wire.available() ? Wire.read() : 0);
+            }
+            i2cUnlock();
+            return value;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sampler tick
+ * 
+ * Sample all channels due in this timer period.
+ */
+static void samplerTick() {
+    for (int i = 0; i < samplerChanCount; i++) {
+        struct samplerChan * c = &samplerChans[i];
+        if (c->source == SAMPLER_NONE || --c->countdown > 0) {
+            continue;
+        }
+        c->countdown = c->divider;
+
+        // Drop sample while the consumer holds all blocks
+        if (c->head - c->tail >= c->blocks) {
+            c->drops++;
+            continue;
+        }
+        long * block = c->buffer + (c->head % c->blocks) * c->blockLen;
+        block[c->pos] = samplerRead(c);
+
+        // Hand over filled block
+        if (++c->pos == c->blockLen) {
+            c->pos = 0;
+            c->head++;
+        }
+    }
+}
+
+/**
+ * Sampler loop
+ * 
+ * Run channel table on each timer notification.
+ * Run in its own task.
+ */
+static void samplerLoop(void * pvParameter) {
+    while (true) {
+        // Missed periods are coalesced into one tick
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        samplerTicking = true;
+        samplerTick();
+        samplerTicking = false;
+    }
+}
+
+/**
+ * Sampler timer callback
+ * 
+ * Wake up sampler task. Runs in the esp_timer task.
+ */
+static void samplerTimerCallback(void * arg) {
+    xTaskNotifyGive(samplerTaskHandle);
+}
+
+/**
+ * Sampler channel
+ * 
+ * Allocate channel storing samples into ring of `blocks` blocks of
+ * `blockLen` cells at `buffer`, sampled every `divider` timer periods.
+ * The channel is inactive until a source is set.
+ * Returns channel number, or -1 if no channel is left.
+ */
+int samplerChannel(long * buffer, uint32_t blockLen, uint32_t blocks, uint32_t divider) {
+    if (samplerChanCount >= SAMPLER_CHANNELS || !blockLen || !blocks || !divider) {
+        return -1;
+    }
+    struct samplerChan * c = &samplerChans[samplerChanCount];
+    memset(c, 0, sizeof(*c));
+    c->buffer = buffer;
+    c->blockLen = blockLen;
+    c->blocks = blocks;
+    c->divider = divider;
+    c->countdown = divider;
+    // Publish channel after it is complete
+    return samplerChanCount++;
+}
+
+/**
+ * Sampler source
+ * 
+ * Set channel source and activate channel.
+ * For I2C, `pin` is the 7-bit address, `reg` the register and `bytes`
+ * the number of bytes read (1..4). Returns false on invalid channel.
+ */
+bool samplerSource(int ch, uint8_t source, uint8_t pin, uint8_t reg, uint8_t bytes) {
+    if (ch < 0 || ch >= samplerChanCount || source > SAMPLER_I2C) {
+        return false;
+    }
+    if (source == SAMPLER_I2C && (bytes < 1 || bytes > 4)) {
+        return false;
+    }
+    struct samplerChan * c = &samplerChans[ch];
+    c->source = SAMPLER_NONE;
+    c->pin = pin;
+    c->reg = reg;
+    c->bytes = bytes;
+    c->source = source;
+    return true;
+}
+
+/**
+ * Sampler start
+ * 
+ * Start sampler timer with period in us.
+ */
+bool samplerStart(uint32_t periodUs) {
+    if (periodUs < SAMPLER_MIN_PERIOD_US) {
+        return false;
+    }
+
+    // Create task and timer on first use
+    if (!samplerTaskHandle) {
+        // Above ATLAST priority on the ATLAST core, so that an interpreted
+        // program only delays sampling by the length of one tick
+        xTaskCreatePinnedToCore(&samplerLoop,
+                                SAMPLER_TASK_NAME,
+                                4096,   // Stack size
+                                NULL,
+                                configMAX_PRIORITIES - 5,   // Priority
+                                &samplerTaskHandle,
+                                ATL_CORE);
+    }
+    if (!samplerTimer) {
+        esp_timer_create_args_t args = {};
+        args.callback = &samplerTimerCallback;
+        args.name = SAMPLER_TASK_NAME;
+        esp_timer_create(&args, &samplerTimer);
+    }
+
+    samplerStop();
+    samplerRunning = esp_timer_start_periodic(samplerTimer, periodUs) == ESP_OK;
+    return samplerRunning;
+}
+
+/**
+ * Sampler stop
+ * 
+ * Stop sampler timer (channels are kept).
+ */
+void samplerStop() {
+    if (samplerRunning) {
+        esp_timer_stop(samplerTimer);
+        samplerRunning = false;
+    }
+}
+
+/**
+ * Sampler clear
+ * 
+ * Stop sampler and remove all channels.
+ */
+void samplerClear() {
+    samplerStop();
+    samplerChanCount = 0;
+    // The sampler task preempts ATLAST on its core, other tasks (restart
+    // after kill) wait for a tick that took the channels before they went
+    while (samplerTicking) {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * Sampler block
+ * 
+ * Return address of the oldest filled block of channel, NULL if none.
+ */
+long * samplerBlock(int ch) {
+    if (ch < 0 || ch >= samplerChanCount) {
+        return NULL;
+    }
+    struct samplerChan * c = &samplerChans[ch];
+    if (c->head == c->tail) {
+        return NULL;
+    }
+    return c->buffer + (c->tail % c->blocks) * c->blockLen;
+}
+
+/**
+ * Sampler release
+ * 
+ * Return the oldest filled block of channel to the sampler.
+ */
+void samplerRelease(int ch) {
+    if (ch < 0 || ch >= samplerChanCount) {
+        return;
+    }
+    struct samplerChan * c = &samplerChans[ch];
+    if (c->head != c->tail) {
+        c->tail++;
+    }
+}
+
+/**
+ * Sampler drops
+ * 
+ * Return number of samples dropped because all blocks were filled.
+ */
+uint32_t samplerDrops(int ch) {
+    if (ch < 0 || ch >= samplerChanCount) {
+        return 0;
+    }
+    return samplerChans[ch].drops;
+}
@@ -0,0 +1,239 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "atlast-1.2-esp32/atlast.h"
+#include "atlast-task.h"
+#include "scan.h"
+
+
+// Process image: mapped pins and image bits
+uint8_t scanInPins[SCAN_MAX_PINS];
+uint8_t scanOutPins[SCAN_MAX_PINS];
+uint8_t scanInCount = 0;
+uint8_t scanOutCount = 0;
+uint32_t scanInImage = 0;
+uint32_t scanOutImage = 0;
+
+// Statistics, guarded by spinlock (read by other tasks)
+struct scanStats scanStat;
+portMUX_TYPE scanMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool scanStopFlag = false;
+
+
+/**
+ * Scan add input
+ * 
+ * Map digital input pin to the next bit of the input image.
+ * Returns false if the image is full.
+ */
+bool scanAddInput(uint8_t pin) {
+    if (scanInCount >= SCAN_MAX_PINS) {
+        return false;
+    }
+    scanInPins[scanInCount++] = pin;
+    return true;
+}
+
+/**
+ * Scan add output
+ * 
+ * Map the next bit of the output image to digital output pin.
+ * Returns false if the image is full.
+ */
+bool scanAddOutput(uint8_t pin) {
+    if (scanOutCount >= SCAN_MAX_PINS) {
+        return false;
+    }
+    scanOutPins[scanOutCount++] = pin;
+    return true;
+}
+
+/**
+ * Scan clear
+ * 
+ * Remove all pins from the process image.
+ */
+void scanClear() {
+    scanInCount = scanOutCount = 0;
+    scanInImage = scanOutImage = 0;
+}
+
+/**
+ * Scan get inputs
+ * 
+ * Return input image latched at the start of the current cycle.
+ */
+uint32_t scanGetInputs() {
+    return scanInImage;
+}
+
+/**
+ * Scan get outputs
+ * 
+ * Return output image to be committed at the end of the current cycle.
+ */
+uint32_t scanGetOutputs() {
+    return scanOutImage;
+}
+
+/**
+ * Scan set outputs
+ * 
+ * Set output image to be committed at the end of the current cycle.
+ */
+void scanSetOutputs(uint32_t image) {
+    scanOutImage = image;
+}
+
+/**
+ * Scan latch
+ * 
+ * Read all mapped input pins into the input image.
+ */
+static void scanLatch() {
+    uint32_t image = 0;
+    for (uint8_t i = 0; i < scanInCount; i++) {
+        if (digitalRead(scanInPins[i])) {
+            image |= 1UL << i;
+        }
+    }
+    scanInImage = image;
+}
+
+/**
+ * Scan commit
+ * 
+ * Write output image to all mapped output pins.
+ */
+static void scanCommit() {
+    for (uint8_t i = 0; i < scanOutCount; i++) {
+        digitalWrite(scanOutPins[i], (scanOutImage >> i) & 1);
+    }
+}
+
+/**
+ * Scan run
+ * 
+ * Run scan cycles with fixed period: latch inputs, call body, commit outputs.
+ * Stops on scanStop(), on kill or when body returns nonzero.
+ * Returns the last status returned by body, or SCAN_BADPERIOD if the period
+ * is shorter than one tick.
+ */
+int scanRun(int (*body)(void *), void * arg, uint32_t periodMs) {
+    TickType_t periodTicks = pdMS_TO_TICKS(periodMs);
+    int64_t period = (int64_t) periodMs * 1000;
+    int status = 0;
+
+    // Periods below one tick cannot be scheduled
+    if (!periodTicks) {
+        return SCAN_BADPERIOD;
+    }
+
+    // Reset statistics
+    portENTER_CRITICAL(&scanMux);
+    memset(&scanStat, 0, sizeof(scanStat));
+    scanStat.running = true;
+    scanStat.periodMs = periodMs;
+    scanStat.minTime = INT64_MAX;
+    portEXIT_CRITICAL(&scanMux);
+    scanStopFlag = false;
+
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t scheduled = esp_timer_get_time();
+
+    while (!scanStopFlag && !atlastKilled()) {
+        int64_t start = esp_timer_get_time();
+
+        // Latch inputs, run user word, commit outputs
+        scanLatch();
+        status = body(arg);
+        scanCommit();
+
+        int64_t cycleTime = esp_timer_get_time() - start;
+        int64_t jitter = start - scheduled;
+        bool overrun = cycleTime > period;
+
+        // Update statistics
+        portENTER_CRITICAL(&scanMux);
+        scanStat.cycles++;
+        scanStat.sumTime += cycleTime;
+        if (cycleTime < scanStat.minTime) {
+            scanStat.minTime = cycleTime;
+        }
+        if (cycleTime > scanStat.maxTime) {
+            scanStat.maxTime = cycleTime;
+        }
+        if (jitter > scanStat.maxJitter) {
+            scanStat.maxJitter = jitter;
+        }
+        if (overrun) {
+            scanStat.overruns++;
+        }
+        portEXIT_CRITICAL(&scanMux);
+
+        if (status != 0) {
+            break;
+        }
+
+        // Sleep until the next period, restart schedule at once after an
+        // overrun (missed periods are not caught up with)
+        if (overrun || xTaskGetTickCount() - lastWake >= periodTicks) {
+            lastWake = xTaskGetTickCount();
+            scheduled = esp_timer_get_time();
+        } else {
+            // Sleep is cut short by atlastKill() only, stray notifications
+            // do not end it
+            TickType_t now;
+            while ((now = xTaskGetTickCount()) - lastWake < periodTicks && !atlastKilled()) {
+                ulTaskNotifyTake(pdTRUE, lastWake + periodTicks - now);
+            }
+            lastWake += periodTicks;
+            atl_yielded();
+            scheduled += period;
+        }
+    }
+
+    portENTER_CRITICAL(&scanMux);
+    scanStat.running = false;
+    portEXIT_CRITICAL(&scanMux);
+    return status;
+}
+
+/**
+ * Scan stop
+ * 
+ * Stop scan cycles after the current one.
+ */
+void scanStop() {
+    scanStopFlag = true;
+}
+
+/**
+ * Scan get stats
+ * 
+ * Copy statistics of the running or last scan.
+ */
+void scanGetStats(struct scanStats * stats) {
+    portENTER_CRITICAL(&scanMux);
+    *stats = scanStat;
+    portEXIT_CRITICAL(&scanMux);
+    if (!stats->cycles) {
+        stats->minTime = 0;
+    }
+}
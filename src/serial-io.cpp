@@ -0,0 +1,253 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+
+#include "atlast-task.h"
+#include "io.h"
+#include "serial-io.h"
+
+
+// Line being assembled from UART input
+struct serialLine {
+    char buf[ATL_CMD_LEN];
+    size_t len;
+    bool cr;    // Last char was CR, a following LF ends nothing
+} serialIn;
+
+// Task reading serial input
+TaskHandle_t serialTaskHandle = NULL;
+// Output waiting for transmission and its writer lock. A semaphore rather
+// than a mutex, so that the lock of a deleted ATLAST task can be released.
+StreamBufferHandle_t serialTx = NULL;
+SemaphoreHandle_t serialTxSemaphore = NULL;
+volatile TaskHandle_t serialTxOwner = NULL;
+// TX task holds output taken from the ring
+volatile bool serialTxBusy = false;
+
+
+/**
+ * Serial TX task
+ * 
+ * Move queued output to UART FIFO as space frees up, never spinning on it.
+ */
+static void serialTxTask(void * pvParameter) {
+    char chunk[SERIAL_TX_CHUNK];
+
+    while (true) {
+        // Wait for output
+        size_t len = xStreamBufferReceive(serialTx, chunk, sizeof(chunk), portMAX_DELAY);
+        serialTxBusy = true;
+
+        // Pass it on, sleep while FIFO is full
+        size_t done = 0;
+        while (done < len) {
+            size_t space = Serial.availableForWrite();
+            if (!space) {
+                vTaskDelay(1);
+                continue;
+            }
+            size_t n = len - done < space ? len - done : space;
+            Serial.write((const uint8_t *) chunk + done, n);
+            done += n;
+        }
+        serialTxBusy = false;
+    }
+}
+
+/**
+ * Serial begin
+ * 
+ * Initialize UART with a large receive ring. Input is read by the calling
+ * task, which is woken by receive events where the core supports them.
+ * Output is transmitted from a ring by a separate task.
+ */
+void serialBegin() {
+    serialTaskHandle = xTaskGetCurrentTaskHandle();
+
+    // Ring must be sized before the driver is installed
+    Serial.setRxBufferSize(SERIAL_RX_RING);
+    Serial.begin(SERIAL_BAUD);
+
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 2
+    // Wake reader on receive event (older cores are checked every SERIAL_WAIT_MS)
+    Serial.onReceive([]() {
+        xTaskNotifyGive(serialTaskHandle);
+    });
+#endif
+
+    // Transmit output in background
+    serialTx = xStreamBufferCreate(SERIAL_TX_RING, 1);
+    serialTxSemaphore = xSemaphoreCreateCounting(1, 1);
+    xTaskCreate(serialTxTask, SERIAL_TX_TASK_NAME, 2048, NULL, 1, NULL);
+}
+
+/**
+ * Serial set baud
+ * 
+ * Switch UART baud rate once pending output is transmitted.
+ */
+void serialSetBaud(unsigned long baud) {
+    while (!xStreamBufferIsEmpty(serialTx) || serialTxBusy) {
+        delay(1);
+    }
+    Serial.flush();
+    Serial.updateBaudRate(baud);
+}
+
+/**
+ * Serial write
+ * 
+ * Queue output for transmission without waiting for the UART.
+ * Returns the number of bytes queued, the rest did not fit the ring
+ * (or another writer held the ring for over SERIAL_TX_LOCK_MS).
+ */
+size_t serialWrite(const char * data, size_t len) {
+    // Stream buffer takes one writer at a time, others wait for the copy
+    if (xSemaphoreTake(serialTxSemaphore, pdMS_TO_TICKS(SERIAL_TX_LOCK_MS)) != pdTRUE) {
+        return 0;
+    }
+    serialTxOwner = xTaskGetCurrentTaskHandle();
+    size_t sent = xStreamBufferSend(serialTx, data, len, 0);
+    serialTxOwner = NULL;
+    xSemaphoreGive(serialTxSemaphore);
+    return sent;
+}
+
+/**
+ * Serial unlock task
+ * 
+ * Release the output ring if its writer lock is held by `task` (deleted
+ * while holding it).
+ */
+void serialUnlockTask(TaskHandle_t task) {
+    if (task && serialTxOwner == task) {
+        serialTxOwner = NULL;
+        xSemaphoreGive(serialTxSemaphore);
+    }
+}
+
+/**
+ * Serial wait
+ * 
+ * Block until input may be available.
+ */
+static void serialWait() {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SERIAL_WAIT_MS));
+}
+
+/**
+ * Serial read piece
+ * 
+ * Block until a line is received or `limit` - 1 chars of it are buffered.
+ * Overlong lines are returned in pieces with `more` set on all but the last.
+ */
+void serialReadPiece(char * buf, size_t limit, bool * more) {
+    if (limit > sizeof(serialIn.buf)) {
+        limit = sizeof(serialIn.buf);
+    }
+
+    while (true) {
+        // Assemble line from received chars
+        while (Serial.available()) {
+            char c = (char) Serial.peek();
+            if (serialIn.len > limit - 1 ||
+                (serialIn.len == limit - 1 && c != '\n' && c != '\r')) {
+                break;
+            }
+            Serial.read();
+
+            // CR LF ends one line only
+            if (c == '\n' && serialIn.cr) {
+                serialIn.cr = false;
+                continue;
+            }
+            serialIn.cr = (c == '\r');
+
+            // Line complete
+            if (c == '\n' || c == '\r') {
+                memcpy(buf, serialIn.buf, serialIn.len);
+                buf[serialIn.len] = '\0';
+                serialIn.len = 0;
+                *more = false;
+                return;
+            }
+
+            serialIn.buf[serialIn.len++] = c;
+        }
+
+        // Piece full and the line goes on
+        if (serialIn.len >= limit - 1 && Serial.available()) {
+            size_t cut = limit - 1;
+            memcpy(buf, serialIn.buf, cut);
+            buf[cut] = '\0';
+            serialIn.len -= cut;
+            memmove(serialIn.buf, serialIn.buf + cut, serialIn.len);
+            *more = true;
+            return;
+        }
+
+        serialWait();
+    }
+}
+
+/**
+ * Serial poll
+ * 
+ * Read a line and pass it to the interpreter.
+ * Waits for free command slot, so pasted input is kept whole and in order.
+ * Overlong lines are joined on heap and evaluated whole, pieces would cut
+ * comments and strings. Lines over SERIAL_LINE_MAX chars are discarded.
+ */
+void serialPoll() {
+    char piece[ATL_CMD_LEN];
+    bool more;
+
+    serialReadPiece(piece, sizeof(piece), &more);
+    if (!more) {
+        incomingText(piece, portMAX_DELAY);
+        return;
+    }
+
+    // Join the pieces, read the whole line even if it does not fit
+    char * line = (char *) malloc(SERIAL_LINE_MAX + 1);
+    bool fits = line != NULL;
+    size_t len = 0;
+    while (true) {
+        size_t n = strlen(piece);
+        if (fits && len + n <= SERIAL_LINE_MAX) {
+            memcpy(line + len, piece, n);
+            len += n;
+        } else {
+            fits = false;
+        }
+        if (!more) {
+            break;
+        }
+        serialReadPiece(piece, sizeof(piece), &more);
+    }
+
+    if (fits) {
+        line[len] = '\0';
+        incomingText(line, portMAX_DELAY);
+    } else {
+        multiPrintf("DISCARDED INPUT: Line too long (max %u chars).\n", SERIAL_LINE_MAX);
+    }
+    free(line);
+}
@@ -0,0 +1,106 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <sys/stat.h>
+
+#include "storage.h"
+
+#ifdef STORAGE_LITTLEFS
+#if __has_include(<LittleFS.h>)
+#include <LittleFS.h>       // Arduino core 2.x
+#define STORAGE_FS LittleFS
+#else
+#include <LITTLEFS.h>       // lorol/LittleFS_esp32 on Arduino core 1.x
+#define STORAGE_FS LITTLEFS
+#endif
+#else
+#include <SPIFFS.h>
+#define STORAGE_FS SPIFFS
+#endif
+
+
+fs::FS & storage = STORAGE_FS;
+
+/**
+ * Storage file path
+ * 
+ * Returns full path of file met walking a directory.
+ */
+const char * storageFilePath(fs::File & file) {
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 2
+    return file.path();
+#else
+    // Core 1.x names files by full path
+    return file.name();
+#endif
+}
+
+/**
+ * Storage begin
+ * 
+ * Mount the filesystem. Returns false on failure.
+ */
+bool storageBegin() {
+    return STORAGE_FS.begin();
+}
+
+/**
+ * Storage info
+ * 
+ * Get filesystem size and used space in bytes.
+ */
+void storageInfo(size_t * total, size_t * used) {
+    *total = STORAGE_FS.totalBytes();
+    *used = STORAGE_FS.usedBytes();
+}
+
+/**
+ * Storage VFS path
+ * 
+ * Prepend mount point to `path` for C stdio into `buf` (STORAGE_VFS_PATH bytes).
+ * Returns false if the path is too long.
+ */
+bool storageVfsPath(char * buf, const char * path) {
+    if (strlen(path) >= STORAGE_PATH) {
+        return false;
+    }
+    strcpy(buf, STORAGE_MOUNT);
+    strcat(buf, path);
+    return true;
+}
+
+/**
+ * Storage make parents
+ * 
+ * Create directories leading to `path` (nothing to do on flat SPIFFS).
+ */
+void storageMakeParents(const char * path) {
+#ifdef STORAGE_LITTLEFS
+    char vfsPath[STORAGE_VFS_PATH];
+    if (!storageVfsPath(vfsPath, path)) {
+        return;
+    }
+
+    // Cut the path at each separator after the root one, existing directories fail harmlessly
+    for (char * sep = vfsPath + sizeof(STORAGE_MOUNT); (sep = strchr(sep, '/')); sep++) {
+        *sep = '\0';
+        mkdir(vfsPath, 0775);
+        *sep = '/';
+    }
+#endif
+}
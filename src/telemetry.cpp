@@ -0,0 +1,106 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "telemetry.h"
+#include "webserver.h"
+#include "wsframe.h"
+
+
+// Samples sent per stream (free-running), sent as message ID to reveal gaps
+static uint32_t tlmSequence[TLM_STREAMS];
+static volatile uint32_t tlmDrops = 0;
+
+// Sample sizes by type
+static const uint8_t tlmSizes[] = {4, 1, 8};
+
+/**
+ * Telemetry frame
+ * 
+ * Take a free frame, waiting up to TLM_WAIT_MS for CLI output
+ * and other telemetry to be sent.
+ */
+static char * telemetryFrame() {
+    TickType_t start = xTaskGetTickCount();
+    char * frame;
+    while (!(frame = wsFrameAcquire(false))) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(TLM_WAIT_MS)) {
+            return NULL;
+        }
+        vTaskDelay(1);
+    }
+    return frame;
+}
+
+/**
+ * Telemetry send
+ * 
+ * Send samples to every client using binary protocol.
+ */
+bool telemetrySend(uint8_t stream, uint8_t type, const void * data, size_t count) {
+    if (stream >= TLM_STREAMS || type >= sizeof(tlmSizes)) {
+        return false;
+    }
+    size_t size = tlmSizes[type];
+    size_t perFrame = (WS_FRAME_SIZE - TLM_OFFSET) / size;
+    uint32_t sequence = tlmSequence[stream];
+    tlmSequence[stream] += count;
+
+    uint32_t ids[WS_MAX_CLIENTS];
+    size_t clients = wsBinaryClients(ids, WS_MAX_CLIENTS);
+    uint32_t dropped = 0;
+
+    for (size_t i = 0; i < clients; i++) {
+        const uint8_t * samples = (const uint8_t *) data;
+        size_t left = count;
+        while (left > 0) {
+            size_t n = left < perFrame ? left : perFrame;
+            char * frame = telemetryFrame();
+            if (!frame) {
+                // Client too slow, drop the rest for it
+                dropped += left;
+                break;
+            }
+
+            // [header] [stream] [type] [reserved] [samples]
+            wsBinaryHeader((uint8_t *) frame, WSB_TELEMETRY, sequence + (count - left));
+            frame[WSB_HEADER] = stream;
+            frame[WSB_HEADER + 1] = type;
+            frame[WSB_HEADER + 2] = 0;
+            memcpy(frame + TLM_OFFSET, samples, n * size);
+            if (!wsFrameSend(ids[i], frame, TLM_OFFSET + n * size, true)) {
+                // Client went away
+                break;
+            }
+            samples += n * size;
+            left -= n;
+        }
+    }
+
+    tlmDrops += dropped;
+    return dropped == 0;
+}
+
+/**
+ * Telemetry drops
+ * 
+ * Returns the number of samples dropped (per client) since boot.
+ */
+uint32_t telemetryDrops() {
+    return tlmDrops;
+}
@@ -0,0 +1,393 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <rom/crc.h>
+
+#include "fileindex.h"
+#include "io.h"
+#include "storage.h"
+#include "upload.h"
+#include "webserver.h"
+
+
+// Request handed from the network to the writer
+enum {
+    UPLOAD_WRITE,       // Write block
+    UPLOAD_KEEP,        // Close file, keep it for resuming
+    UPLOAD_REMOVE,      // Close and remove incomplete file
+    UPLOAD_FINISH       // Close, verify and report complete file
+};
+struct uploadBlock {
+    uint8_t op;
+    uint16_t len;       // Bytes to write
+    uint8_t * data;     // Static buffer or heap block (freed once written)
+};
+
+static uint8_t uploadBufs[UPLOAD_BUFFERS][UPLOAD_BLOCK];
+static QueueHandle_t uploadFull = NULL;         // Requests to the writer
+static QueueHandle_t uploadFree = NULL;         // Static buffers free to fill
+static SemaphoreHandle_t uploadExtra = NULL;    // Heap blocks still allowed
+
+// Active or suspended upload
+static struct {
+    char path[UPLOAD_PATH_LEN];
+    File file;              // Closed by the writer
+    volatile bool open;     // File is open, cleared by the writer once closed
+    bool active;            // Receiving data
+    volatile bool suspended;    // Interrupted, may be resumed
+    bool verify;            // Check CRC-32 when complete
+    uint32_t size;
+    uint32_t crc;           // Expected CRC-32
+    uint32_t received;      // Bytes received, next offset expected
+    uint32_t start;         // Offset this session started at
+    int64_t startTime;      // Session start (esp_timer, us)
+    uint8_t * fill;         // Block being filled, NULL if none
+    uint16_t fillLen;
+    // Result of finished upload goes to
+    uploadReport report;
+    uint32_t reportClient;
+    uint32_t reportId;
+    // Updated by the writer
+    volatile bool failed;
+    volatile uint32_t written;
+    volatile uint32_t crcWritten;
+} up;
+
+/**
+ * Upload return block
+ * 
+ * Put written (or dropped) block back: static buffer to the free queue,
+ * heap block to heap.
+ */
+static void uploadReturnBlock(uint8_t * data) {
+    if (data >= (uint8_t *) uploadBufs && data < (uint8_t *) (uploadBufs + UPLOAD_BUFFERS)) {
+        xQueueSend(uploadFree, &data, 0);
+    } else {
+        free(data);
+        xSemaphoreGive(uploadExtra);
+    }
+}
+
+/**
+ * Upload writer close
+ * 
+ * Close the file at the end of upload as requested by `op`.
+ * Returns WSB_* status.
+ */
+static uint8_t uploadWriterClose(uint8_t op) {
+    up.file.close();
+    if (op == UPLOAD_KEEP) {
+        up.suspended = !up.failed;
+        return WSB_OK;
+    }
+
+    uint8_t status = WSB_OK;
+    if (op == UPLOAD_REMOVE || up.failed || up.written != up.size) {
+        status = WSB_FAILED;
+    } else if (up.verify && up.crcWritten != up.crc) {
+        status = WSB_CORRUPT;
+    }
+    if (status != WSB_OK) {
+        storage.remove(up.path);
+    }
+    fileIndexUpdate(up.path);
+    return status;
+}
+
+/**
+ * Upload writer loop
+ * 
+ * Write filled blocks to the file and compute CRC-32 of what is written.
+ * Flash erase and write run here, not in the network task. The file is
+ * closed here too, after its last block.
+ */
+static void uploadWriterLoop(void * pvParameter) {
+    struct uploadBlock b;
+    while (true) {
+        xQueueReceive(uploadFull, &b, portMAX_DELAY);
+        if (b.op == UPLOAD_WRITE) {
+            if (!up.failed) {
+                if (up.file.write(b.data, b.len) == b.len) {
+                    up.crcWritten = crc32_le(up.crcWritten, b.data, b.len);
+                    up.written += b.len;
+                } else {
+                    up.failed = true;
+                }
+            }
+            uploadReturnBlock(b.data);
+            continue;
+        }
+
+        uint8_t status = uploadWriterClose(b.op);
+        if (b.op == UPLOAD_FINISH && up.report) {
+            up.report(status, up.received - up.start,
+                      (esp_timer_get_time() - up.startTime) / 1000,
+                      up.reportClient, up.reportId);
+        }
+        // Next upload may start now
+        up.open = false;
+    }
+}
+
+/**
+ * Upload hand over
+ * 
+ * Queue request to the writer. The queue holds every block and one end
+ * request, so it never waits.
+ */
+static void uploadHandOver(uint8_t op, uint8_t * data, uint16_t len) {
+    struct uploadBlock b = {op, len, data};
+    xQueueSend(uploadFull, &b, 0);
+}
+
+/**
+ * Upload take block
+ * 
+ * Get a block to fill: a static buffer once written, waiting up to
+ * UPLOAD_WAIT_MS for it, or a heap block while flash falls behind.
+ * Returns NULL if none is available.
+ */
+static uint8_t * uploadTakeBlock() {
+    uint8_t * data;
+    if (xQueueReceive(uploadFree, &data, pdMS_TO_TICKS(UPLOAD_WAIT_MS)) == pdTRUE) {
+        return data;
+    }
+    if (xSemaphoreTake(uploadExtra, 0) != pdTRUE) {
+        return NULL;
+    }
+    data = (uint8_t *) malloc(UPLOAD_BLOCK);
+    if (!data) {
+        xSemaphoreGive(uploadExtra);
+    }
+    return data;
+}
+
+/**
+ * Upload end
+ * 
+ * Stop receiving and have the writer close the file as requested by `op`.
+ */
+static void uploadEnd(uint8_t op) {
+    if (up.fill) {
+        uploadReturnBlock(up.fill);
+        up.fill = NULL;
+    }
+    up.active = false;
+    up.suspended = (op == UPLOAD_KEEP);
+    uploadHandOver(op, NULL, 0);
+}
+
+/**
+ * Upload abandon
+ * 
+ * Stop active upload, the writer removes the incomplete file.
+ */
+static void uploadAbandon() {
+    if (!up.active) {
+        return;
+    }
+    uploadEnd(UPLOAD_REMOVE);
+}
+
+/**
+ * Upload init
+ * 
+ * Create the task writing uploaded files to flash.
+ */
+void uploadInit() {
+    uploadFull = xQueueCreate(UPLOAD_BUFFERS + UPLOAD_EXTRA + 1, sizeof(struct uploadBlock));
+    uploadFree = xQueueCreate(UPLOAD_BUFFERS, sizeof(uint8_t *));
+    uploadExtra = xSemaphoreCreateCounting(UPLOAD_EXTRA, UPLOAD_EXTRA);
+    for (int b = 0; b < UPLOAD_BUFFERS; b++) {
+        uint8_t * data = uploadBufs[b];
+        xQueueSend(uploadFree, &data, 0);
+    }
+    xTaskCreate(&uploadWriterLoop, UPLOAD_TASK_NAME, 3072, NULL, 2, NULL);
+}
+
+/**
+ * Upload resumable
+ * 
+ * Returns true if an interrupted upload of the same file is pending.
+ */
+static bool uploadResumable(const char * path, uint32_t size, uint32_t crc) {
+    return up.suspended && !up.open && !strcmp(up.path, path) &&
+           up.size == size && up.crc == crc;
+}
+
+/**
+ * Upload begin
+ * 
+ * Start (or resume) upload of file.
+ */
+uint8_t uploadBegin(const char * path, uint32_t size, uint32_t crc, bool verify, bool resume,
+                    uint32_t * offset) {
+    *offset = 0;
+    if (!uploadFull || strlen(path) >= UPLOAD_PATH_LEN) {
+        return WSB_FAILED;
+    }
+    uploadAbandon();
+
+    // Writer still owns the previous file
+    if (up.open) {
+        multiPrintf("Upload error: \"%s\" is still being written, try again.\n", up.path);
+        return WSB_FAILED;
+    }
+
+    // Continue interrupted upload of the same file after its last whole block
+    if (resume && uploadResumable(path, size, crc) && up.verify == verify) {
+        up.suspended = false;
+        up.file = storage.open(path, FILE_APPEND);
+        if (up.file && up.file.size() == up.written) {
+            up.open = true;
+            up.active = true;
+            up.received = up.start = up.written;
+            up.startTime = esp_timer_get_time();
+            *offset = up.written;
+            return WSB_OK;
+        }
+        up.file.close();
+    }
+    up.suspended = false;
+
+    // Replace file with an empty one
+    if (!removeFile(path)) {
+        return WSB_PROTECTED;
+    }
+    storageMakeParents(path);
+    up.file = storage.open(path, FILE_WRITE);
+    if (!up.file) {
+        multiPrintf("Upload error: failed to open file \"%s\" for writing.\n", path);
+        return WSB_FAILED;
+    }
+    strlcpy(up.path, path, sizeof(up.path));
+    up.open = true;
+    up.active = true;
+    up.verify = verify;
+    up.size = size;
+    up.crc = crc;
+    up.received = up.start = 0;
+    up.startTime = esp_timer_get_time();
+    up.failed = false;
+    up.written = 0;
+    up.crcWritten = 0;
+    return WSB_OK;
+}
+
+/**
+ * Upload write
+ * 
+ * Copy received data into blocks, full blocks go to the writer.
+ */
+bool uploadWrite(uint32_t offset, const uint8_t * data, size_t len) {
+    if (!up.active || up.failed || offset != up.received || len > up.size - up.received) {
+        // Rest of the messages of a suspended upload is refused quietly
+        if (up.active || !up.suspended) {
+            multiPrintf("Upload error: unexpected data for \"%s\"\n", up.path);
+        }
+        uploadAbandon();
+        return false;
+    }
+
+    while (len) {
+        if (!up.fill) {
+            up.fill = uploadTakeBlock();
+            up.fillLen = 0;
+            if (!up.fill) {
+                // Whole written blocks are kept, the client resumes after them
+                multiPrintf("Upload error: flash cannot keep up with \"%s\", suspended.\n",
+                            up.path);
+                uploadEnd(UPLOAD_KEEP);
+                return false;
+            }
+        }
+
+        size_t n = min(len, (size_t) (UPLOAD_BLOCK - up.fillLen));
+        memcpy(up.fill + up.fillLen, data, n);
+        up.fillLen += n;
+        up.received += n;
+        data += n;
+        len -= n;
+
+        // Hand over whole blocks (and the tail of the file)
+        if (up.fillLen == UPLOAD_BLOCK || up.received == up.size) {
+            uploadHandOver(UPLOAD_WRITE, up.fill, up.fillLen);
+            up.fill = NULL;
+        }
+    }
+    return true;
+}
+
+/**
+ * Upload complete
+ * 
+ * Returns true once all bytes of the active upload have been received.
+ */
+bool uploadComplete() {
+    return up.active && up.received == up.size;
+}
+
+/**
+ * Upload finish
+ * 
+ * Have the writer close the file once written and verify it.
+ */
+void uploadFinish(uploadReport report, uint32_t client, uint32_t id) {
+    if (!up.active) {
+        report(WSB_FAILED, 0, 0, client, id);
+        return;
+    }
+    up.report = report;
+    up.reportClient = client;
+    up.reportId = id;
+    uploadEnd(UPLOAD_FINISH);
+}
+
+/**
+ * Upload suspend
+ * 
+ * Keep whole written blocks of interrupted upload for resuming.
+ */
+void uploadSuspend() {
+    if (!up.active) {
+        return;
+    }
+    // Partial block is sent again on resume, so that writes stay aligned
+    uploadEnd(UPLOAD_KEEP);
+}
+
+/**
+ * Upload resume offset
+ * 
+ * Returns the offset an upload would resume from, 0 if it would start over.
+ */
+uint32_t uploadResumeOffset(const char * path, uint32_t size, uint32_t crc) {
+    return uploadResumable(path, size, crc) ? up.written : 0;
+}
+
+/**
+ * Upload path
+ * 
+ * Returns path of the active or suspended upload.
+ */
+const char * uploadPath() {
+    return up.path;
+}
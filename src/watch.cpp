@@ -0,0 +1,364 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#include "atlast-1.2-esp32/atlast.h"
+#include "atlast-task.h"
+#include "watch.h"
+#include "webserver.h"
+#include "wsframe.h"
+
+
+// Watch set of a client, slot is free if client is 0
+struct watchSet {
+    uint32_t client;
+    bool binary;
+    bool pending;                   // Names wait for the interpreter to look them up
+    uint8_t count;
+    TickType_t interval;
+    TickType_t due;                 // Next sampling time
+    atl_int * addr[WATCH_VARS];     // NULL if name is unknown
+    atl_int last[WATCH_VARS];       // Last value sent
+    uint32_t sent;                  // Bit per variable: value was sent
+    char names[WATCH_NAMES + 1];    // Names to look up while pending
+};
+
+static struct watchSet watchSets[WS_MAX_CLIENTS];
+// Lock of watch sets. A semaphore rather than a mutex, so that the lock
+// of a deleted ATLAST task can be released.
+static SemaphoreHandle_t watchSemaphore = NULL;
+static volatile TaskHandle_t watchOwner = NULL;
+static TaskHandle_t watchTaskHandle = NULL;
+
+/**
+ * Watch lock
+ * 
+ * Take the lock of watch sets.
+ */
+static void watchLock() {
+    xSemaphoreTake(watchSemaphore, portMAX_DELAY);
+    watchOwner = xTaskGetCurrentTaskHandle();
+}
+
+/**
+ * Watch unlock
+ * 
+ * Release the lock taken by watchLock().
+ */
+static void watchUnlock() {
+    watchOwner = NULL;
+    xSemaphoreGive(watchSemaphore);
+}
+
+/**
+ * Watch delta
+ * 
+ * Write changed values of watch set into frame and mark them sent.
+ * Binary: [index, byte] [value, int32 LE]...
+ * JSON: {"type":"watch","index":[...],"value":[...]}
+ * Returns message length, 0 if nothing changed.
+ */
+static size_t watchDelta(struct watchSet * w, char * frame) {
+    uint8_t changed[WATCH_VARS];
+    atl_int values[WATCH_VARS];
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < w->count; i++) {
+        if (!w->addr[i]) {
+            continue;
+        }
+        // Aligned cell reads are atomic, the interpreter is not stopped
+        atl_int v = *w->addr[i];
+        if (!(w->sent & (1UL << i)) || v != w->last[i]) {
+            changed[n] = i;
+            values[n++] = v;
+        }
+    }
+    if (!n) {
+        return 0;
+    }
+
+    size_t len;
+    if (w->binary) {
+        wsBinaryHeader((uint8_t *) frame, WSB_WATCH, 0);
+        len = WSB_HEADER;
+        for (uint8_t j = 0; j < n; j++) {
+            int32_t v = values[j];
+            frame[len++] = changed[j];
+            memcpy(frame + len, &v, sizeof(v));
+            len += sizeof(v);
+        }
+    } else {
+        JsonWriter json(frame, WS_FRAME_SIZE);
+        json.beginObject();
+        json.addString("type", "watch");
+        json.beginArray("index");
+        for (uint8_t j = 0; j < n; j++) {
+            json.addInt(NULL, changed[j]);
+        }
+        json.endArray();
+        json.beginArray("value");
+        for (uint8_t j = 0; j < n; j++) {
+            json.addInt(NULL, values[j]);
+        }
+        json.endArray();
+        json.endObject();
+        len = json.length();
+    }
+
+    for (uint8_t j = 0; j < n; j++) {
+        w->last[changed[j]] = values[j];
+        w->sent |= 1UL << changed[j];
+    }
+    return len;
+}
+
+/**
+ * Watch loop
+ * 
+ * Sample watched variables when due and push changed values.
+ * Sleeps while nothing is watched.
+ */
+static void watchLoop(void * pvParameter) {
+    while (true) {
+        bool active = false;
+        TickType_t now = xTaskGetTickCount();
+
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            watchLock();
+            struct watchSet * w = &watchSets[i];
+            if (!w->client || w->pending) {
+                watchUnlock();
+                continue;
+            }
+            active = true;
+            if ((int32_t) (now - w->due) < 0) {
+                watchUnlock();
+                continue;
+            }
+
+            // Values are marked sent only once a frame is available,
+            // so a skipped round is caught up in the next one
+            char * frame = wsFrameAcquire(false);
+            size_t len = 0;
+            if (frame) {
+                len = watchDelta(w, frame);
+                w->due = now + w->interval;
+            }
+            uint32_t client = w->client;
+            bool binary = w->binary;
+            watchUnlock();
+
+            if (len) {
+                wsFrameSend(client, frame, len, binary);
+            } else if (frame) {
+                wsFrameRelease(frame);
+            }
+        }
+
+        if (active) {
+            vTaskDelay(pdMS_TO_TICKS(WATCH_MIN_MS));
+        } else {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+}
+
+/**
+ * Watch begin
+ * 
+ * Create the task sampling watched variables.
+ */
+void watchBegin() {
+    watchSemaphore = xSemaphoreCreateCounting(1, 1);
+    // Low priority on the core not running ATLAST
+    xTaskCreatePinnedToCore(&watchLoop,
+                            WATCH_TASK_NAME,
+                            3072,   // Stack size
+                            NULL,
+                            1,      // Priority
+                            &watchTaskHandle,
+                            1 - ATL_CORE);  // The other core
+}
+
+/**
+ * Watch subscribe
+ * 
+ * Replace watch set of client with variables named in `names`,
+ * looked up later by the interpreter task.
+ */
+bool watchSubscribe(uint32_t client, const char * names, uint32_t intervalMs, bool binary) {
+    if (intervalMs < WATCH_MIN_MS) {
+        intervalMs = WATCH_MIN_MS;
+    }
+
+    watchLock();
+    struct watchSet * w = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (watchSets[i].client == client) {
+            w = &watchSets[i];
+            break;
+        } else if (!w && !watchSets[i].client) {
+            w = &watchSets[i];
+        }
+    }
+    if (w) {
+        w->client = client;
+        w->binary = binary;
+        w->pending = true;
+        w->count = 0;
+        w->interval = pdMS_TO_TICKS(intervalMs);
+        strncpy(w->names, names, WATCH_NAMES);
+        w->names[WATCH_NAMES] = '\0';
+    }
+    watchUnlock();
+
+    // Dictionary belongs to the interpreter (FORGET frees its names)
+    if (w && !atlastWatchResolve()) {
+        watchRemove(client);
+        return false;
+    }
+    return w != NULL;
+}
+
+/**
+ * Watch resolve
+ * 
+ * Look up names of subscribed watch sets and acknowledge them.
+ * Call on the interpreter task only, the dictionary is not locked.
+ */
+void watchResolve() {
+    bool active = false;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        char missing[WATCH_NAMES + 1];
+        size_t missingLen = 0;
+        missing[0] = '\0';
+
+        watchLock();
+        struct watchSet * w = &watchSets[i];
+        if (!w->client || !w->pending) {
+            watchUnlock();
+            continue;
+        }
+        uint8_t count = 0;
+        char * save;
+        for (char * name = strtok_r(w->names, " ", &save); name && count < WATCH_VARS;
+             name = strtok_r(NULL, " ", &save)) {
+            w->addr[count] = atl_varaddr(name);
+            if (!w->addr[count]) {
+                missingLen += snprintf(missing + missingLen, WATCH_NAMES + 1 - missingLen,
+                                       missingLen ? " %s" : "%s", name);
+                missingLen = min(missingLen, (size_t) WATCH_NAMES);
+            }
+            count++;
+        }
+        uint32_t client = w->client;
+        // Empty set unsubscribes
+        w->client = count ? client : 0;
+        w->pending = false;
+        w->count = count;
+        w->due = xTaskGetTickCount();
+        w->sent = 0;
+        active |= count > 0;
+        watchUnlock();
+
+        // Unknown names are reported, known ones are watched anyway
+        wsSendAckTo(client, "watch", missing[0] ? "unknown" : "ok", missing);
+    }
+
+    if (active) {
+        xTaskNotifyGive(watchTaskHandle);
+    }
+}
+
+/**
+ * Watch cancel
+ * 
+ * Drop subscribed watch sets whose lookup was discarded (killed program).
+ */
+void watchCancel() {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        watchLock();
+        uint32_t client = watchSets[i].pending ? watchSets[i].client : 0;
+        if (client) {
+            watchSets[i].client = 0;
+            watchSets[i].pending = false;
+        }
+        watchUnlock();
+
+        if (client) {
+            wsSendAckTo(client, "watch", "failed", "");
+        }
+    }
+}
+
+/**
+ * Watch drop all
+ * 
+ * Drop all watch sets once watched variables may be gone (FORGET,
+ * interpreter restart) and tell their clients.
+ */
+void watchDropAll() {
+    if (!watchSemaphore) {
+        return;
+    }
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        watchLock();
+        uint32_t client = watchSets[i].client;
+        watchSets[i].client = 0;
+        watchSets[i].pending = false;
+        watchUnlock();
+
+        if (client) {
+            wsSendAckTo(client, "watch", "dropped", "");
+        }
+    }
+}
+
+/**
+ * Watch unlock task
+ * 
+ * Release the lock of watch sets if it is held by `task` (deleted while
+ * holding it).
+ */
+void watchUnlockTask(TaskHandle_t task) {
+    if (watchSemaphore && task && watchOwner == task) {
+        watchUnlock();
+    }
+}
+
+/**
+ * Watch remove
+ * 
+ * Drop watch set of client.
+ */
+void watchRemove(uint32_t client) {
+    if (!watchSemaphore) {
+        return;
+    }
+    watchLock();
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (watchSets[i].client == client) {
+            watchSets[i].client = 0;
+            watchSets[i].pending = false;
+        }
+    }
+    watchUnlock();
+}
@@ -15,25 +15,157 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <ESPmDNS.h>
-#include <SPIFFS.h>
 
+#include "assets.h"
 #include "atlast-task.h"
+#include "fileindex.h"
 #include "io.h"
+#include "outring.h"
+#include "scan.h"
+#include "storage.h"
+#include "upload.h"
+#include "watch.h"
 #include "webserver.h"
+#include "wsframe.h"
 
 
 // Webserver globals
 AsyncWebServer server(80);
 AsyncWebSocket ws("/ws");
-AsyncWebSocketClient* currentClient;
+AssetsHandler assetsHandler;
+AsyncWebSocketClient* currentClient;   // Client whose message is handled
 
-// Outgoing CLI text buffer and mutex
-std::string wsOutString;
-SemaphoreHandle_t wsOutMutex = xSemaphoreCreateMutex();
+// Connected clients, slot is free if ID is 0
+struct wsClientState wsClients[WS_MAX_CLIENTS];
+portMUX_TYPE wsClientsMux = portMUX_INITIALIZER_UNLOCKED;
 
+// Output shared by all clients, each reads at its own cursor
+// (written by the CLI output task only)
+char wsFanout[WS_FANOUT_SIZE];
+volatile uint32_t wsFanoutHead = 0;    // Bytes written in total (free-running)
+
+// Outgoing CLI text chunk read from output ring
+char wsOutChunk[WS_OUT_CHUNK];
+// Task sending CLI output, notified when output is committed
+TaskHandle_t wsCliTaskHandle = nullptr;
+
+
+/**
+ * Client find
+ * 
+ * Returns state of client with ID, NULL if not connected.
+ */
+static struct wsClientState * wsClientFind(uint32_t id) {
+    for (int i = 0; id && i < WS_MAX_CLIENTS; i++) {
+        if (wsClients[i].id == id) {
+            return &wsClients[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Client binary
+ * 
+ * Look up whether client with ID uses binary protocol (from any task).
+ * Returns false if the client is not connected.
+ */
+static bool wsClientBinary(uint32_t id, bool * binary) {
+    portENTER_CRITICAL(&wsClientsMux);
+    struct wsClientState * c = wsClientFind(id);
+    if (c) {
+        *binary = c->binary;
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+    return c != NULL;
+}
+
+/**
+ * Send literal
+ * 
+ * Send constant JSON text to client.
+ */
+static void wsSendLiteral(uint32_t id, const char * json) {
+    char * frame = wsFrameAcquire(true);
+    if (frame) {
+        size_t len = strlen(json);
+        memcpy(frame, json, len);
+        wsFrameSend(id, frame, len, false);
+    }
+}
+
+/**
+ * Send role
+ * 
+ * Notify client of its role.
+ */
+static void wsSendRole(uint32_t id, uint8_t role) {
+    wsSendLiteral(id, role == WS_CONTROLLER ?
+        "{\"type\":\"role\",\"role\":\"controller\"}" :
+        "{\"type\":\"role\",\"role\":\"observer\"}");
+}
+
+/**
+ * Client add
+ * 
+ * Register new client, the first one becomes controller.
+ * Returns false if all client slots are taken.
+ */
+static bool wsClientAdd(uint32_t id) {
+    struct wsClientState * c = NULL;
+
+    portENTER_CRITICAL(&wsClientsMux);
+    bool controlled = false;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        controlled |= wsClients[i].id && wsClients[i].role == WS_CONTROLLER;
+        if (!c && !wsClients[i].id) {
+            c = &wsClients[i];
+        }
+    }
+    if (c) {
+        memset(c, 0, sizeof(*c));
+        c->id = id;
+        c->role = controlled ? WS_OBSERVER : WS_CONTROLLER;
+        // Only output printed from now on
+        c->cursor = wsFanoutHead;
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+
+    if (c) {
+        wsSendRole(id, c->role);
+    }
+    return c != NULL;
+}
+
+/**
+ * Client remove
+ * 
+ * Release client slot, control passes to the oldest-slot observer.
+ */
+static void wsClientRemove(uint32_t id) {
+    uint32_t promoted = 0;
+
+    portENTER_CRITICAL(&wsClientsMux);
+    struct wsClientState * c = wsClientFind(id);
+    if (c) {
+        c->id = 0;
+        if (c->role == WS_CONTROLLER) {
+            for (int i = 0; i < WS_MAX_CLIENTS && !promoted; i++) {
+                if (wsClients[i].id) {
+                    wsClients[i].role = WS_CONTROLLER;
+                    promoted = wsClients[i].id;
+                }
+            }
+        }
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+
+    if (promoted) {
+        wsSendRole(promoted, WS_CONTROLLER);
+    }
+}
 
 /**
  * On websocket event
@@ -45,24 +177,33 @@ void onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventT
     switch(type) {
         // New client has connected
         case WS_EVT_CONNECT:
-            currentClient = client;
-
             // Notify serial CLI
             Serial.printf("[%u] Connection from ", client->id());
             Serial.println(client->remoteIP().toString());
+
+            // close oldest client at max clients
+            ws.cleanupClients(WS_MAX_CLIENTS);
+            if (!wsClientAdd(client->id())) {
+                client->close();
+                break;
+            }
+
             // Notify web CLI
-            client->text("{\"type\":\"cli\",\"data\":\"Websocket connection established.\"}");
+            wsSendLiteral(client->id(), "{\"type\":\"cli\",\"data\":\"Websocket connection established.\"}");
 
-            // Send SPIFFS file list (JSON array)
+            // Send file list (JSON array)
+            currentClient = client;
             wsSendFileList();
-
-            // close oldest client at max clients
-            ws.cleanupClients();
             break;
 
         // Client has disconnected
         case WS_EVT_DISCONNECT:
-            currentClient = nullptr;
+            if (currentClient == client) {
+                currentClient = nullptr;
+            }
+            incomingDisconnect(client->id());
+            watchRemove(client->id());
+            wsClientRemove(client->id());
 
             Serial.printf("[%u] Client disconnected.\n", client->id());
             break;
@@ -101,18 +242,48 @@ void parseReceived(void * arg, uint8_t * data, size_t len) {
     // Different uses of info->opcode and info->message_opcode:
     // https://github.com/me-no-dev/ESPAsyncWebServer#async-websocket-event
     AwsFrameInfo * info = (AwsFrameInfo*) arg;
+    bool whole = info->final && info->num == 0 && info->index == 0 && info->len == len;
+
+    // Observers can only query, in single-part messages
+    if (!wsIsController()) {
+        if (!whole) {
+            wsSendAck("role", "observer", "");
+        } else if (info->opcode == WS_TEXT && len <= 250) {
+            // Handled by JSON message type
+            incomingJson((char*) data);
+        } else if (info->opcode == WS_BINARY && wsIsBinary() &&
+                   len >= WSB_HEADER && data[0] == WSB_FILE_LIST) {
+            uint32_t id;
+            memcpy(&id, data + 1, sizeof(id));
+            wsSendFileList(id);
+        } else {
+            wsSendAck("role", "observer", "");
+        }
+        return;
+    }
 
     // Message is binary, either single- or multi-frame
     if (info->opcode == WS_BINARY ||
         (info->opcode == WS_CONTINUATION && info->message_opcode == WS_BINARY)) {
 
-        // Handle received data
-        incomingData(arg, data, len);
+        // Handle received data: binary protocol or raw upload data
+        if (wsIsBinary()) {
+            incomingBinary(arg, data, len);
+        } else {
+            incomingData(arg, data, len);
+        }
+        return;
+    }
+
+    // Run message (text source after header line), in any number of parts
+    if ((info->opcode == WS_TEXT ||
+         (info->opcode == WS_CONTINUATION && info->message_opcode == WS_TEXT)) &&
+        incomingTextRun(arg, data, len)) {
         return;
     }
 
     // Message is text (JSON), in a single frame, and this is all its data
-    if (info->opcode == WS_TEXT && info->final && info->index == 0 && info->len == len) {
+    if (info->opcode == WS_TEXT && whole) {
         // Verify input length (to protect statically allocated JSON deserializer)
         if (len > 250) {
             multiPrintf("DISCARDED INPUT: Too long (%u > 250).\n", len);
@@ -125,7 +296,7 @@ void parseReceived(void * arg, uint8_t * data, size_t len) {
     } else if (info->message_opcode == WS_TEXT) {
         // Message is fragmented
 
-        // Fragmented text data should never arrive with normal use
+        // Fragmented text data other than run messages is not supported
         multiPrintf("DISCARDED INPUT: Multi-frame text data received.\n");
     }
 }
@@ -144,136 +315,648 @@ void setupWebServer() {
     // Start server
     server.begin();
 
-    // Serve all files in SPIFFS
-    // Request to the root serves "www/index.html"
-    server.serveStatic("/", SPIFFS, "/").setDefaultFile("www/index.html");
-    // Redirect "/favicon.ico" to "/www/favicon.ico"
-    server.serveStatic("/favicon.ico", SPIFFS, "/www/favicon.ico");
+    // Serve web assets precompressed with cache validators
+    // Request to the root serves "www/index.html", "/favicon.ico" is "/www/favicon.ico"
+    assetsIndex();
+    server.addHandler(&assetsHandler);
+    // Serve all other files in storage
+    server.serveStatic("/", storage, "/");
 
     // Start mDNS responder with "esp" hostname (esp.local)
     MDNS.begin("esp");
 
     // Start the task handling websocket CLI output
-    xTaskCreate(&wsSendCliLoop, "ws_cli_out", 8196, NULL, 5, NULL);
+    xTaskCreate(&wsSendCliLoop, "ws_cli_out", 8196, NULL, 5, &wsCliTaskHandle);
+
+    // Start the task pushing watched variables
+    watchBegin();
+
+    // Start the task writing uploads to flash
+    uploadInit();
 }
 
 /**
  * Send text
  * 
  * Send CLI message JSON to the last connected websocket client.
- * Approximate max data length slightly below doc size (~4000).
+ * Data not fitting a frame (~4000 chars) is cut off.
  */
 void wsSendText(const char * data) {
-    if(currentClient && currentClient->status() == WS_CONNECTED) {
-        // Allocate JSON document and add elements
-        DynamicJsonDocument doc(4096);
-        doc["type"] = "cli";
-        doc["data"] = data;
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+
+    // Write JSON straight into the frame
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    json.beginObject();
+    json.addString("type", "cli");
+    json.addString("data", data, strlen(data));
+    json.endObject();
+
+    wsFrameSendJson(wsClientId(), frame, json);
+}
+
+/**
+ * Connected
+ * 
+ * Returns true if a websocket client is connected.
+ */
+bool wsConnected() {
+    return ws.count() > 0;
+}
 
-        // Serialize document into a buffer
-        String output;
-        serializeJson(doc, output);
+/**
+ * Client ID
+ * 
+ * Returns ID of the client whose message is handled, 0 if none.
+ */
+uint32_t wsClientId() {
+    return currentClient ? currentClient->id() : 0;
+}
 
-        // Send through websocket
-        currentClient->text(output);
+/**
+ * Is controller
+ * 
+ * Returns true if the client whose message is handled is the controller.
+ */
+bool wsIsController() {
+    struct wsClientState * c = wsClientFind(wsClientId());
+    return c && c->role == WS_CONTROLLER;
+}
+
+/**
+ * Is binary
+ * 
+ * Returns true if the client whose message is handled negotiated
+ * binary protocol.
+ */
+bool wsIsBinary() {
+    struct wsClientState * c = wsClientFind(wsClientId());
+    return c && c->binary;
+}
+
+/**
+ * Set binary
+ * 
+ * Switch protocol of the client whose message is handled.
+ */
+void wsSetBinary(bool binary) {
+    portENTER_CRITICAL(&wsClientsMux);
+    struct wsClientState * c = wsClientFind(wsClientId());
+    if (c) {
+        c->binary = binary;
     }
+    portEXIT_CRITICAL(&wsClientsMux);
+}
+
+/**
+ * Client IDs
+ * 
+ * Copy IDs of connected clients and whether they use binary protocol.
+ */
+size_t wsClientIds(uint32_t * ids, bool * binary, size_t max) {
+    size_t n = 0;
+    portENTER_CRITICAL(&wsClientsMux);
+    for (int i = 0; i < WS_MAX_CLIENTS && n < max; i++) {
+        if (wsClients[i].id) {
+            binary[n] = wsClients[i].binary;
+            ids[n++] = wsClients[i].id;
+        }
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+    return n;
+}
+
+/**
+ * Binary clients
+ * 
+ * Copy IDs of connected clients using binary protocol into `ids`.
+ */
+size_t wsBinaryClients(uint32_t * ids, size_t max) {
+    size_t n = 0;
+    portENTER_CRITICAL(&wsClientsMux);
+    for (int i = 0; i < WS_MAX_CLIENTS && n < max; i++) {
+        if (wsClients[i].id && wsClients[i].binary) {
+            ids[n++] = wsClients[i].id;
+        }
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+    return n;
+}
+
+/**
+ * Request role
+ * 
+ * Make the client whose message is handled controller (taking over from
+ * the current one) or observer.
+ */
+void wsRequestRole(bool controller) {
+    uint32_t id = wsClientId();
+    uint32_t demoted = 0;
+
+    portENTER_CRITICAL(&wsClientsMux);
+    struct wsClientState * c = wsClientFind(id);
+    if (c && controller) {
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            if (wsClients[i].id && wsClients[i].id != id &&
+                wsClients[i].role == WS_CONTROLLER) {
+                wsClients[i].role = WS_OBSERVER;
+                demoted = wsClients[i].id;
+            }
+        }
+    }
+    if (c) {
+        c->role = controller ? WS_CONTROLLER : WS_OBSERVER;
+    }
+    portEXIT_CRITICAL(&wsClientsMux);
+
+    if (demoted) {
+        wsSendRole(demoted, WS_OBSERVER);
+    }
+    if (c) {
+        wsSendRole(id, c->role);
+    }
+}
+
+/**
+ * Notify output
+ * 
+ * Wake up the task sending CLI output. Callable from any task.
+ */
+void wsNotifyOutput() {
+    if (wsCliTaskHandle) {
+        xTaskNotifyGive(wsCliTaskHandle);
+    }
+}
+
+/**
+ * Binary header
+ * 
+ * Write binary protocol message header.
+ */
+void wsBinaryHeader(uint8_t * buf, uint8_t opcode, uint32_t id) {
+    buf[0] = opcode;
+    // ESP32 is little-endian
+    memcpy(buf + 1, &id, sizeof(id));
+}
+
+/**
+ * Fan-out fill
+ * 
+ * Move committed output from output ring into the fan-out ring.
+ * Clients falling behind skip output, only in output blocking mode is it
+ * held in the output ring for the controller (ATLAST waits for it).
+ * Returns true if output was moved.
+ */
+static bool wsFanoutFill() {
+    if (!wsConnected()) {
+        // If no client is connected, throw away buffered output
+        outRingRead(NULL, 0);
+        return false;
+    }
+
+    // Blocking mode: keep room for a whole chunk ahead of the controller
+    if (outputBlocking()) {
+        bool full = false;
+        portENTER_CRITICAL(&wsClientsMux);
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            full |= wsClients[i].id && wsClients[i].role == WS_CONTROLLER &&
+                    wsFanoutHead - wsClients[i].cursor > WS_FANOUT_SIZE - WS_OUT_CHUNK;
+        }
+        portEXIT_CRITICAL(&wsClientsMux);
+        if (full) {
+            return false;
+        }
+    }
+
+    size_t len = outRingRead(wsOutChunk, WS_OUT_CHUNK);
+    for (size_t i = 0; i < len; ) {
+        size_t pos = wsFanoutHead & (WS_FANOUT_SIZE - 1);
+        size_t n = min(len - i, (size_t) WS_FANOUT_SIZE - pos);
+        memcpy(wsFanout + pos, wsOutChunk + i, n);
+        wsFanoutHead += n;
+        i += n;
+    }
+    return len > 0;
+}
+
+/**
+ * Send CLI chunk
+ * 
+ * Send one chunk of fan-out ring at the cursor of a copy of client state.
+ * Returns WS_SENT, WS_PENDING if the client's queue is full (or no frame
+ * is free), or WS_IDLE.
+ */
+static int wsSendCliChunk(struct wsClientState * c) {
+    AsyncWebSocketClient * client = ws.client(c->id);
+    uint32_t backlog = wsFanoutHead - c->cursor;
+    if (!client || client->status() != WS_CONNECTED || !backlog) {
+        return WS_IDLE;
+    }
+
+    // Output overwritten before the client got it is lost
+    if (backlog > WS_FANOUT_SIZE) {
+        c->skipped += backlog - WS_FANOUT_SIZE;
+        c->cursor = wsFanoutHead - WS_FANOUT_SIZE;
+        backlog = WS_FANOUT_SIZE;
+    }
+    if (backlog > c->maxLag) {
+        c->maxLag = backlog;
+    }
+
+    // Client falls behind: let output accumulate into a larger message
+    if (client->queueIsFull()) {
+        return WS_PENDING;
+    }
+    char * frame = wsFrameAcquire(false);
+    if (!frame) {
+        return WS_PENDING;
+    }
+
+    // Contiguous part of the backlog, room for header
+    size_t pos = c->cursor & (WS_FANOUT_SIZE - 1);
+    size_t len = min((size_t) backlog, (size_t) WS_FANOUT_SIZE - pos);
+    len = min(len, (size_t) WS_FRAME_SIZE - WSB_HEADER);
+
+    if (c->binary) {
+        // Binary: send raw output after message header
+        wsBinaryHeader((uint8_t *) frame, WSB_OUTPUT, 0);
+        memcpy(frame + WSB_HEADER, wsFanout + pos, len);
+        wsFrameSend(c->id, frame, WSB_HEADER + len, true);
+    } else {
+        // JSON: as much output as fits the frame escaped
+        JsonWriter json(frame, WS_FRAME_SIZE);
+        json.beginObject();
+        json.addString("type", "cli");
+        len = json.addString("data", wsFanout + pos, len);
+        json.endObject();
+        wsFrameSendJson(c->id, frame, json);
+    }
+
+    c->cursor += len;
+    c->sent += len;
+    return WS_SENT;
 }
 
 /**
  * Send CLI loop
  * 
- * Loop to send wsOutString to the last connected websocket client.
+ * Loop to send output ring to all connected websocket clients.
  * Run in its own task.
  */
 void wsSendCliLoop(void * pvParameter) {
-    // Allocate JSON document to populate and send
-    DynamicJsonDocument doc(4096);
+    TickType_t lastSend = 0;
 
     while (true) {
-        // Wait 10ms
-        vTaskDelay(10 / portTICK_RATE_MS);
-
-        if(currentClient && currentClient->status() == WS_CONNECTED) {
-            // Client is connected, take mutex and check string buffer
-            xSemaphoreTake(wsOutMutex, portMAX_DELAY);
-            if (wsOutString.empty()) {
-                // Nothing to send
-                xSemaphoreGive(wsOutMutex);
-                continue;
+        // Sleep until output is committed
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Output keeps coming: batch it instead of a message per print,
+        // a single reply after idle time is sent at once
+        if (xTaskGetTickCount() - lastSend < pdMS_TO_TICKS(WS_OUT_BATCH_MS)) {
+            vTaskDelay(pdMS_TO_TICKS(WS_OUT_BATCH_MS));
+        }
+
+        // Send everything committed so far to every client
+        while (true) {
+            bool progress = wsFanoutFill();
+            bool pending = false;
+            for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+                // Send from a copy, the slot may be released and reused meanwhile
+                struct wsClientState c;
+                portENTER_CRITICAL(&wsClientsMux);
+                c = wsClients[i];
+                portEXIT_CRITICAL(&wsClientsMux);
+                if (!c.id) {
+                    continue;
+                }
+                int state = wsSendCliChunk(&c);
+                progress |= state == WS_SENT;
+                pending |= state == WS_PENDING;
+
+                // Store progress of the same client
+                portENTER_CRITICAL(&wsClientsMux);
+                if (wsClients[i].id == c.id) {
+                    wsClients[i].cursor = c.cursor;
+                    wsClients[i].sent = c.sent;
+                    wsClients[i].skipped = c.skipped;
+                    wsClients[i].maxLag = c.maxLag;
+                }
+                portEXIT_CRITICAL(&wsClientsMux);
             }
 
-            // Add elements to JSON document and clear string buffer
-            doc["type"] = "cli";            
-            doc["data"] = wsOutString;
-            wsOutString.clear();
-            
-            // Give back mutex
-            xSemaphoreGive(wsOutMutex);
+            if (progress) {
+                lastSend = xTaskGetTickCount();
+            } else if (pending) {
+                // Wait for send queues to drain
+                vTaskDelay(pdMS_TO_TICKS(WS_OUT_BACKOFF_MS));
+            } else {
+                break;
+            }
+        }
+    }
+}
 
-            // Serialize JSON document into a buffer and clear JSON doc
-            String output;
-            serializeJson(doc, output);
-            doc.clear();
+/**
+ * Send clients
+ * 
+ * Send list of connected clients with roles and output lag statistics JSON.
+ */
+void wsSendClients() {
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
 
-            // Send through websocket
-            currentClient->text(output);
-        } else {
-            // If no client is connected, throw away buffered output
-            xSemaphoreTake(wsOutMutex, portMAX_DELAY);
-            wsOutString.clear();
-            xSemaphoreGive(wsOutMutex);
+    // Write JSON straight into the frame
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    json.beginObject();
+    json.addString("type", "clients");
+    json.addInt("you", wsClientId());
+    json.addInt("mallocs", wsMallocs());
+    json.addInt("frameMisses", wsFrameMisses());
+    json.beginArray("clients");
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        // Copy, the CLI task updates output statistics meanwhile
+        struct wsClientState state;
+        portENTER_CRITICAL(&wsClientsMux);
+        state = wsClients[i];
+        portEXIT_CRITICAL(&wsClientsMux);
+        struct wsClientState * c = &state;
+        AsyncWebSocketClient * client = ws.client(c->id);
+        if (!c->id || !client) {
+            continue;
         }
+        IPAddress ip = client->remoteIP();
+        char ipText[16];
+        snprintf(ipText, sizeof(ipText), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+
+        json.beginObject();
+        json.addInt("id", c->id);
+        json.addString("ip", ipText);
+        json.addString("role", c->role == WS_CONTROLLER ? "controller" : "observer");
+        json.addBool("binary", c->binary);
+        json.addInt("sent", c->sent);
+        json.addInt("skipped", c->skipped);
+        json.addInt("lag", wsFanoutHead - c->cursor);
+        json.addInt("maxLag", c->maxLag);
+        json.endObject();
     }
+
+    json.endArray();
+    json.endObject();
+    wsFrameSendJson(wsClientId(), frame, json);
 }
 
+// File list being written into a frame
+struct fileListFrame {
+    char * frame;
+    size_t len;         // Binary message length
+    JsonWriter * json;  // NULL for binary
+};
+
 /**
- * Send file list
+ * File list add
  * 
- * Send file list JSON.
+ * Append indexed file to file list frame.
+ * Returns false once the frame is full.
  */
-void wsSendFileList() {
-    if(currentClient && currentClient->status() == WS_CONNECTED) {
-        // Allocate JSON document and add elements
-        DynamicJsonDocument doc(2048);
-        doc["type"] = "fileList";
-        JsonArray paths = doc.createNestedArray("paths");
+static bool fileListAdd(const struct fileEntry * entry, void * arg) {
+    struct fileListFrame * list = (struct fileListFrame *) arg;
+
+    if (!list->json) {
+        // [size, uint32] [path] \0
+        size_t n = strlen(entry->path) + 1;
+        if (list->len + sizeof(entry->size) + n > WS_FRAME_SIZE) {
+            return false;
+        }
+        memcpy(list->frame + list->len, &entry->size, sizeof(entry->size));
+        memcpy(list->frame + list->len + sizeof(entry->size), entry->path, n);
+        list->len += sizeof(entry->size) + n;
+        return true;
+    }
 
-        // Fill array with file paths
-        File root = SPIFFS.open("/");
-	    File file = root.openNextFile();
-        while(file) {
-            // Cast to non-const char* to force copy
-            paths.add((char*) file.name());
-            file = root.openNextFile();
-	    }
+    // [path, size], room is kept for the sequence number that follows the list
+    if (list->json->length() + 24 > WS_FRAME_SIZE) {
+        return false;
+    }
+    JsonWriter::Mark before = list->json->mark();
+    list->json->beginArray();
+    list->json->addString(NULL, entry->path);
+    list->json->addInt(NULL, entry->size);
+    list->json->endArray();
+    if (list->json->overflow()) {
+        // Drop the incomplete file, close the list
+        list->json->rewind(before);
+        return false;
+    }
+    return true;
+}
 
-        // Serialize document into a buffer
-        String output;
-        serializeJson(doc, output);
+/**
+ * Send file list
+ * 
+ * Send file index (paths and sizes) JSON, with sequence number of the
+ * last change pushed (see fileindex.h).
+ * Sent in binary with request ID if binary protocol is negotiated.
+ * Files not fitting a frame are left out.
+ */
+void wsSendFileList(uint32_t id) {
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+    struct fileListFrame list = {frame, WSB_HEADER + sizeof(uint32_t), NULL};
 
-        // Send through websocket
-        currentClient->text(output);
+    if (wsIsBinary()) {
+        wsBinaryHeader((uint8_t *) frame, WSB_FILE_LIST, id);
+        uint32_t seq = fileIndexEach(fileListAdd, &list);
+        memcpy(frame + WSB_HEADER, &seq, sizeof(seq));
+        wsFrameSend(wsClientId(), frame, list.len, true);
+        return;
     }
+
+    // Write JSON straight into the frame, sequence number goes last
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    list.json = &json;
+    json.beginObject();
+    json.addString("type", "fileList");
+    json.beginArray("files");
+    uint32_t seq = fileIndexEach(fileListAdd, &list);
+    json.endArray();
+    json.addInt("seq", seq);
+    json.endObject();
+    wsFrameSendJson(wsClientId(), frame, json);
 }
 
 /**
  * Send acknowledge
  * 
  * Send (negative-) acknowledge JSON for various requests.
+ * Transfers report `bytes` moved in `ms` and resulting throughput.
+ */
+void wsSendAck(const char * type, const char * status, const char * name,
+               uint32_t bytes, uint32_t ms) {
+    wsSendAckTo(wsClientId(), type, status, name, bytes, ms);
+}
+
+/**
+ * Send acknowledge to
+ * 
+ * Send acknowledge JSON to given client (from outside its message handler).
+ */
+void wsSendAckTo(uint32_t client, const char * type, const char * status, const char * name,
+                 uint32_t bytes, uint32_t ms) {
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+
+    // Write JSON straight into the frame
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    json.beginObject();
+    json.addString("type", type);
+    json.addString("status", status);
+    json.addString("name", name);
+    if (bytes) {
+        json.addInt("bytes", bytes);
+        json.addInt("ms", ms);
+        json.addInt("kBps", ms ? (uint64_t) bytes * 1000 / 1024 / ms : 0);
+    }
+    json.endObject();
+
+    wsFrameSendJson(client, frame, json);
+}
+
+/**
+ * Send binary
+ * 
+ * Send binary protocol message to the last connected websocket client
+ * (or to given client).
+ */
+void wsSendBinary(uint8_t opcode, uint32_t id, const char * payload, size_t len) {
+    wsSendBinaryTo(wsClientId(), opcode, id, payload, len);
+}
+
+void wsSendBinaryTo(uint32_t client, uint8_t opcode, uint32_t id, const char * payload,
+                    size_t len) {
+    if (!wsConnected() || WSB_HEADER + len > WS_FRAME_SIZE) {
+        return;
+    }
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+    wsBinaryHeader((uint8_t *) frame, opcode, id);
+    memcpy(frame + WSB_HEADER, payload, len);
+    wsFrameSend(client, frame, WSB_HEADER + len, true);
+}
+
+/**
+ * Send acknowledge binary
+ * 
+ * Send binary acknowledge of request with opcode and ID (to given client).
+ * Extra data (if any) follows the path after a null terminator.
  */
-void wsSendAck(const char * type, const char * status, const char * name) {
-    if(currentClient && currentClient->status() == WS_CONNECTED) {
-        // Allocate JSON document and add elements
-        StaticJsonDocument<128> doc;
-        doc["type"] = type;
-        doc["status"] = status;
-        doc["name"] = name;
+void wsSendAckBinary(uint8_t opcode, uint32_t id, uint8_t status, const char * path,
+                     const void * extra, size_t extraLen) {
+    wsSendAckBinaryTo(wsClientId(), opcode, id, status, path, extra, extraLen);
+}
 
-        // Serialize document into a buffer
-        String output;
-        serializeJson(doc, output);
+void wsSendAckBinaryTo(uint32_t client, uint8_t opcode, uint32_t id, uint8_t status,
+                       const char * path, const void * extra, size_t extraLen) {
+    char payload[2 + 32 + 1 + 16];
+    payload[0] = opcode;
+    payload[1] = status;
+    size_t len = 2 + strnlen(path, 32);
+    memcpy(payload + 2, path, len - 2);
+    if (extra && extraLen <= 16) {
+        payload[len++] = '\0';
+        memcpy(payload + len, extra, extraLen);
+        len += extraLen;
+    }
+    wsSendBinaryTo(client, WSB_ACK, id, payload, len);
+}
 
-        // Send through websocket
-        currentClient->text(output);
+/**
+ * Send result
+ * 
+ * Send structured result JSON (or binary) of a command submitted with ID
+ * to the submitting client. Depth is -1 if the command was not evaluated,
+ * `truncated` is set if output did not fit the capture buffer.
+ */
+void wsSendResult(uint32_t clientId, uint32_t id, int status, const char * text,
+                  size_t textLen, long depth, int64_t duration, bool truncated) {
+    AsyncWebSocketClient * client = ws.client(clientId);
+    bool binary;
+    if (!client || !wsClientBinary(clientId, &binary) || client->status() != WS_CONNECTED) {
+        return;
     }
-}
\ No newline at end of file
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+
+    if (binary) {
+        // Fixed fields followed by raw output
+        int32_t fields[3] = {status, (int32_t) depth, (int32_t) duration};
+        uint8_t * payload = (uint8_t *) frame + WSB_HEADER;
+        size_t len = min(textLen, WS_FRAME_SIZE - WSB_HEADER - sizeof(fields) - 1);
+        wsBinaryHeader((uint8_t *) frame, WSB_RESULT, id);
+        memcpy(payload, fields, sizeof(fields));
+        payload[sizeof(fields)] = truncated || len < textLen;
+        memcpy(payload + sizeof(fields) + 1, text, len);
+        wsFrameSend(clientId, frame, WSB_HEADER + sizeof(fields) + 1 + len, true);
+        return;
+    }
+
+    // Write JSON straight into the frame
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    json.beginObject();
+    json.addString("type", "result");
+    json.addInt("id", id);
+    json.addInt("status", status);
+    json.addInt("depth", depth);
+    json.addInt("us", duration);
+
+    // Output goes last, cut off if it does not fit the frame
+    size_t room = WS_FRAME_SIZE - WS_JSON_CLOSE - json.length() -
+                  strlen(",\"truncated\":false,\"output\":\"\"");
+    json.addBool("truncated", truncated || JsonWriter::escapedLength(text, textLen) > room);
+    json.addString("output", text, textLen);
+    json.endObject();
+
+    wsFrameSendJson(clientId, frame, json);
+}
+
+/**
+ * Send scan stats
+ * 
+ * Send scan cycle statistics JSON (times in us).
+ */
+void wsSendScanStats() {
+    char * frame = wsFrameAcquire(true);
+    if (!frame) {
+        return;
+    }
+    struct scanStats stats;
+    scanGetStats(&stats);
+
+    // Write JSON straight into the frame
+    JsonWriter json(frame, WS_FRAME_SIZE);
+    json.beginObject();
+    json.addString("type", "scanStats");
+    json.addBool("running", stats.running);
+    json.addInt("period", stats.periodMs);
+    json.addInt("cycles", stats.cycles);
+    json.addInt("overruns", stats.overruns);
+    json.addInt("min", stats.minTime);
+    json.addInt("max", stats.maxTime);
+    json.addInt("mean", stats.cycles ? stats.sumTime / stats.cycles : 0);
+    json.addInt("jitter", stats.maxJitter);
+    json.endObject();
+
+    wsFrameSendJson(wsClientId(), frame, json);
+}
@@ -17,10 +17,10 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <SPIFFS.h>
 #include <WiFi.h>
 
 #include "io.h"
+#include "storage.h"
 #include "wlan.h"
 
 #define SSID_MAX_LEN 33
@@ -42,7 +42,7 @@ struct WlanConf {
  */
 bool getWlanConfigJSON() {
     // Open configuration file
-    File confFile = SPIFFS.open("/cfg/config.json");
+    File confFile = storage.open("/cfg/config.json");
 
     // Allocate JSON document and deserialize
     DynamicJsonDocument doc(2048);
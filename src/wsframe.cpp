@@ -0,0 +1,455 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <new>
+
+#include "wsframe.h"
+
+#define WS_SENDING_TASKS 4  // Tasks queueing a message at once, counted in wsMallocs
+
+
+extern AsyncWebSocket ws;
+
+/**
+ * Frame message
+ * 
+ * Websocket message sent straight from a pooled frame. Lives in the pool
+ * entry of its frame, the library deleting it returns the frame.
+ * Uses AsyncWebSocketMessage internals of ESP Async WebServer 1.2.3,
+ * the version pinned in platformio.ini.
+ */
+class wsFrameMessage : public AsyncWebSocketMessage {
+  public:
+    wsFrameMessage(char * frame, size_t len, bool binary)
+        : _frame(frame), _len(len), _sent(0), _ack(0), _acked(0) {
+        _opcode = binary ? WS_BINARY : WS_TEXT;
+        _status = WS_MSG_SENDING;
+    }
+
+    virtual ~wsFrameMessage() {
+        wsFrameRelease(_frame);
+    }
+
+    // Storage comes with the frame
+    static void * operator new(size_t size, void * where) {
+        return where;
+    }
+    static void operator delete(void * p) {}
+
+    virtual void ack(size_t len, uint32_t time) {
+        _acked += len;
+        if (_sent == _len && _acked == _ack) {
+            _status = WS_MSG_SENT;
+        }
+    }
+
+    virtual bool betweenFrames() const {
+        return _acked == _ack;
+    }
+
+    /**
+     * Send
+     * 
+     * Send as much of the message as the connection takes in one
+     * websocket frame (server frames are not masked).
+     */
+    virtual size_t send(AsyncClient * client) {
+        if (_status != WS_MSG_SENDING || _acked < _ack) {
+            return 0;
+        }
+        if (_sent == _len) {
+            if (_acked == _ack) {
+                _status = WS_MSG_SENT;
+            }
+            return 0;
+        }
+
+        // Keep room for the longest frame header
+        if (!client->canSend() || client->space() < 9) {
+            return 0;
+        }
+        size_t len = min(_len - _sent, client->space() - 8);
+
+        uint8_t head[4];
+        size_t headLen = 2;
+        head[0] = (_sent ? WS_CONTINUATION : _opcode) | (_sent + len == _len ? 0x80 : 0);
+        if (len < 126) {
+            head[1] = len;
+        } else {
+            head[1] = 126;
+            head[2] = len >> 8;
+            head[3] = len & 0xFF;
+            headLen = 4;
+        }
+        client->add((const char *) head, headLen);
+        client->add(_frame + _sent, len);
+        client->send();
+
+        _sent += len;
+        _ack += headLen + len;
+        return len;
+    }
+
+  private:
+    char * _frame;
+    size_t _len;
+    size_t _sent;
+    size_t _ack;    // Bytes to be acknowledged by the peer
+    size_t _acked;
+};
+
+// Frame pool, message object is built next to its frame
+struct wsFrameEntry {
+    char data[WS_FRAME_SIZE];
+    alignas(wsFrameMessage) uint8_t message[sizeof(wsFrameMessage)];
+    bool used;
+};
+struct wsFrameEntry wsFrames[WS_FRAME_COUNT];
+portMUX_TYPE wsFramesMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint32_t wsFrameMissCount = 0;
+
+// Tasks queueing a message meanwhile, whose heap allocations are counted
+TaskHandle_t wsSendingTasks[WS_SENDING_TASKS];
+volatile uint8_t wsSendingCount = 0;
+volatile uint32_t wsMallocCount = 0;
+
+
+/**
+ * JSON writer
+ */
+JsonWriter::JsonWriter(char * buf, size_t size)
+    : _buf(buf), _size(size), _len(0), _overflow(false), _members(0), _depth(0) {}
+
+/**
+ * JSON writer put
+ * 
+ * Append raw chars, keeping room for closing brackets.
+ */
+bool JsonWriter::put(const char * s, size_t n) {
+    if (_overflow || _len + n > _size - WS_JSON_CLOSE) {
+        _overflow = true;
+        return false;
+    }
+    memcpy(_buf + _len, s, n);
+    _len += n;
+    return true;
+}
+
+/**
+ * JSON writer member
+ * 
+ * Start next member (or array element) of current level.
+ */
+bool JsonWriter::member(const char * key) {
+    uint32_t bit = 1UL << _depth;
+    if ((_members & bit) && !put(",", 1)) {
+        return false;
+    }
+    _members |= bit;
+    if (!key) {
+        return true;
+    }
+    return put("\"", 1) && put(key, strlen(key)) && put("\":", 2);
+}
+
+void JsonWriter::open(const char * key, char bracket) {
+    if (_depth && !member(key)) {
+        return;
+    }
+    if (put(&bracket, 1)) {
+        _depth++;
+        _members &= ~(1UL << _depth);
+    }
+}
+
+void JsonWriter::close(char bracket) {
+    // Closing brackets always fit (WS_JSON_CLOSE)
+    if (_depth && _len < _size) {
+        _buf[_len++] = bracket;
+        _depth--;
+    }
+}
+
+void JsonWriter::beginObject(const char * key) {
+    open(key, '{');
+}
+
+void JsonWriter::beginArray(const char * key) {
+    open(key, '[');
+}
+
+void JsonWriter::endObject() {
+    close('}');
+}
+
+void JsonWriter::endArray() {
+    close(']');
+}
+
+void JsonWriter::addString(const char * key, const char * value) {
+    size_t len = strlen(value);
+    if (addString(key, value, len) < len) {
+        _overflow = true;
+    }
+}
+
+size_t JsonWriter::addString(const char * key, const char * value, size_t len) {
+    if (!member(key) || !put("\"", 1)) {
+        return 0;
+    }
+
+    // Escape while it fits, leave room for closing quote
+    size_t i;
+    for (i = 0; i < len; i++) {
+        char c = value[i];
+        char esc[6] = {'\\', c, 0, 0, 0, 0};
+        size_t n = 2;
+        switch (c) {
+            case '"': case '\\': break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                if ((unsigned char) c >= 0x20) {
+                    esc[0] = c;
+                    n = 1;
+                } else {
+                    // \u00XX
+                    esc[1] = 'u';
+                    esc[2] = esc[3] = '0';
+                    esc[4] = "0123456789abcdef"[c >> 4];
+                    esc[5] = "0123456789abcdef"[c & 0xF];
+                    n = 6;
+                }
+        }
+        if (_len + n + 1 > _size - WS_JSON_CLOSE) {
+            break;
+        }
+        memcpy(_buf + _len, esc, n);
+        _len += n;
+    }
+    _buf[_len++] = '"';
+    return i;
+}
+
+size_t JsonWriter::escapedLength(const char * value, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = value[i];
+        if (c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\t') {
+            n += 2;
+        } else {
+            n += (unsigned char) c < 0x20 ? 6 : 1;
+        }
+    }
+    return n;
+}
+
+void JsonWriter::addInt(const char * key, int64_t value) {
+    char digits[21];
+    size_t n = 0;
+    uint64_t v = value < 0 ? -(uint64_t) value : value;
+    do {
+        digits[sizeof(digits) - 1 - n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (value < 0) {
+        digits[sizeof(digits) - 1 - n++] = '-';
+    }
+    if (member(key)) {
+        put(digits + sizeof(digits) - n, n);
+    }
+}
+
+void JsonWriter::addBool(const char * key, bool value) {
+    if (member(key)) {
+        put(value ? "true" : "false", value ? 4 : 5);
+    }
+}
+
+/**
+ * Frame pooled
+ * 
+ * Returns true if frame comes from the pool, false if from heap.
+ */
+static bool wsFramePooled(const char * frame) {
+    return frame >= (const char *) wsFrames &&
+           frame < (const char *) (wsFrames + WS_FRAME_COUNT);
+}
+
+/**
+ * Frame acquire
+ * 
+ * Take a free frame of WS_FRAME_SIZE bytes from the pool.
+ * Unless `reply` is set, WS_FRAME_RESERVE frames are left free.
+ * A reply finding the pool empty gets a frame from heap instead.
+ * Returns NULL if no frame is available.
+ */
+char * wsFrameAcquire(bool reply) {
+    struct wsFrameEntry * entry = NULL;
+    int free = 0;
+
+    portENTER_CRITICAL(&wsFramesMux);
+    for (int i = 0; i < WS_FRAME_COUNT; i++) {
+        if (!wsFrames[i].used) {
+            free++;
+            entry = entry ? entry : &wsFrames[i];
+        }
+    }
+    if (entry && (reply || free > WS_FRAME_RESERVE)) {
+        entry->used = true;
+    } else {
+        entry = NULL;
+    }
+    portEXIT_CRITICAL(&wsFramesMux);
+
+    if (entry) {
+        return entry->data;
+    }
+    if (!reply) {
+        return NULL;
+    }
+
+    // Replies are not dropped, the message is copied by the library
+    wsFrameMissCount++;
+    wsMallocCount++;
+    return (char *) malloc(WS_FRAME_SIZE);
+}
+
+/**
+ * Frame release
+ * 
+ * Return unsent frame to the pool.
+ */
+void wsFrameRelease(char * frame) {
+    if (!wsFramePooled(frame)) {
+        free(frame);
+        return;
+    }
+
+    // Frame data is at the start of its entry
+    struct wsFrameEntry * entry = (struct wsFrameEntry *) frame;
+    portENTER_CRITICAL(&wsFramesMux);
+    entry->used = false;
+    portEXIT_CRITICAL(&wsFramesMux);
+}
+
+/**
+ * Frame sending
+ * 
+ * Start or stop counting heap allocations of the calling task,
+ * which is queueing a message.
+ */
+static void wsFrameSending(bool sending) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&wsFramesMux);
+    for (int i = 0; i < WS_SENDING_TASKS; i++) {
+        if (sending && !wsSendingTasks[i]) {
+            wsSendingTasks[i] = task;
+            wsSendingCount++;
+            break;
+        }
+        if (!sending && wsSendingTasks[i] == task) {
+            wsSendingTasks[i] = NULL;
+            wsSendingCount--;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&wsFramesMux);
+}
+
+/**
+ * Frame send
+ * 
+ * Queue frame to client without copying it. The frame returns to the pool
+ * once sent (or when the client goes away). Heap frame is copied and freed.
+ * Returns false if the client is not connected (frame is released).
+ */
+bool wsFrameSend(uint32_t clientId, char * frame, size_t len, bool binary) {
+    AsyncWebSocketClient * client = ws.client(clientId);
+    if (!client || client->status() != WS_CONNECTED) {
+        wsFrameRelease(frame);
+        return false;
+    }
+
+    wsFrameSending(true);
+    if (!wsFramePooled(frame)) {
+        if (binary) {
+            client->binary(frame, len);
+        } else {
+            client->text(frame, len);
+        }
+        free(frame);
+    } else {
+        struct wsFrameEntry * entry = (struct wsFrameEntry *) frame;
+        client->message(new (entry->message) wsFrameMessage(frame, len, binary));
+    }
+    wsFrameSending(false);
+    return true;
+}
+
+/**
+ * Frame send JSON
+ * 
+ * Send JSON written into a frame, incomplete JSON is dropped.
+ */
+bool wsFrameSendJson(uint32_t clientId, char * frame, const JsonWriter & json) {
+    if (json.overflow()) {
+        wsFrameRelease(frame);
+        wsFrameMissCount++;
+        return false;
+    }
+    return wsFrameSend(clientId, frame, json.length(), false);
+}
+
+/**
+ * Frame misses
+ * 
+ * Returns the number of messages dropped or sent from heap
+ * for lack of a free frame.
+ */
+uint32_t wsFrameMisses() {
+    return wsFrameMissCount;
+}
+
+/**
+ * Web mallocs
+ * 
+ * Returns the number of heap allocations made while queueing outgoing
+ * websocket messages (library queue nodes, replies sent from heap).
+ */
+uint32_t wsMallocs() {
+    return wsMallocCount;
+}
+
+// Every malloc() is routed here (-Wl,--wrap=malloc in platformio.ini)
+extern "C" void * __real_malloc(size_t size);
+
+extern "C" void * IRAM_ATTR __wrap_malloc(size_t size) {
+    if (wsSendingCount) {
+        TaskHandle_t task = xTaskGetCurrentTaskHandle();
+        for (int i = 0; i < WS_SENDING_TASKS; i++) {
+            if (wsSendingTasks[i] && wsSendingTasks[i] == task) {
+                wsMallocCount++;
+                break;
+            }
+        }
+    }
+    return __real_malloc(size);
+}
@@ -0,0 +1,409 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Filesystem benchmark
+ * 
+ * Compares SPIFFS and LittleFS open, append and list latency and
+ * throughput on the host, using the same library sources the filesystem
+ * image tools (mkspiffs, mklittlefs) are built from, on an emulated NOR
+ * flash partition of the firmware's size and geometry.
+ * 
+ * Host time shows the CPU work of each filesystem. Flash time is modelled
+ * from counted flash operations with typical SPI NOR timing, this is what
+ * dominates on the ESP32.
+ * 
+ * Build (SPIFFS = spiffs/src, LFS = littlefs checkout):
+ *   cc -O2 -o fsbench tools/fsbench/fsbench.c -Itools/fsbench \
+ *      -I$SPIFFS $SPIFFS/spiffs_*.c -I$LFS $LFS/lfs.c $LFS/lfs_util.c
+ *   ./fsbench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lfs.h"
+#include "spiffs.h"
+
+#define FLASH_SIZE 0x170000     // Filesystem partition of the default 4 MB layout
+#define FLASH_BLOCK 4096        // Erase block
+#define FLASH_PAGE 256          // Program page
+
+#define FLASH_READ_NS_PER_BYTE 50       // 80 MHz DIO read
+#define FLASH_PROG_US_PER_PAGE 700      // Page program
+#define FLASH_ERASE_US_PER_BLOCK 45000  // Sector erase
+
+#define BENCH_FILE_SIZE 2048    // Size of files filling the filesystem
+#define BENCH_OPENS 200         // Opens measured per stage
+#define BENCH_APPENDS 200       // Appends measured per stage
+#define BENCH_RECORD 64         // Bytes per append (log line)
+#define BENCH_PATH_FMT "/log/%04d.txt"
+
+// Files present in each stage, kept below capacity: LittleFS stores each
+// file in blocks of its own, so 368 blocks hold about 360 files of this size
+static const int stages[] = {16, 64, 128, 192, 256};
+
+// Emulated flash and operation counters
+static uint8_t flash[FLASH_SIZE];
+static struct {
+    uint64_t read;      // Bytes read
+    uint64_t pages;     // Pages programmed
+    uint64_t erased;    // Blocks erased
+} flashOps;
+
+static void flashRead(uint32_t addr, void * dst, uint32_t size) {
+    memcpy(dst, flash + addr, size);
+    flashOps.read += size;
+}
+
+static void flashProg(uint32_t addr, const void * src, uint32_t size) {
+    const uint8_t * s = src;
+    // NOR flash only clears bits
+    for (uint32_t i = 0; i < size; i++) {
+        flash[addr + i] &= s[i];
+    }
+    flashOps.pages += (addr % FLASH_PAGE + size + FLASH_PAGE - 1) / FLASH_PAGE;
+}
+
+static void flashErase(uint32_t addr, uint32_t size) {
+    memset(flash + addr, 0xFF, size);
+    flashOps.erased += size / FLASH_BLOCK;
+}
+
+// Modelled flash time in us of counted operations
+static double flashUs() {
+    return flashOps.read * FLASH_READ_NS_PER_BYTE / 1000.0 +
+           flashOps.pages * FLASH_PROG_US_PER_PAGE +
+           flashOps.erased * FLASH_ERASE_US_PER_BLOCK;
+}
+
+static double hostUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+// Filesystem under test
+struct fsOps {
+    const char * name;
+    int (*format)(void);
+    int (*create)(const char * path, const void * data, size_t len);
+    int (*openClose)(const char * path);
+    int (*append)(const char * path, const void * data, size_t len);
+    int (*list)(void);      // Returns number of files
+    void (*usage)(uint32_t * total, uint32_t * used);
+};
+
+
+// SPIFFS ///////////////////////////////////////////////////////////////////////////////////////
+
+static spiffs sfs;
+static spiffs_config scfg;
+static uint8_t spiffsWork[FLASH_PAGE * 2];
+static uint8_t spiffsFds[32 * 8];
+static uint8_t spiffsCache[(FLASH_PAGE + 32) * 8];
+
+static s32_t spiffsRead(u32_t addr, u32_t size, u8_t * dst) {
+    flashRead(addr, dst, size);
+    return SPIFFS_OK;
+}
+
+static s32_t spiffsWrite(u32_t addr, u32_t size, u8_t * src) {
+    flashProg(addr, src, size);
+    return SPIFFS_OK;
+}
+
+static s32_t spiffsErase(u32_t addr, u32_t size) {
+    flashErase(addr, size);
+    return SPIFFS_OK;
+}
+
+static int spiffsMount() {
+    return SPIFFS_mount(&sfs, &scfg, spiffsWork, spiffsFds, sizeof(spiffsFds),
+                        spiffsCache, sizeof(spiffsCache), NULL);
+}
+
+static int spiffsFormat() {
+    scfg.hal_read_f = spiffsRead;
+    scfg.hal_write_f = spiffsWrite;
+    scfg.hal_erase_f = spiffsErase;
+    scfg.phys_size = FLASH_SIZE;
+    scfg.phys_addr = 0;
+    scfg.phys_erase_block = FLASH_BLOCK;
+    scfg.log_block_size = FLASH_BLOCK;
+    scfg.log_page_size = FLASH_PAGE;
+
+    // Format needs the configuration a mount attempt leaves behind
+    spiffsMount();
+    SPIFFS_unmount(&sfs);
+    if (SPIFFS_format(&sfs) != SPIFFS_OK) {
+        return -1;
+    }
+    return spiffsMount();
+}
+
+static int spiffsCreate(const char * path, const void * data, size_t len) {
+    spiffs_file fd = SPIFFS_open(&sfs, path, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_WRONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int res = SPIFFS_write(&sfs, fd, (void *) data, len);
+    SPIFFS_close(&sfs, fd);
+    return res < 0 ? -1 : 0;
+}
+
+static int spiffsOpenClose(const char * path) {
+    spiffs_file fd = SPIFFS_open(&sfs, path, SPIFFS_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    SPIFFS_close(&sfs, fd);
+    return 0;
+}
+
+static int spiffsAppend(const char * path, const void * data, size_t len) {
+    spiffs_file fd = SPIFFS_open(&sfs, path, SPIFFS_CREAT | SPIFFS_APPEND | SPIFFS_WRONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int res = SPIFFS_write(&sfs, fd, (void *) data, len);
+    SPIFFS_close(&sfs, fd);
+    return res < 0 ? -1 : 0;
+}
+
+static int spiffsList() {
+    spiffs_DIR dir;
+    struct spiffs_dirent entry;
+    int n = 0;
+
+    if (!SPIFFS_opendir(&sfs, "/", &dir)) {
+        return -1;
+    }
+    while (SPIFFS_readdir(&dir, &entry)) {
+        n++;
+    }
+    SPIFFS_closedir(&dir);
+    return n;
+}
+
+static void spiffsUsage(uint32_t * total, uint32_t * used) {
+    SPIFFS_info(&sfs, total, used);
+}
+
+
+// LittleFS /////////////////////////////////////////////////////////////////////////////////////
+
+static lfs_t lfs;
+
+static int lfsRead(const struct lfs_config * c, lfs_block_t block, lfs_off_t off,
+                   void * buffer, lfs_size_t size) {
+    flashRead(block * c->block_size + off, buffer, size);
+    return 0;
+}
+
+static int lfsProg(const struct lfs_config * c, lfs_block_t block, lfs_off_t off,
+                   const void * buffer, lfs_size_t size) {
+    flashProg(block * c->block_size + off, buffer, size);
+    return 0;
+}
+
+static int lfsErase(const struct lfs_config * c, lfs_block_t block) {
+    flashErase(block * c->block_size, c->block_size);
+    return 0;
+}
+
+static int lfsSync(const struct lfs_config * c) {
+    (void) c;
+    return 0;
+}
+
+// Sizes follow the ESP32 LittleFS port defaults
+static const struct lfs_config lcfg = {
+    .read = lfsRead,
+    .prog = lfsProg,
+    .erase = lfsErase,
+    .sync = lfsSync,
+    .read_size = 128,
+    .prog_size = 128,
+    .block_size = FLASH_BLOCK,
+    .block_count = FLASH_SIZE / FLASH_BLOCK,
+    .block_cycles = 512,
+    .cache_size = 512,
+    .lookahead_size = 128,
+};
+
+static int lfsFormat() {
+    if (lfs_format(&lfs, &lcfg) || lfs_mount(&lfs, &lcfg)) {
+        return -1;
+    }
+    return lfs_mkdir(&lfs, "/log");
+}
+
+static int lfsWriteFile(const char * path, int flags, const void * data, size_t len) {
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, path, flags) < 0) {
+        return -1;
+    }
+    int res = lfs_file_write(&lfs, &file, data, len);
+    lfs_file_close(&lfs, &file);
+    return res < 0 ? -1 : 0;
+}
+
+static int lfsCreate(const char * path, const void * data, size_t len) {
+    return lfsWriteFile(path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC, data, len);
+}
+
+static int lfsOpenClose(const char * path) {
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, path, LFS_O_RDONLY) < 0) {
+        return -1;
+    }
+    lfs_file_close(&lfs, &file);
+    return 0;
+}
+
+static int lfsAppend(const char * path, const void * data, size_t len) {
+    return lfsWriteFile(path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND, data, len);
+}
+
+// Count files in directory and its subdirectories
+static int lfsListDir(const char * path) {
+    lfs_dir_t dir;
+    struct lfs_info info;
+    char sub[64];
+    int n = 0;
+
+    if (lfs_dir_open(&lfs, &dir, path) < 0) {
+        return -1;
+    }
+    while (lfs_dir_read(&lfs, &dir, &info) > 0) {
+        if (info.type == LFS_TYPE_REG) {
+            n++;
+        } else if (strcmp(info.name, ".") && strcmp(info.name, "..")) {
+            snprintf(sub, sizeof(sub), "%s/%s", strcmp(path, "/") ? path : "", info.name);
+            n += lfsListDir(sub);
+        }
+    }
+    lfs_dir_close(&lfs, &dir);
+    return n;
+}
+
+static int lfsList() {
+    return lfsListDir("/");
+}
+
+static void lfsUsage(uint32_t * total, uint32_t * used) {
+    *total = FLASH_SIZE;
+    *used = lfs_fs_size(&lfs) * FLASH_BLOCK;
+}
+
+
+// Benchmark ////////////////////////////////////////////////////////////////////////////////////
+
+static const struct fsOps filesystems[] = {
+    {"SPIFFS", spiffsFormat, spiffsCreate, spiffsOpenClose, spiffsAppend, spiffsList, spiffsUsage},
+    {"LittleFS", lfsFormat, lfsCreate, lfsOpenClose, lfsAppend, lfsList, lfsUsage},
+};
+
+// Time of an operation: host CPU and modelled flash, per repetition in us
+struct timing {
+    double host;
+    double flash;
+};
+
+static void timingStart(struct timing * t) {
+    memset(&flashOps, 0, sizeof(flashOps));
+    t->host = hostUs();
+}
+
+static void timingStop(struct timing * t, int reps) {
+    t->host = (hostUs() - t->host) / reps;
+    t->flash = flashUs() / reps;
+}
+
+static void bench(const struct fsOps * fs) {
+    static uint8_t content[BENCH_FILE_SIZE];
+    char path[32];
+    int files = 0;
+
+    memset(flash, 0xFF, sizeof(flash));
+    memset(content, 'x', sizeof(content));
+    if (fs->format()) {
+        printf("%s: format failed\n", fs->name);
+        return;
+    }
+
+    for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) {
+        struct timing open, append, list;
+        uint32_t total, used;
+        int listed = 0;
+
+        // Fill up to the stage's file count
+        for (; files < stages[s]; files++) {
+            snprintf(path, sizeof(path), BENCH_PATH_FMT, files);
+            if (fs->create(path, content, sizeof(content))) {
+                printf("%s: full at %d files\n", fs->name, files);
+                return;
+            }
+        }
+
+        // Open and close existing files in scattered order
+        timingStart(&open);
+        for (int i = 0; i < BENCH_OPENS; i++) {
+            snprintf(path, sizeof(path), BENCH_PATH_FMT, (i * 7919) % files);
+            fs->openClose(path);
+        }
+        timingStop(&open, BENCH_OPENS);
+
+        // Append log records to one file, reopening it each time
+        snprintf(path, sizeof(path), "/log/append%d.txt", (int) s);
+        timingStart(&append);
+        for (int i = 0; i < BENCH_APPENDS; i++) {
+            if (fs->append(path, content, BENCH_RECORD)) {
+                printf("%s: append failed\n", fs->name);
+                return;
+            }
+        }
+        timingStop(&append, BENCH_APPENDS);
+
+        // List all files
+        timingStart(&list);
+        listed = fs->list();
+        timingStop(&list, 1);
+
+        fs->usage(&total, &used);
+        printf("%-9s %5d %4u%% | %8.1f %9.1f | %8.1f %9.1f %7.1f | %8.1f %9.1f\n",
+               fs->name, listed, (unsigned) (100.0 * used / total),
+               open.host, open.flash,
+               append.host, append.flash, BENCH_RECORD * 1000.0 / (append.host + append.flash),
+               list.host / 1000, list.flash / 1000);
+    }
+}
+
+int main() {
+    printf("%-9s %5s %5s | %-18s | %-26s | %s\n", "", "", "",
+           "open+close (us)", "append 64 B (us, kB/s)", "list (ms)");
+    printf("%-9s %5s %5s | %8s %9s | %8s %9s %7s | %8s %9s\n", "fs", "files", "used",
+           "host", "flash", "host", "flash", "kB/s", "host", "flash");
+    for (size_t i = 0; i < sizeof(filesystems) / sizeof(filesystems[0]); i++) {
+        bench(&filesystems[i]);
+    }
+    return 0;
+}
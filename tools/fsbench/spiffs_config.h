@@ -0,0 +1,77 @@
+/* This file is part of Interactive Atlast Forth Interpreter For ESP32.
+ * Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* SPIFFS build configuration for the host benchmark, values follow the
+ * ESP-IDF spiffs component (sdkconfig defaults) so the on-flash layout and
+ * behaviour match the firmware image. */
+
+#ifndef SPIFFS_CONFIG_H_
+#define SPIFFS_CONFIG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+typedef int32_t s32_t;
+typedef uint32_t u32_t;
+typedef int16_t s16_t;
+typedef uint16_t u16_t;
+typedef int8_t s8_t;
+typedef uint8_t u8_t;
+
+typedef u16_t spiffs_block_ix;
+typedef u16_t spiffs_page_ix;
+typedef u16_t spiffs_obj_id;
+typedef u16_t spiffs_span_ix;
+
+#define SPIFFS_DBG(...)
+#define SPIFFS_GC_DBG(...)
+#define SPIFFS_CACHE_DBG(...)
+#define SPIFFS_CHECK_DBG(...)
+#define SPIFFS_API_DBG(...)
+
+#define SPIFFS_BUFFER_HELP 0
+#define SPIFFS_CACHE 1
+#define SPIFFS_CACHE_WR 1
+#define SPIFFS_CACHE_STATS 0
+#define SPIFFS_PAGE_CHECK 1
+#define SPIFFS_GC_MAX_RUNS 10
+#define SPIFFS_GC_STATS 0
+#define SPIFFS_GC_HEUR_W_DELET (5)
+#define SPIFFS_GC_HEUR_W_USED (-1)
+#define SPIFFS_GC_HEUR_W_AGE (50)
+#define SPIFFS_OBJ_NAME_LEN 32
+#define SPIFFS_OBJ_META_LEN 4      // mtime
+#define SPIFFS_COPY_BUFFER_STACK 256
+#define SPIFFS_USE_MAGIC 1
+#define SPIFFS_USE_MAGIC_LENGTH 1
+#define SPIFFS_LOCK(fs)
+#define SPIFFS_UNLOCK(fs)
+#define SPIFFS_SINGLETON 0
+#define SPIFFS_ALIGNED_OBJECT_INDEX_TABLES 0
+#define SPIFFS_HAL_CALLBACK_EXTRA 0
+#define SPIFFS_FILEHDL_OFFSET 0
+#define SPIFFS_READ_ONLY 0
+#define SPIFFS_TEMPORAL_FD_CACHE 1
+#define SPIFFS_TEMPORAL_CACHE_HIT_SCORE 4
+#define SPIFFS_IX_MAP 1
+#define SPIFFS_NO_BLIND_WRITES 0
+#define SPIFFS_TEST_VISUALISATION 0
+#define SPIFFS_SECURE_ERASE 0
+
+#endif // SPIFFS_CONFIG_H_
@@ -0,0 +1,53 @@
+# This file is part of Interactive Atlast Forth Interpreter For ESP32.
+# Copyright (C) 2021  Vojtech Fryblik <433796@mail.muni.cz>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# PlatformIO pre script: stage "data" for the filesystem image with web
+# assets ("data/www") replaced by their gzipped variants. The server sends
+# them with "Content-Encoding: gzip" (see src/assets.cpp).
+
+import gzip
+import os
+import shutil
+
+Import("env")
+
+WWW = "www"
+PATH_MAX = 31   # Object name length without terminator (SPIFFS limit, kept for LittleFS)
+
+src = env.subst("$PROJECT_DATA_DIR")
+dst = os.path.join(env.subst("$BUILD_DIR"), "data")
+
+if os.path.isdir(dst):
+    shutil.rmtree(dst)
+shutil.copytree(src, dst, ignore=shutil.ignore_patterns(WWW))
+os.makedirs(os.path.join(dst, WWW))
+
+plain = packed = 0
+for name in sorted(os.listdir(os.path.join(src, WWW))):
+    path = "/%s/%s.gz" % (WWW, name)
+    if len(path) > PATH_MAX:
+        env.Exit("gzip_www: \"%s\" is longer than %d characters" % (path, PATH_MAX))
+    with open(os.path.join(src, WWW, name), "rb") as f:
+        data = f.read()
+    # No timestamp in the header, unchanged files keep their ETag
+    out = gzip.compress(data, 9, mtime=0)
+    with open(os.path.join(dst, WWW, name + ".gz"), "wb") as f:
+        f.write(out)
+    plain += len(data)
+    packed += len(out)
+
+print("gzip_www: %d -> %d bytes (%d%%)" % (plain, packed, 100 * packed // max(plain, 1)))
+env.Replace(PROJECT_DATA_DIR=dst)